@@ -0,0 +1,283 @@
+#include "pch.h"
+
+#include "TitanAudioModem.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/crc32.h>
+
+namespace {
+
+const int kSymbolsPerSecond = 100;
+const int kSyncFrequencies[] = {500, 700};
+const size_t kSyncSymbols = 2;
+const int kFirstToneFrequency = 1000;
+const int kToneSpacing = 100;
+const int kToneGroups = 4;
+const int kTonesPerGroup = 16;
+const size_t kBytesPerSymbol = kToneGroups / 2;
+const size_t kCrcSize = 4;
+
+// Peak of a single tone; four of them together still leave some headroom.
+const double kToneAmplitude = 6000.0;
+// Share of the window energy the sync tone must have to be taken as one.
+const double kSyncThreshold = 0.5;
+// RMS level below which a window is treated as silence.
+const double kMinLevel = 300.0;
+// Steps the sync search slides its window by, in fractions of a symbol.
+const size_t kSearchSteps = 8;
+
+const double kPi = 3.14159265358979323846;
+
+int ToneFrequency(int group, int value) {
+  return kFirstToneFrequency + (group * kTonesPerGroup + value) * kToneSpacing;
+}
+
+}  // namespace
+
+bool IsValidTitanAudioSampleRate(int sample_rate) {
+  return sample_rate >= 16000 && sample_rate % kSymbolsPerSecond == 0;
+}
+
+TitanAudioModulator::TitanAudioModulator(int sample_rate)
+    : sample_rate_(sample_rate),
+      symbol_samples_(sample_rate / kSymbolsPerSecond),
+      symbol_index_(0) {
+  RTC_DCHECK(IsValidTitanAudioSampleRate(sample_rate));
+}
+
+bool TitanAudioModulator::Start(const uint8_t* data, size_t size) {
+  RTC_DCHECK(idle());
+  if (size == 0 || size > kTitanAudioMaxMessageSize)
+    return false;
+
+  size_t packet_size = 1 + size + kCrcSize;
+  packet_size += (kBytesPerSymbol - packet_size % kBytesPerSymbol) %
+                 kBytesPerSymbol;
+  packet_.assign(packet_size, 0);
+  packet_[0] = static_cast<uint8_t>(size);
+  memcpy(&packet_[1], data, size);
+  uint32_t crc = rtc::ComputeCrc32(packet_.data(), 1 + size);
+  for (size_t i = 0; i < kCrcSize; ++i)
+    packet_[1 + size + i] = static_cast<uint8_t>(crc >> (24 - 8 * i));
+  symbol_index_ = 0;
+  return true;
+}
+
+void TitanAudioModulator::RenderSymbol(int16_t* samples) {
+  if (idle()) {
+    memset(samples, 0, symbol_samples_ * sizeof(*samples));
+    return;
+  }
+
+  if (symbol_index_ < kSyncSymbols) {
+    RenderTones(&kSyncFrequencies[symbol_index_], 1, samples);
+  } else {
+    const uint8_t* bytes =
+        &packet_[(symbol_index_ - kSyncSymbols) * kBytesPerSymbol];
+    int frequencies[kToneGroups];
+    for (int group = 0; group < kToneGroups; ++group) {
+      uint8_t byte = bytes[group / 2];
+      int nibble = group % 2 == 0 ? byte >> 4 : byte & 0x0f;
+      frequencies[group] = ToneFrequency(group, nibble);
+    }
+    RenderTones(frequencies, kToneGroups, samples);
+  }
+
+  ++symbol_index_;
+  if (symbol_index_ == kSyncSymbols + packet_.size() / kBytesPerSymbol)
+    packet_.clear();
+}
+
+void TitanAudioModulator::RenderTones(const int* frequencies,
+                                      size_t count,
+                                      int16_t* samples) {
+  // Every symbol starts at phase zero, the receiver aligns its windows to the
+  // symbol boundaries so there is no need to keep the phase continuous.
+  for (size_t i = 0; i < symbol_samples_; ++i) {
+    double value = 0;
+    for (size_t tone = 0; tone < count; ++tone)
+      value += sin(2 * kPi * frequencies[tone] * i / sample_rate_);
+    samples[i] = static_cast<int16_t>(value * kToneAmplitude);
+  }
+}
+
+TitanAudioDemodulator::TitanAudioDemodulator(int sample_rate)
+    : sample_rate_(sample_rate),
+      symbol_samples_(sample_rate / kSymbolsPerSecond),
+      base_(0),
+      observer_(nullptr) {
+  RTC_DCHECK(IsValidTitanAudioSampleRate(sample_rate));
+  Reset(0);
+}
+
+void TitanAudioDemodulator::Process(const int16_t* samples,
+                                    size_t count,
+                                    size_t stride,
+                                    TitanTransportObserver* observer) {
+  for (size_t i = 0; i < count; ++i)
+    samples_.push_back(samples[i * stride]);
+  observer_ = observer;
+
+  const uint64_t step = symbol_samples_ / kSearchSteps;
+  for (;;) {
+    if (state_ == kSearching) {
+      if (!HasWindow(search_position_))
+        break;
+      double fraction = ToneFraction(search_position_, kSyncFrequencies[0]);
+      if (fraction >= kSyncThreshold && fraction >= best_fraction_) {
+        best_fraction_ = fraction;
+        best_position_ = search_position_;
+      } else if (best_fraction_ > 0 && (fraction < kSyncThreshold ||
+                                        fraction < best_fraction_ * 0.8)) {
+        // We have slid past the peak of the first sync tone.
+        Lock();
+        continue;
+      }
+      search_position_ += step;
+    } else if (state_ == kSecondSync) {
+      if (!HasWindow(symbol_position_))
+        break;
+      if (ToneFraction(symbol_position_, kSyncFrequencies[1]) <
+          kSyncThreshold) {
+        Reset(best_position_ + step);
+        continue;
+      }
+      symbol_position_ += symbol_samples_;
+      state_ = kData;
+    } else {
+      if (!HasWindow(symbol_position_))
+        break;
+      DecodeSymbol(symbol_position_);
+      symbol_position_ += symbol_samples_;
+    }
+  }
+
+  observer_ = nullptr;
+  Compact();
+}
+
+const float* TitanAudioDemodulator::Window(uint64_t position) const {
+  RTC_DCHECK(HasWindow(position));
+  return samples_.data() + (position - base_);
+}
+
+bool TitanAudioDemodulator::HasWindow(uint64_t position) const {
+  return position >= base_ &&
+         position + symbol_samples_ <= base_ + samples_.size();
+}
+
+double TitanAudioDemodulator::ToneFraction(uint64_t position,
+                                           int frequency) const {
+  const float* window = Window(position);
+  double energy = 0;
+  for (size_t i = 0; i < symbol_samples_; ++i)
+    energy += window[i] * window[i];
+  if (energy < kMinLevel * kMinLevel * symbol_samples_)
+    return 0;
+  // A pure tone filling the window has a power of N / 2 times its energy.
+  return 2 * TonePower(window, frequency) / (symbol_samples_ * energy);
+}
+
+double TitanAudioDemodulator::TonePower(const float* window,
+                                        int frequency) const {
+  // Goertzel filter for a single DFT bin.
+  double coefficient = 2 * cos(2 * kPi * frequency / sample_rate_);
+  double s1 = 0;
+  double s2 = 0;
+  for (size_t i = 0; i < symbol_samples_; ++i) {
+    double s0 = window[i] + coefficient * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  return s1 * s1 + s2 * s2 - coefficient * s1 * s2;
+}
+
+void TitanAudioDemodulator::DecodeSymbol(uint64_t position) {
+  const float* window = Window(position);
+  uint8_t bytes[kBytesPerSymbol] = {0};
+  for (int group = 0; group < kToneGroups; ++group) {
+    int best_value = 0;
+    double best_power = -1;
+    for (int value = 0; value < kTonesPerGroup; ++value) {
+      double power = TonePower(window, ToneFrequency(group, value));
+      if (power > best_power) {
+        best_power = power;
+        best_value = value;
+      }
+    }
+    bytes[group / 2] |= group % 2 == 0 ? best_value << 4 : best_value;
+  }
+  packet_.insert(packet_.end(), bytes, bytes + kBytesPerSymbol);
+
+  if (packet_size_ == 0) {
+    packet_size_ = 1 + packet_[0] + kCrcSize;
+    packet_size_ += (kBytesPerSymbol - packet_size_ % kBytesPerSymbol) %
+                    kBytesPerSymbol;
+  }
+  if (packet_.size() < packet_size_)
+    return;
+
+  size_t size = packet_[0];
+  uint32_t crc = 0;
+  for (size_t i = 0; i < kCrcSize; ++i)
+    crc = (crc << 8) | packet_[1 + size + i];
+  if (size > 0 && crc == rtc::ComputeCrc32(packet_.data(), 1 + size) &&
+      observer_) {
+    observer_->OnTransportMessage(&packet_[1], size);
+  }
+  Reset(position + symbol_samples_);
+}
+
+void TitanAudioDemodulator::Lock() {
+  // Refine the coarse peak found by the search before trusting it for the
+  // whole burst.
+  const uint64_t step = symbol_samples_ / kSearchSteps;
+  const uint64_t fine_step = step / 4 > 0 ? step / 4 : 1;
+  uint64_t start = best_position_ >= step + base_ ? best_position_ - step
+                                                  : base_;
+  for (uint64_t position = start; position <= best_position_ + step;
+       position += fine_step) {
+    if (!HasWindow(position))
+      break;
+    double fraction = ToneFraction(position, kSyncFrequencies[0]);
+    if (fraction > best_fraction_) {
+      best_fraction_ = fraction;
+      best_position_ = position;
+    }
+  }
+  symbol_position_ = best_position_ + symbol_samples_;
+  state_ = kSecondSync;
+}
+
+void TitanAudioDemodulator::Reset(uint64_t position) {
+  state_ = kSearching;
+  search_position_ = position;
+  best_position_ = position;
+  best_fraction_ = 0;
+  symbol_position_ = position;
+  packet_.clear();
+  packet_size_ = 0;
+}
+
+void TitanAudioDemodulator::Compact() {
+  // Lock() and a failed second sync both look back from |best_position_|.
+  uint64_t keep;
+  if (state_ == kData)
+    keep = symbol_position_;
+  else if (state_ == kSecondSync || best_fraction_ > 0)
+    keep = best_position_;
+  else
+    keep = search_position_;
+  const uint64_t step = symbol_samples_ / kSearchSteps;
+  keep = keep > step ? keep - step : 0;
+  if (keep <= base_)
+    return;
+  size_t drop = static_cast<size_t>(keep - base_);
+  if (drop > samples_.size())
+    drop = samples_.size();
+  samples_.erase(samples_.begin(), samples_.begin() + drop);
+  base_ += drop;
+}
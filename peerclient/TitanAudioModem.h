@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "TitanTransport.h"
+
+// Messages are sent as bursts of 10 ms symbols, one per audio frame. A burst
+// starts with two sync tones, followed by the length, the payload and a
+// CRC32. Every data symbol is four simultaneous tones, each picking one of 16
+// frequencies, so it carries two bytes. The tones sit on a 100 Hz grid
+// between 500 Hz and 7.3 kHz, which keeps them orthogonal over a 10 ms window
+// and inside what a wideband voice codec passes through.
+const size_t kTitanAudioMaxMessageSize = 255;
+
+// Sample rates must be a multiple of 100 Hz and at least 16 kHz.
+bool IsValidTitanAudioSampleRate(int sample_rate);
+
+class TitanAudioModulator {
+ public:
+  explicit TitanAudioModulator(int sample_rate);
+
+  int sample_rate() const { return sample_rate_; }
+  size_t symbol_samples() const { return symbol_samples_; }
+  bool idle() const { return packet_.empty(); }
+
+  // Starts the burst for |data|. Only valid while idle().
+  bool Start(const uint8_t* data, size_t size);
+
+  // Writes the next symbol_samples() mono samples of the current burst, or
+  // silence when idle.
+  void RenderSymbol(int16_t* samples);
+
+ private:
+  void RenderTones(const int* frequencies, size_t count, int16_t* samples);
+
+  const int sample_rate_;
+  const size_t symbol_samples_;
+  // Length, payload and CRC, padded to whole symbols.
+  std::vector<uint8_t> packet_;
+  // Symbols of the current burst written so far, sync tones included.
+  size_t symbol_index_;
+};
+
+class TitanAudioDemodulator {
+ public:
+  explicit TitanAudioDemodulator(int sample_rate);
+
+  int sample_rate() const { return sample_rate_; }
+
+  // Feeds |count| samples, taking every |stride|th one so that the first
+  // channel of interleaved audio can be passed directly. Every burst whose
+  // CRC checks out is handed to |observer|.
+  void Process(const int16_t* samples,
+               size_t count,
+               size_t stride,
+               TitanTransportObserver* observer);
+
+ private:
+  enum State { kSearching, kSecondSync, kData };
+
+  const float* Window(uint64_t position) const;
+  bool HasWindow(uint64_t position) const;
+  double ToneFraction(uint64_t position, int frequency) const;
+  double TonePower(const float* window, int frequency) const;
+  void DecodeSymbol(uint64_t position);
+  void Lock();
+  void Reset(uint64_t position);
+  void Compact();
+
+  const int sample_rate_;
+  const size_t symbol_samples_;
+
+  // Samples received and not yet consumed; |base_| is the stream position of
+  // the first one.
+  std::vector<float> samples_;
+  uint64_t base_;
+
+  State state_;
+  uint64_t search_position_;
+  uint64_t best_position_;
+  double best_fraction_;
+  uint64_t symbol_position_;
+  std::vector<uint8_t> packet_;
+  size_t packet_size_;
+  TitanTransportObserver* observer_;
+};
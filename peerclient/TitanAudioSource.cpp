@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "TitanAudioSource.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <rtc_base/checks.h>
+
+namespace {
+
+const int kFrameMs = 10;
+
+}  // namespace
+
+TitanAudioSource::TitanAudioSource(TitanAudioProvider* provider)
+    : provider_(provider), state_(kLive), running_(true) {
+  RTC_DCHECK(provider_);
+  thread_ = std::thread([this] { Run(); });
+}
+
+TitanAudioSource::~TitanAudioSource() {
+  Stop();
+}
+
+void TitanAudioSource::Stop() {
+  if (!running_.exchange(false))
+    return;
+  if (thread_.joinable())
+    thread_.join();
+  state_ = kEnded;
+  FireOnChanged();
+}
+
+void TitanAudioSource::AddSink(webrtc::AudioTrackSinkInterface* sink) {
+  rtc::CritScope lock(&sink_lock_);
+  if (std::find(sinks_.begin(), sinks_.end(), sink) == sinks_.end())
+    sinks_.push_back(sink);
+}
+
+void TitanAudioSource::RemoveSink(webrtc::AudioTrackSinkInterface* sink) {
+  rtc::CritScope lock(&sink_lock_);
+  sinks_.erase(std::remove(sinks_.begin(), sinks_.end(), sink), sinks_.end());
+}
+
+void TitanAudioSource::Run() {
+  const size_t frame_samples = kSampleRate * kFrameMs / 1000;
+  std::vector<int16_t> frame(frame_samples);
+
+  // Sleep until absolute deadlines so the cadence doesn't drift with the time
+  // spent rendering.
+  auto next = std::chrono::steady_clock::now();
+  while (running_.load()) {
+    next += std::chrono::milliseconds(kFrameMs);
+    std::this_thread::sleep_until(next);
+
+    rtc::CritScope lock(&sink_lock_);
+    // Without sinks the frame would be lost, leave the messages queued.
+    if (sinks_.empty())
+      continue;
+    provider_->RenderAudio(frame.data(), frame_samples, kSampleRate);
+    for (webrtc::AudioTrackSinkInterface* sink : sinks_)
+      sink->OnData(frame.data(), 16, kSampleRate, 1, frame_samples);
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <api/mediastreaminterface.h>
+#include <api/notifier.h>
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/refcountedobject.h>
+#include <rtc_base/thread_annotations.h>
+
+// Fills the frames a TitanAudioSource sends.
+class TitanAudioProvider {
+ public:
+  // Called every 10 ms on the audio thread with room for |count| mono
+  // samples at |sample_rate|.
+  virtual void RenderAudio(int16_t* samples, size_t count, int sample_rate) = 0;
+
+ protected:
+  virtual ~TitanAudioProvider() {}
+};
+
+// Audio source that produces 10 ms frames from a TitanAudioProvider instead
+// of a capture device, so the audio track can carry messages.
+class TitanAudioSource : public rtc::RefCountedObject<
+                             webrtc::Notifier<webrtc::AudioSourceInterface>> {
+ public:
+  static const int kSampleRate = 48000;
+
+  explicit TitanAudioSource(TitanAudioProvider* provider);
+
+  // Stops the audio thread; must be called before the provider goes away.
+  void Stop();
+
+  SourceState state() const override { return state_; }
+  bool remote() const override { return false; }
+
+  void AddSink(webrtc::AudioTrackSinkInterface* sink) override;
+  void RemoveSink(webrtc::AudioTrackSinkInterface* sink) override;
+
+ protected:
+  ~TitanAudioSource() override;
+
+ private:
+  void Run();
+
+  TitanAudioProvider* const provider_;
+  SourceState state_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+
+  rtc::CriticalSection sink_lock_;
+  std::vector<webrtc::AudioTrackSinkInterface*> sinks_
+      RTC_GUARDED_BY(sink_lock_);
+};
@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "TitanAudioTransport.h"
+
+#include <string.h>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+
+TitanAudioTransport::TitanAudioTransport(size_t max_buffered_bytes)
+    : max_buffered_bytes_(max_buffered_bytes),
+      observer_(nullptr),
+      rendering_(false),
+      buffered_bytes_(0) {}
+
+TitanAudioTransport::~TitanAudioTransport() {}
+
+bool TitanAudioTransport::ready() const {
+  return rendering_.load(std::memory_order_relaxed);
+}
+
+size_t TitanAudioTransport::buffered_amount() const {
+  rtc::CritScope lock(&send_lock_);
+  return buffered_bytes_;
+}
+
+void TitanAudioTransport::SetObserver(TitanTransportObserver* observer) {
+  observer_.store(observer, std::memory_order_release);
+}
+
+bool TitanAudioTransport::Send(const uint8_t* data, size_t size) {
+  if (size == 0 || size > kTitanAudioMaxMessageSize)
+    return false;
+  rtc::CritScope lock(&send_lock_);
+  if (buffered_bytes_ + size > max_buffered_bytes_)
+    return false;
+  send_queue_.emplace_back(data, data + size);
+  buffered_bytes_ += size;
+  return true;
+}
+
+void TitanAudioTransport::RenderAudio(int16_t* samples,
+                                      size_t count,
+                                      int sample_rate) {
+  rendering_.store(true, std::memory_order_relaxed);
+  if (!modulator_ || modulator_->sample_rate() != sample_rate) {
+    if (!IsValidTitanAudioSampleRate(sample_rate)) {
+      memset(samples, 0, count * sizeof(*samples));
+      return;
+    }
+    modulator_.reset(new TitanAudioModulator(sample_rate));
+  }
+  RTC_DCHECK_EQ(count, modulator_->symbol_samples());
+
+  if (modulator_->idle()) {
+    rtc::CritScope lock(&send_lock_);
+    if (!send_queue_.empty()) {
+      const std::vector<uint8_t>& message = send_queue_.front();
+      modulator_->Start(message.data(), message.size());
+      buffered_bytes_ -= message.size();
+      send_queue_.pop_front();
+    }
+  }
+  modulator_->RenderSymbol(samples);
+}
+
+void TitanAudioTransport::OnData(const void* audio_data,
+                                 int bits_per_sample,
+                                 int sample_rate,
+                                 size_t number_of_channels,
+                                 size_t number_of_frames) {
+  if (bits_per_sample != 16 || number_of_channels == 0 ||
+      !IsValidTitanAudioSampleRate(sample_rate)) {
+    return;
+  }
+  if (!demodulator_ || demodulator_->sample_rate() != sample_rate) {
+    RTC_LOG(INFO) << "Titan audio lane receiving at " << sample_rate << " Hz";
+    demodulator_.reset(new TitanAudioDemodulator(sample_rate));
+  }
+  demodulator_->Process(static_cast<const int16_t*>(audio_data),
+                        number_of_frames, number_of_channels,
+                        observer_.load(std::memory_order_acquire));
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <api/mediastreaminterface.h>
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+#include "TitanAudioModem.h"
+#include "TitanAudioSource.h"
+#include "TitanTransport.h"
+
+// Carries small messages in the audio track, one burst per message. On the
+// sending side it feeds a TitanAudioSource, on the receiving side it is added
+// as a sink to the remote audio track. Messages go out on the 10 ms audio
+// cadence, so this is meant as a side lane for control messages next to the
+// main transport rather than for bulk data.
+class TitanAudioTransport : public TitanTransport,
+                            public TitanAudioProvider,
+                            public webrtc::AudioTrackSinkInterface {
+ public:
+  explicit TitanAudioTransport(size_t max_buffered_bytes);
+  ~TitanAudioTransport() override;
+
+  // TitanTransport implementation. Messages are limited to
+  // kTitanAudioMaxMessageSize bytes.
+  Mode mode() const override { return kTitanAudio; }
+  const char* name() const override { return "titan-audio"; }
+  bool reliable() const override { return false; }
+  bool ready() const override;
+  size_t buffered_amount() const override;
+  void SetObserver(TitanTransportObserver* observer) override;
+  bool Send(const uint8_t* data, size_t size) override;
+
+  // TitanAudioProvider implementation, called on the audio thread.
+  void RenderAudio(int16_t* samples, size_t count, int sample_rate) override;
+
+  // AudioTrackSinkInterface implementation, called on the playout thread.
+  void OnData(const void* audio_data,
+              int bits_per_sample,
+              int sample_rate,
+              size_t number_of_channels,
+              size_t number_of_frames) override;
+
+ private:
+  const size_t max_buffered_bytes_;
+  std::atomic<TitanTransportObserver*> observer_;
+  std::atomic<bool> rendering_;
+
+  mutable rtc::CriticalSection send_lock_;
+  std::deque<std::vector<uint8_t>> send_queue_ RTC_GUARDED_BY(send_lock_);
+  size_t buffered_bytes_ RTC_GUARDED_BY(send_lock_);
+
+  // Only touched on the audio thread.
+  std::unique_ptr<TitanAudioModulator> modulator_;
+  // Only touched on the playout thread.
+  std::unique_ptr<TitanAudioDemodulator> demodulator_;
+};
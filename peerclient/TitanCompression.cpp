@@ -0,0 +1,324 @@
+#include "pch.h"
+
+#include "TitanCompression.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+
+#include "TitanMetrics.h"
+
+namespace {
+
+// Block methods, the first byte of every block of a message.
+enum : uint8_t {
+  kBlockStored = 0,
+  kBlockCompressed = 1,
+};
+
+// Messages are compressed in blocks of this size, which is as far as a
+// match may reach back anyway.
+const size_t kBlockSize = 64 * 1024;
+// Smaller blocks aren't worth the attempt.
+const size_t kMinCompressedSize = 32;
+// Sample TitanLooksIncompressible() takes: this many runs spread over the
+// data.
+const size_t kSampleRuns = 16;
+const size_t kSampleRunLength = 64;
+// Bits of entropy per byte above which data is left alone. Text is around
+// 5, random bytes come out close to 8 for a sample this small.
+const double kIncompressibleEntropy = 7.0;
+
+// LZ4 block format constants.
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;
+// No match starts this close to the end of a block.
+const size_t kMatchLimit = 12;
+const size_t kMaxOffset = 65535;
+const int kHashBits = 12;
+
+uint32_t Read32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes the remainder of an LZ4 length after its 4 bit field.
+uint8_t* WriteLength(uint8_t* out, size_t length) {
+  for (; length >= 255; length -= 255)
+    *out++ = 255;
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+bool ReadLength(const uint8_t** pos, const uint8_t* end, size_t* length) {
+  uint8_t byte;
+  do {
+    if (*pos == end)
+      return false;
+    byte = *(*pos)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals,
+                       size_t literal_length, size_t offset,
+                       size_t match_length) {
+  uint8_t* token = out++;
+  *token = static_cast<uint8_t>(std::min<size_t>(literal_length, 15) << 4);
+  if (literal_length >= 15)
+    out = WriteLength(out, literal_length - 15);
+  memcpy(out, literals, literal_length);
+  out += literal_length;
+  if (match_length == 0)
+    return out;  // The last sequence has literals only.
+  *out++ = static_cast<uint8_t>(offset);
+  *out++ = static_cast<uint8_t>(offset >> 8);
+  match_length -= kMinMatch;
+  *token |= static_cast<uint8_t>(std::min<size_t>(match_length, 15));
+  if (match_length >= 15)
+    out = WriteLength(out, match_length - 15);
+  return out;
+}
+
+void WriteVarint(std::vector<uint8_t>* out, uint32_t value) {
+  for (; value >= 0x80; value >>= 7)
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+bool ReadVarint(const uint8_t** pos, const uint8_t* end, uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (*pos == end)
+      return false;
+    uint8_t byte = *(*pos)++;
+    *value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+size_t TitanCompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t TitanCompressBlock(const uint8_t* data, size_t size, uint8_t* out) {
+  RTC_DCHECK_LE(size, kBlockSize);
+  uint8_t* const out_start = out;
+  size_t anchor = 0;
+  if (size >= kMatchLimit) {
+    // Positions plus one, 0 for none.
+    uint32_t table[1 << kHashBits] = {};
+    const size_t match_limit = size - kMatchLimit;
+    const size_t match_end = size - kLastLiterals;
+    size_t pos = 0;
+    while (pos <= match_limit) {
+      uint32_t sequence = Read32(data + pos);
+      uint32_t& entry = table[Hash(sequence)];
+      size_t candidate = entry;
+      entry = static_cast<uint32_t>(pos + 1);
+      if (candidate == 0 || pos - (candidate - 1) > kMaxOffset ||
+          Read32(data + candidate - 1) != sequence) {
+        ++pos;
+        continue;
+      }
+      size_t match = candidate - 1;
+      size_t length = kMinMatch;
+      while (pos + length < match_end && data[match + length] ==
+                                             data[pos + length]) {
+        ++length;
+      }
+      out = WriteSequence(out, data + anchor, pos - anchor, pos - match,
+                          length);
+      pos += length;
+      anchor = pos;
+    }
+  }
+  out = WriteSequence(out, data + anchor, size - anchor, 0, 0);
+  return out - out_start;
+}
+
+bool TitanDecompressBlock(const uint8_t* data, size_t size, uint8_t* out,
+                          size_t out_size) {
+  const uint8_t* pos = data;
+  const uint8_t* const end = data + size;
+  size_t written = 0;
+  while (pos < end) {
+    uint8_t token = *pos++;
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !ReadLength(&pos, end, &literal_length))
+      return false;
+    if (literal_length > static_cast<size_t>(end - pos) ||
+        literal_length > out_size - written) {
+      return false;
+    }
+    memcpy(out + written, pos, literal_length);
+    pos += literal_length;
+    written += literal_length;
+    if (pos == end)
+      break;  // The last sequence has no match.
+
+    if (end - pos < 2)
+      return false;
+    size_t offset = pos[0] | (pos[1] << 8);
+    pos += 2;
+    size_t match_length = token & 0x0F;
+    if (match_length == 15 && !ReadLength(&pos, end, &match_length))
+      return false;
+    match_length += kMinMatch;
+    if (offset == 0 || offset > written ||
+        match_length > out_size - written) {
+      return false;
+    }
+    // Byte by byte, a match may overlap what it copies.
+    const uint8_t* match = out + written - offset;
+    for (size_t i = 0; i < match_length; ++i)
+      out[written + i] = match[i];
+    written += match_length;
+  }
+  return written == out_size;
+}
+
+bool TitanLooksIncompressible(const uint8_t* data, size_t size) {
+  uint32_t counts[256] = {};
+  size_t sampled = 0;
+  if (size <= kSampleRuns * kSampleRunLength) {
+    for (size_t i = 0; i < size; ++i)
+      ++counts[data[i]];
+    sampled = size;
+  } else {
+    size_t step = (size - kSampleRunLength) / (kSampleRuns - 1);
+    for (size_t run = 0; run < kSampleRuns; ++run) {
+      const uint8_t* start = data + run * step;
+      for (size_t i = 0; i < kSampleRunLength; ++i)
+        ++counts[start[i]];
+    }
+    sampled = kSampleRuns * kSampleRunLength;
+  }
+  if (sampled == 0)
+    return true;
+
+  double entropy = 0;
+  for (uint32_t count : counts) {
+    if (count == 0)
+      continue;
+    double p = static_cast<double>(count) / sampled;
+    entropy -= p * log2(p);
+  }
+  return entropy > kIncompressibleEntropy;
+}
+
+TitanCompressedTransport::TitanCompressedTransport(TitanTransport* transport)
+    : transport_(transport), observer_(nullptr) {
+  RTC_DCHECK(transport_);
+  transport_->SetObserver(this);
+}
+
+TitanCompressedTransport::~TitanCompressedTransport() {
+  transport_->SetObserver(nullptr);
+}
+
+void TitanCompressedTransport::SetObserver(TitanTransportObserver* observer) {
+  observer_.store(observer, std::memory_order_release);
+}
+
+bool TitanCompressedTransport::Send(const uint8_t* data, size_t size) {
+  if (size == 0)
+    return transport_->Send(data, size);
+  rtc::CritScope lock(&send_lock_);
+  encoded_.clear();
+  for (size_t pos = 0; pos < size; pos += kBlockSize)
+    EncodeBlock(data + pos, std::min(kBlockSize, size - pos));
+
+  TitanMetrics& metrics = TitanMetrics::Get();
+  metrics.compression_input_bytes.fetch_add(size, std::memory_order_relaxed);
+  metrics.compression_output_bytes.fetch_add(encoded_.size(),
+                                             std::memory_order_relaxed);
+  return transport_->Send(encoded_.data(), encoded_.size());
+}
+
+// A block is its method, its size and, if compressed, its compressed size,
+// followed by its bytes.
+void TitanCompressedTransport::EncodeBlock(const uint8_t* data, size_t size) {
+  size_t compressed = 0;
+  if (size >= kMinCompressedSize && !TitanLooksIncompressible(data, size)) {
+    scratch_.resize(TitanCompressBound(size));
+    compressed = TitanCompressBlock(data, size, scratch_.data());
+  }
+  if (compressed == 0 || compressed >= size) {
+    TitanMetrics::Get().compression_blocks_stored.fetch_add(
+        1, std::memory_order_relaxed);
+    encoded_.push_back(kBlockStored);
+    WriteVarint(&encoded_, static_cast<uint32_t>(size));
+    encoded_.insert(encoded_.end(), data, data + size);
+    return;
+  }
+  encoded_.push_back(kBlockCompressed);
+  WriteVarint(&encoded_, static_cast<uint32_t>(size));
+  WriteVarint(&encoded_, static_cast<uint32_t>(compressed));
+  encoded_.insert(encoded_.end(), scratch_.data(),
+                  scratch_.data() + compressed);
+}
+
+void TitanCompressedTransport::OnTransportMessage(const uint8_t* data,
+                                                  size_t size) {
+  rtc::CritScope lock(&receive_lock_);
+  decoded_.clear();
+  const uint8_t* pos = data;
+  const uint8_t* end = data + size;
+  while (pos < end) {
+    if (!DecodeBlock(&pos, end)) {
+      RTC_LOG(LS_WARNING) << "Dropping a message that isn't compressed, "
+                             "is the remote side using compression?";
+      return;
+    }
+  }
+  TitanTransportObserver* observer = observer_.load(std::memory_order_acquire);
+  if (observer)
+    observer->OnTransportMessage(decoded_.data(), decoded_.size());
+}
+
+bool TitanCompressedTransport::DecodeBlock(const uint8_t** pos,
+                                           const uint8_t* end) {
+  uint8_t method = *(*pos)++;
+  uint32_t size = 0;
+  if (!ReadVarint(pos, end, &size) || size > kBlockSize)
+    return false;
+  size_t offset = decoded_.size();
+  switch (method) {
+    case kBlockStored:
+      if (size > static_cast<size_t>(end - *pos))
+        return false;
+      decoded_.insert(decoded_.end(), *pos, *pos + size);
+      *pos += size;
+      return true;
+    case kBlockCompressed: {
+      uint32_t compressed = 0;
+      if (!ReadVarint(pos, end, &compressed) ||
+          compressed > static_cast<size_t>(end - *pos)) {
+        return false;
+      }
+      decoded_.resize(offset + size);
+      if (!TitanDecompressBlock(*pos, compressed, decoded_.data() + offset,
+                                size)) {
+        return false;
+      }
+      *pos += compressed;
+      return true;
+    }
+  }
+  return false;
+}
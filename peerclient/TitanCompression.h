@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+#include "TitanTransport.h"
+
+// LZ4 block format, self contained. Blocks are compressed independently of
+// each other, since the Titan track may lose or reorder messages.
+
+// The most TitanCompressBlock() may write for |size| bytes of input.
+size_t TitanCompressBound(size_t size);
+
+// Compresses |size| bytes into |out|, which must hold TitanCompressBound()
+// bytes. Returns the compressed size.
+size_t TitanCompressBlock(const uint8_t* data, size_t size, uint8_t* out);
+
+// Decompresses a block into exactly |out_size| bytes. Returns false for
+// anything that isn't a well formed block of that size.
+bool TitanDecompressBlock(const uint8_t* data, size_t size, uint8_t* out,
+                          size_t out_size);
+
+// Guesses from a sample of the bytes whether they are worth compressing.
+// Data that is compressed or encrypted already has about 8 bits of entropy
+// per byte and would only grow.
+bool TitanLooksIncompressible(const uint8_t* data, size_t size);
+
+// Compresses messages on their way into another transport and decompresses
+// them on the way out. Messages are cut into blocks, each of which is
+// compressed unless it looks incompressible or doesn't get any smaller, in
+// which case it is stored as it is.
+//
+// Both sides have to use it, the remote side can't tell compressed messages
+// from others. Raw replay frames bypass it, see
+// TitanTrackTransport::SetRawObserver().
+class TitanCompressedTransport : public TitanTransport,
+                                 private TitanTransportObserver {
+ public:
+  // |transport| must outlive this object.
+  explicit TitanCompressedTransport(TitanTransport* transport);
+  ~TitanCompressedTransport() override;
+
+  // TitanTransport implementation.
+  Mode mode() const override { return transport_->mode(); }
+  const char* name() const override { return transport_->name(); }
+  bool reliable() const override { return transport_->reliable(); }
+  bool ready() const override { return transport_->ready(); }
+  // In compressed bytes.
+  size_t buffered_amount() const override {
+    return transport_->buffered_amount();
+  }
+  void SetObserver(TitanTransportObserver* observer) override;
+  bool Send(const uint8_t* data, size_t size) override;
+
+ private:
+  // Called on the receive thread of |transport_|.
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+
+  void EncodeBlock(const uint8_t* data, size_t size)
+      RTC_EXCLUSIVE_LOCKS_REQUIRED(send_lock_);
+  bool DecodeBlock(const uint8_t** pos, const uint8_t* end)
+      RTC_EXCLUSIVE_LOCKS_REQUIRED(receive_lock_);
+
+  TitanTransport* const transport_;
+  std::atomic<TitanTransportObserver*> observer_;
+
+  rtc::CriticalSection send_lock_;
+  std::vector<uint8_t> encoded_ RTC_GUARDED_BY(send_lock_);
+  std::vector<uint8_t> scratch_ RTC_GUARDED_BY(send_lock_);
+
+  rtc::CriticalSection receive_lock_;
+  std::vector<uint8_t> decoded_ RTC_GUARDED_BY(receive_lock_);
+};
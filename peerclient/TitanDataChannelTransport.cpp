@@ -0,0 +1,95 @@
+#include "pch.h"
+
+#include "TitanDataChannelTransport.h"
+
+#include <rtc_base/checks.h>
+#include <rtc_base/copyonwritebuffer.h>
+#include <rtc_base/logging.h>
+
+#include "TitanMetrics.h"
+
+const char TitanDataChannelTransport::kLabel[] = "titan";
+
+TitanDataChannelTransport::TitanDataChannelTransport(Mode mode,
+                                                     size_t max_buffered_bytes)
+    : mode_(mode), max_buffered_bytes_(max_buffered_bytes), observer_(nullptr) {
+  RTC_DCHECK(mode_ == kDataChannelReliable || mode_ == kDataChannelUnreliable);
+}
+
+TitanDataChannelTransport::~TitanDataChannelTransport() {
+  Close();
+}
+
+// static
+webrtc::DataChannelInit TitanDataChannelTransport::CreateInit(Mode mode) {
+  webrtc::DataChannelInit init;
+  if (mode == kDataChannelUnreliable) {
+    init.ordered = false;
+    init.maxRetransmits = 0;
+  }
+  return init;
+}
+
+void TitanDataChannelTransport::AddChannel(
+    rtc::scoped_refptr<webrtc::DataChannelInterface> channel) {
+  RTC_LOG(INFO) << "Titan data channel added: " << channel->label();
+  channel->RegisterObserver(this);
+  if (!send_channel_)
+    send_channel_ = channel;
+  channels_.push_back(channel);
+}
+
+void TitanDataChannelTransport::Close() {
+  for (const auto& channel : channels_) {
+    channel->UnregisterObserver();
+    channel->Close();
+  }
+  channels_.clear();
+  send_channel_ = nullptr;
+}
+
+const char* TitanDataChannelTransport::name() const {
+  return mode_ == kDataChannelReliable ? "datachannel-reliable"
+                                       : "datachannel-unreliable";
+}
+
+bool TitanDataChannelTransport::ready() const {
+  return send_channel_ &&
+         send_channel_->state() == webrtc::DataChannelInterface::kOpen;
+}
+
+size_t TitanDataChannelTransport::buffered_amount() const {
+  return send_channel_ ? static_cast<size_t>(send_channel_->buffered_amount())
+                       : 0;
+}
+
+void TitanDataChannelTransport::SetObserver(TitanTransportObserver* observer) {
+  observer_.store(observer, std::memory_order_release);
+}
+
+bool TitanDataChannelTransport::Send(const uint8_t* data, size_t size) {
+  if (!ready() || size == 0)
+    return false;
+  // The channel closes itself when its buffer overflows, so push back early.
+  if (buffered_amount() + size > max_buffered_bytes_)
+    return false;
+  webrtc::DataBuffer buffer(rtc::CopyOnWriteBuffer(data, size),
+                            /*binary=*/true);
+  return send_channel_->Send(buffer);
+}
+
+void TitanDataChannelTransport::OnStateChange() {
+  for (const auto& channel : channels_) {
+    RTC_LOG(INFO) << "Titan data channel " << channel->id() << " is "
+                  << webrtc::DataChannelInterface::DataStateString(
+                         channel->state());
+  }
+}
+
+void TitanDataChannelTransport::OnMessage(const webrtc::DataBuffer& buffer) {
+  TitanMetrics::Get().payload_bytes_received.fetch_add(
+      buffer.size(), std::memory_order_relaxed);
+  TitanTransportObserver* observer = observer_.load(std::memory_order_acquire);
+  if (observer)
+    observer->OnTransportMessage(buffer.data.cdata(), buffer.size());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <api/datachannelinterface.h>
+
+#include "TitanTransport.h"
+
+// Carries messages over SCTP data channels. The first channel added is used
+// for sending; every channel added is listened on, which covers both a
+// negotiated pair of channels and loopback, where the local and the remote
+// end are different objects.
+class TitanDataChannelTransport : public TitanTransport,
+                                  public webrtc::DataChannelObserver {
+ public:
+  static const char kLabel[];
+
+  TitanDataChannelTransport(Mode mode, size_t max_buffered_bytes);
+  ~TitanDataChannelTransport() override;
+
+  // Init for the channel the offerer creates before the offer is made.
+  static webrtc::DataChannelInit CreateInit(Mode mode);
+
+  void AddChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel);
+  void Close();
+
+  // TitanTransport implementation.
+  Mode mode() const override { return mode_; }
+  const char* name() const override;
+  bool reliable() const override { return mode_ == kDataChannelReliable; }
+  bool ready() const override;
+  size_t buffered_amount() const override;
+  void SetObserver(TitanTransportObserver* observer) override;
+  bool Send(const uint8_t* data, size_t size) override;
+
+  // DataChannelObserver implementation.
+  void OnStateChange() override;
+  void OnMessage(const webrtc::DataBuffer& buffer) override;
+  void OnBufferedAmountChange(uint64_t previous_amount) override {}
+
+ private:
+  const Mode mode_;
+  const size_t max_buffered_bytes_;
+  std::atomic<TitanTransportObserver*> observer_;
+  rtc::scoped_refptr<webrtc::DataChannelInterface> send_channel_;
+  std::vector<rtc::scoped_refptr<webrtc::DataChannelInterface>> channels_;
+};
@@ -0,0 +1,168 @@
+#include "pch.h"
+
+#include "TitanEncoderFeedback.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <api/video/video_frame.h>
+#include <rtc_base/checks.h>
+#include <rtc_base/timeutils.h>
+
+#include "TitanMetrics.h"
+
+namespace {
+
+// A frame the encoder hasn't taken by then is not coming back, e.g. because
+// the stream was reconfigured.
+const int64_t kAckTimeoutUs = rtc::kNumMicrosecsPerSec;
+// Bounds |sent_| should the encoder stop acknowledging altogether.
+const size_t kMaxOutstandingFrames = 256;
+
+// Forwards everything to the wrapped encoder and acknowledges each frame it
+// takes.
+class FeedbackEncoder : public webrtc::VideoEncoder {
+ public:
+  FeedbackEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder,
+                  TitanEncoderFeedback* feedback)
+      : encoder_(std::move(encoder)), feedback_(feedback) {
+    feedback_->OnEncoderCreated();
+  }
+  ~FeedbackEncoder() override { feedback_->OnEncoderReleased(); }
+
+  int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+                     int32_t number_of_cores,
+                     size_t max_payload_size) override {
+    return encoder_->InitEncode(codec_settings, number_of_cores,
+                                max_payload_size);
+  }
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override {
+    return encoder_->RegisterEncodeCompleteCallback(callback);
+  }
+  int32_t Release() override { return encoder_->Release(); }
+  int32_t Encode(const webrtc::VideoFrame& frame,
+                 const webrtc::CodecSpecificInfo* codec_specific_info,
+                 const std::vector<webrtc::FrameType>* frame_types) override {
+    int32_t result = encoder_->Encode(frame, codec_specific_info, frame_types);
+    feedback_->OnFrameEncoded(frame.timestamp_us());
+    return result;
+  }
+  int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override {
+    return encoder_->SetChannelParameters(packet_loss, rtt);
+  }
+  int32_t SetRateAllocation(const webrtc::BitrateAllocation& allocation,
+                            uint32_t framerate) override {
+    return encoder_->SetRateAllocation(allocation, framerate);
+  }
+  ScalingSettings GetScalingSettings() const override {
+    return encoder_->GetScalingSettings();
+  }
+  bool SupportsNativeHandle() const override {
+    return encoder_->SupportsNativeHandle();
+  }
+  const char* ImplementationName() const override {
+    return encoder_->ImplementationName();
+  }
+
+ private:
+  const std::unique_ptr<webrtc::VideoEncoder> encoder_;
+  TitanEncoderFeedback* const feedback_;
+};
+
+}  // namespace
+
+TitanEncoderFeedback::TitanEncoderFeedback() : encoders_(0), skipped_(0) {}
+
+void TitanEncoderFeedback::OnFrameSent(int64_t timestamp_us) {
+  rtc::CritScope lock(&lock_);
+  if (encoders_ == 0)
+    return;
+  Expire(timestamp_us);
+  if (sent_.size() == kMaxOutstandingFrames) {
+    sent_.pop_front();
+    Skipped(1);
+  }
+  sent_.push_back(timestamp_us);
+}
+
+size_t TitanEncoderFeedback::pending() const {
+  rtc::CritScope lock(&lock_);
+  return sent_.size();
+}
+
+uint64_t TitanEncoderFeedback::frames_skipped() const {
+  rtc::CritScope lock(&lock_);
+  return skipped_;
+}
+
+void TitanEncoderFeedback::OnEncoderCreated() {
+  rtc::CritScope lock(&lock_);
+  ++encoders_;
+}
+
+void TitanEncoderFeedback::OnEncoderReleased() {
+  rtc::CritScope lock(&lock_);
+  RTC_DCHECK_GT(encoders_, 0);
+  if (--encoders_ == 0)
+    sent_.clear();
+}
+
+void TitanEncoderFeedback::OnFrameEncoded(int64_t timestamp_us) {
+  rtc::CritScope lock(&lock_);
+  // Frames reach the encoder in the order they were sent. A frame that isn't
+  // found was taken twice (say, for two simulcast layers) or belongs to
+  // another track, whose encoder comes from the same factory.
+  auto it = std::find(sent_.begin(), sent_.end(), timestamp_us);
+  if (it == sent_.end())
+    return;
+  Skipped(it - sent_.begin());
+  sent_.erase(sent_.begin(), it + 1);
+}
+
+void TitanEncoderFeedback::Expire(int64_t now_us) {
+  uint64_t skipped = 0;
+  while (!sent_.empty() && sent_.front() < now_us - kAckTimeoutUs) {
+    sent_.pop_front();
+    ++skipped;
+  }
+  Skipped(skipped);
+}
+
+void TitanEncoderFeedback::Skipped(uint64_t count) {
+  if (count == 0)
+    return;
+  skipped_ += count;
+  TitanMetrics::Get().frames_superseded.fetch_add(count,
+                                                  std::memory_order_relaxed);
+}
+
+TitanEncoderFactory::TitanEncoderFactory(
+    std::unique_ptr<webrtc::VideoEncoderFactory> factory,
+    TitanEncoderFeedback* feedback)
+    : factory_(std::move(factory)), feedback_(feedback) {
+  RTC_DCHECK(factory_);
+  RTC_DCHECK(feedback_);
+}
+
+TitanEncoderFactory::~TitanEncoderFactory() {}
+
+std::vector<webrtc::SdpVideoFormat> TitanEncoderFactory::GetSupportedFormats()
+    const {
+  return factory_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo TitanEncoderFactory::QueryVideoEncoder(
+    const webrtc::SdpVideoFormat& format) const {
+  return factory_->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder> TitanEncoderFactory::CreateVideoEncoder(
+    const webrtc::SdpVideoFormat& format) {
+  std::unique_ptr<webrtc::VideoEncoder> encoder =
+      factory_->CreateVideoEncoder(format);
+  if (!encoder)
+    return nullptr;
+  return std::unique_ptr<webrtc::VideoEncoder>(
+      new FeedbackEncoder(std::move(encoder), feedback_));
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <api/video_codecs/sdp_video_format.h>
+#include <api/video_codecs/video_encoder.h>
+#include <api/video_codecs/video_encoder_factory.h>
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+// Tells a TitanTrackSource how many of the frames it sent are still waiting
+// in front of the encoder. Frames are matched by their timestamp: the
+// encoder acknowledges the frame it takes, and every older frame still
+// outstanding was skipped, i.e. replaced by a newer one before the encoder
+// got to it. Only one source can use a feedback, the encoders of other
+// tracks merely don't find their frames.
+class TitanEncoderFeedback {
+ public:
+  TitanEncoderFeedback();
+
+  // Frame thread.
+  void OnFrameSent(int64_t timestamp_us);
+  // Frames sent that the encoder neither took nor skipped yet. Always 0
+  // while no encoder exists, nothing would drain them.
+  size_t pending() const;
+  // Frames the encoder never saw.
+  uint64_t frames_skipped() const;
+
+  // Encoder thread.
+  void OnEncoderCreated();
+  void OnEncoderReleased();
+  void OnFrameEncoded(int64_t timestamp_us);
+
+ private:
+  // Drops what is older than |now_us| minus the timeout, as skipped.
+  void Expire(int64_t now_us) RTC_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void Skipped(uint64_t count) RTC_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable rtc::CriticalSection lock_;
+  std::deque<int64_t> sent_ RTC_GUARDED_BY(lock_);
+  int encoders_ RTC_GUARDED_BY(lock_);
+  uint64_t skipped_ RTC_GUARDED_BY(lock_);
+};
+
+// Wraps another encoder factory so that every encoder it makes reports the
+// frames it takes to a TitanEncoderFeedback.
+class TitanEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  TitanEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> factory,
+                      TitanEncoderFeedback* feedback);
+  ~TitanEncoderFactory() override;
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+  CodecInfo QueryVideoEncoder(
+      const webrtc::SdpVideoFormat& format) const override;
+  std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+      const webrtc::SdpVideoFormat& format) override;
+
+ private:
+  const std::unique_ptr<webrtc::VideoEncoderFactory> factory_;
+  TitanEncoderFeedback* const feedback_;
+};
@@ -0,0 +1,257 @@
+#include "pch.h"
+
+#include "TitanFec.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <rtc_base/checks.h>
+
+#include "TitanMetrics.h"
+
+namespace {
+
+// Advance() result for a sequence number that went backwards, which only
+// happens when the remote source starts over.
+const int kRestarted = -2;
+const int kDuplicate = -1;
+
+// Frames held back, and frames kept for parity frames to come: as many as
+// the largest group.
+const size_t kMaxKeptFrames = kTitanMaxFecGroup;
+
+void WriteUint32(uint8_t* data, uint32_t value) {
+  data[0] = static_cast<uint8_t>(value >> 24);
+  data[1] = static_cast<uint8_t>(value >> 16);
+  data[2] = static_cast<uint8_t>(value >> 8);
+  data[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t ReadUint32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+// |destination| ^= |source|, a word at a time.
+void XorInto(uint8_t* destination, const uint8_t* source, size_t size) {
+  size_t pos = 0;
+  for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, destination + pos, sizeof(a));
+    memcpy(&b, source + pos, sizeof(b));
+    a ^= b;
+    memcpy(destination + pos, &a, sizeof(a));
+  }
+  for (; pos < size; ++pos)
+    destination[pos] ^= source[pos];
+}
+
+}  // namespace
+
+TitanFecEncoder::TitanFecEncoder(int group_size)
+    : group_size_(std::min(std::max(group_size, 0), kTitanMaxFecGroup)) {
+  StartGroup();
+}
+
+void TitanFecEncoder::StartGroup() {
+  frames_ = 0;
+  length_parity_ = 0;
+  has_data_ = false;
+  parity_.clear();
+}
+
+void TitanFecEncoder::AddFrame(const uint8_t* data, size_t size) {
+  if (!enabled())
+    return;
+  if (size > parity_.size())
+    parity_.resize(size, 0);
+  XorInto(parity_.data(), data, size);
+  length_parity_ ^= static_cast<uint32_t>(size);
+  has_data_ |= size > 0;
+  if (++frames_ == group_size_ && !has_data_)
+    StartGroup();
+}
+
+bool TitanFecEncoder::parity_due() const {
+  return enabled() && frames_ == group_size_;
+}
+
+size_t TitanFecEncoder::TakeParity(uint8_t* data, size_t capacity) {
+  RTC_DCHECK(parity_due());
+  RTC_DCHECK_LE(kTitanParityHeaderSize + parity_.size(), capacity);
+  data[0] = static_cast<uint8_t>(frames_);
+  WriteUint32(data + 1, length_parity_);
+  memcpy(data + kTitanParityHeaderSize, parity_.data(), parity_.size());
+  size_t size = kTitanParityHeaderSize + parity_.size();
+  StartGroup();
+  TitanMetrics::Get().fec_parity_frames_sent.fetch_add(
+      1, std::memory_order_relaxed);
+  return size;
+}
+
+TitanFecDecoder::TitanFecDecoder(Output* output)
+    : output_(output),
+      has_sequence_(false),
+      last_sequence_(0),
+      parity_seen_(false),
+      gap_pending_(false),
+      holding_(false),
+      missing_(0) {
+  RTC_DCHECK(output_);
+}
+
+void TitanFecDecoder::OnDataFrame(uint32_t sequence,
+                                  const uint8_t* data,
+                                  size_t size) {
+  int skipped = Advance(sequence);
+  if (skipped == kDuplicate)
+    return;
+  // A second gap, or a group larger than any parity covers: the frame
+  // waited for is gone.
+  if (holding_ && (skipped != 0 || held_.size() == kMaxKeptFrames))
+    Release(true);
+  if (holding_) {
+    held_.push_back({sequence, std::vector<uint8_t>(data, data + size)});
+    return;
+  }
+  if (skipped == 1 && parity_seen_) {
+    holding_ = true;
+    missing_ = sequence - 1;
+    held_.push_back({sequence, std::vector<uint8_t>(data, data + size)});
+    return;
+  }
+  Lost(skipped);
+  Emit(sequence, data, size);
+}
+
+void TitanFecDecoder::OnParityFrame(uint32_t sequence,
+                                    const uint8_t* data,
+                                    size_t size) {
+  int skipped = Advance(sequence);
+  if (skipped == kDuplicate)
+    return;
+  parity_seen_ = true;
+  if (holding_ && skipped != 0)
+    Release(true);
+  if (!holding_ && skipped == 1) {
+    // Perhaps the last data frame of this very group.
+    holding_ = true;
+    missing_ = sequence - 1;
+  } else {
+    Lost(skipped);
+  }
+  if (!holding_)
+    return;
+
+  int group = size >= kTitanParityHeaderSize ? data[0] : 0;
+  if (sequence - missing_ > static_cast<uint32_t>(group)) {
+    // The parity frame before this group went missing, or a frame of a
+    // group that had nothing to protect. No payload was lost either way.
+    Release(false);
+    return;
+  }
+  Release(!Recover(sequence, data, size));
+}
+
+int TitanFecDecoder::Advance(uint32_t sequence) {
+  if (!has_sequence_) {
+    has_sequence_ = true;
+    last_sequence_ = sequence;
+    return 0;
+  }
+  uint32_t delta = sequence - last_sequence_;
+  if (delta == 0)
+    return kDuplicate;
+  last_sequence_ = sequence;
+  if (delta >= 0x80000000u) {
+    // Sequence numbers of the old source mean nothing anymore.
+    window_.clear();
+    return kRestarted;
+  }
+  return static_cast<int>(std::min<uint32_t>(delta - 1, 0x7FFFFFFF));
+}
+
+void TitanFecDecoder::Lost(int frames) {
+  if (frames == 0)
+    return;
+  gap_pending_ = true;
+  if (frames > 0) {
+    TitanMetrics::Get().frames_lost.fetch_add(frames,
+                                              std::memory_order_relaxed);
+  }
+}
+
+void TitanFecDecoder::Emit(uint32_t sequence,
+                           const uint8_t* data,
+                           size_t size) {
+  bool lost_before = gap_pending_;
+  gap_pending_ = false;
+  output_->OnFecFrame(data, size, lost_before);
+  if (!parity_seen_)
+    return;
+
+  // The oldest frame makes room, reusing its memory.
+  Frame frame;
+  if (window_.size() == kMaxKeptFrames) {
+    frame = std::move(window_.front());
+    window_.pop_front();
+  }
+  frame.sequence = sequence;
+  frame.payload.assign(data, data + size);
+  window_.push_back(std::move(frame));
+}
+
+void TitanFecDecoder::Release(bool lost) {
+  holding_ = false;
+  if (lost)
+    Lost(1);
+  std::deque<Frame> held;
+  held.swap(held_);
+  for (const Frame& frame : held)
+    Emit(frame.sequence, frame.payload.data(), frame.payload.size());
+}
+
+bool TitanFecDecoder::Recover(uint32_t sequence,
+                              const uint8_t* data,
+                              size_t size) {
+  int group = data[0];
+  if (group < 1 || group > kTitanMaxFecGroup)
+    return false;
+  uint32_t length = ReadUint32(data + 1);
+  const uint8_t* parity = data + kTitanParityHeaderSize;
+  size_t parity_size = size - kTitanParityHeaderSize;
+
+  recovered_.assign(parity, parity + parity_size);
+  for (int i = 1; i <= group; ++i) {
+    uint32_t member = sequence - i;
+    if (member == missing_)
+      continue;
+    const Frame* frame = Find(member);
+    if (!frame || frame->payload.size() > parity_size)
+      return false;
+    length ^= static_cast<uint32_t>(frame->payload.size());
+    XorInto(recovered_.data(), frame->payload.data(), frame->payload.size());
+  }
+  if (length > parity_size)
+    return false;
+
+  TitanMetrics::Get().fec_frames_recovered.fetch_add(
+      1, std::memory_order_relaxed);
+  Emit(missing_, recovered_.data(), length);
+  return true;
+}
+
+const TitanFecDecoder::Frame* TitanFecDecoder::Find(uint32_t sequence) const {
+  for (const Frame& frame : window_) {
+    if (frame.sequence == sequence)
+      return &frame;
+  }
+  for (const Frame& frame : held_) {
+    if (frame.sequence == sequence)
+      return &frame;
+  }
+  return nullptr;
+}
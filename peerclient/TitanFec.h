@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+// Forward error correction over the payloads of consecutive Titan frames.
+// After every group of data frames the sender adds a parity frame, the XOR
+// of the group, from which the receiver rebuilds any one data frame of the
+// group that went missing. A group whose frames were all empty carries
+// nothing to lose and gets no parity frame.
+
+// A parity payload starts with: frames in the group (1), XOR of their
+// lengths (4).
+const size_t kTitanParityHeaderSize = 5;
+// Largest group a parity frame can protect.
+const int kTitanMaxFecGroup = 16;
+
+class TitanFecEncoder {
+ public:
+  // |group_size| data frames per parity frame, 0 disables FEC.
+  explicit TitanFecEncoder(int group_size);
+
+  bool enabled() const { return group_size_ > 0; }
+  // Data frames must leave this much of the frame capacity unused, so that
+  // the parity fits into a frame as well.
+  size_t overhead() const { return enabled() ? kTitanParityHeaderSize : 0; }
+
+  // Accounts for a data frame about to be sent.
+  void AddFrame(const uint8_t* data, size_t size);
+  // True once the group is complete and its parity frame is next.
+  bool parity_due() const;
+  // Writes the parity payload into |data| and starts the next group.
+  // Returns its size.
+  size_t TakeParity(uint8_t* data, size_t capacity);
+
+ private:
+  void StartGroup();
+
+  const int group_size_;
+  int frames_;
+  uint32_t length_parity_;
+  bool has_data_;
+  std::vector<uint8_t> parity_;
+};
+
+// Sits between the frames coming off the track and their processing. Frames
+// come out in sequence order; after a single lost frame the following ones
+// are held back until the parity frame tells whether it can be rebuilt.
+class TitanFecDecoder {
+ public:
+  class Output {
+   public:
+    // |lost_before| is set if frames are missing in front of this one.
+    virtual void OnFecFrame(const uint8_t* data, size_t size,
+                            bool lost_before) = 0;
+
+   protected:
+    virtual ~Output() {}
+  };
+
+  explicit TitanFecDecoder(Output* output);
+
+  void OnDataFrame(uint32_t sequence, const uint8_t* data, size_t size);
+  void OnParityFrame(uint32_t sequence, const uint8_t* data, size_t size);
+
+ private:
+  struct Frame {
+    uint32_t sequence;
+    std::vector<uint8_t> payload;
+  };
+
+  // Moves past |sequence|. Returns the number of frames skipped, or a
+  // negative value for a duplicate or a source that started over.
+  int Advance(uint32_t sequence);
+  // Marks the next frame handed out as following a gap.
+  void Lost(int frames);
+  void Emit(uint32_t sequence, const uint8_t* data, size_t size);
+  // Hands out the held frames, behind a gap if the missing frame is lost
+  // for good.
+  void Release(bool lost);
+  // Rebuilds |missing_| from the parity of the group in front of the
+  // parity frame |sequence|.
+  bool Recover(uint32_t sequence, const uint8_t* data, size_t size);
+  const Frame* Find(uint32_t sequence) const;
+
+  Output* const output_;
+  bool has_sequence_;
+  uint32_t last_sequence_;
+  // FEC is only known to be on once a parity frame arrived; until then
+  // nothing is held back or kept.
+  bool parity_seen_;
+  bool gap_pending_;
+  // The data frames handed out last, which later parity frames refer to.
+  std::deque<Frame> window_;
+  // Set while waiting for the parity that may rebuild |missing_|.
+  bool holding_;
+  uint32_t missing_;
+  std::deque<Frame> held_;
+  std::vector<uint8_t> recovered_;
+};
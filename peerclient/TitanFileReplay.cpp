@@ -0,0 +1,175 @@
+#include "pch.h"
+
+#include "TitanFileReplay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <common_video/include/video_frame_buffer.h>
+#include <rtc_base/logging.h>
+
+namespace {
+
+const char kY4mMagic[] = "YUV4MPEG2 ";
+const char kY4mFrame[] = "FRAME";
+// A header line longer than this is taken as garbage.
+const size_t kMaxY4mLine = 1024;
+
+// Returns the offset just past the end of the line starting at |offset|, or
+// 0 if there is no complete line.
+size_t LineEnd(const uint8_t* data, size_t size, size_t offset) {
+  size_t limit = std::min(size, offset + kMaxY4mLine);
+  const void* end = memchr(data + offset, '\n', limit - offset);
+  if (!end)
+    return 0;
+  return static_cast<const uint8_t*>(end) - data + 1;
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<TitanFileReplay> TitanFileReplay::Open(
+    const std::string& path,
+    bool loop) {
+  std::shared_ptr<TitanMappedFile> file(TitanMappedFile::Open(path));
+  if (!file)
+    return nullptr;
+  std::unique_ptr<TitanFileReplay> replay(
+      new TitanFileReplay(std::move(file), loop));
+
+  if (replay->file_->size() >= strlen(kY4mMagic) &&
+      memcmp(replay->file_->data(), kY4mMagic, strlen(kY4mMagic)) == 0) {
+    if (!replay->ParseY4mHeader()) {
+      RTC_LOG(LS_ERROR) << path << " is not a 4:2:0 Y4M file";
+      return nullptr;
+    }
+    replay->format_ = kY4m;
+    RTC_LOG(INFO) << "Replaying " << path << ", " << replay->width_ << "x"
+                  << replay->height_ << " Y4M";
+  } else {
+    RTC_LOG(INFO) << "Replaying " << path << ", "
+                  << replay->file_->size() << " raw bytes";
+  }
+  replay->offset_ = replay->data_offset_;
+  return replay;
+}
+
+TitanFileReplay::TitanFileReplay(std::shared_ptr<TitanMappedFile> file,
+                                 bool loop)
+    : file_(std::move(file)),
+      loop_(loop),
+      format_(kRaw),
+      width_(0),
+      height_(0),
+      fps_(0.0),
+      data_offset_(0),
+      offset_(0),
+      finished_(false) {}
+
+TitanFileReplay::~TitanFileReplay() {}
+
+bool TitanFileReplay::ParseY4mHeader() {
+  const uint8_t* data = file_->data();
+  size_t end = LineEnd(data, file_->size(), 0);
+  if (end == 0)
+    return false;
+  std::string header(reinterpret_cast<const char*>(data), end - 1);
+
+  size_t pos = strlen(kY4mMagic);
+  while (pos < header.size()) {
+    size_t next = header.find(' ', pos);
+    if (next == std::string::npos)
+      next = header.size();
+    std::string token = header.substr(pos, next - pos);
+    pos = next + 1;
+    if (token.empty())
+      continue;
+    const char* value = token.c_str() + 1;
+    switch (token[0]) {
+      case 'W':
+        width_ = atoi(value);
+        break;
+      case 'H':
+        height_ = atoi(value);
+        break;
+      case 'F': {
+        int numerator = atoi(value);
+        const char* colon = strchr(value, ':');
+        int denominator = colon ? atoi(colon + 1) : 0;
+        if (numerator > 0 && denominator > 0)
+          fps_ = static_cast<double>(numerator) / denominator;
+        break;
+      }
+      case 'C':
+        // 420, 420jpeg, 420paldv and 420mpeg2 only differ in chroma siting.
+        if (strncmp(value, "420", 3) != 0)
+          return false;
+        break;
+    }
+  }
+  data_offset_ = end;
+  return width_ > 0 && height_ > 0;
+}
+
+bool TitanFileReplay::Continue() {
+  if (offset_ < file_->size())
+    return true;
+  if (loop_) {
+    offset_ = data_offset_;
+    return true;
+  }
+  if (!finished_) {
+    finished_ = true;
+    RTC_LOG(INFO) << "Replay finished";
+  }
+  return false;
+}
+
+size_t TitanFileReplay::FillPayload(uint8_t* data, size_t capacity) {
+  if (format_ != kRaw || !Continue())
+    return 0;
+  size_t size = std::min(capacity, file_->size() - offset_);
+  memcpy(data, file_->data() + offset_, size);
+  offset_ += size;
+  file_->Advance(offset_);
+  return size;
+}
+
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> TitanFileReplay::NextFrame() {
+  if (format_ != kY4m || !Continue())
+    return nullptr;
+
+  const uint8_t* data = file_->data();
+  size_t size = file_->size();
+  size_t frame_end = LineEnd(data, size, offset_);
+  if (frame_end == 0 || frame_end - offset_ < strlen(kY4mFrame) ||
+      memcmp(data + offset_, kY4mFrame, strlen(kY4mFrame)) != 0) {
+    RTC_LOG(LS_ERROR) << "Corrupt Y4M frame at offset " << offset_;
+    offset_ = size;
+    return nullptr;
+  }
+
+  int chroma_width = (width_ + 1) / 2;
+  int chroma_height = (height_ + 1) / 2;
+  size_t luma_size = static_cast<size_t>(width_) * height_;
+  size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+  if (size - frame_end < luma_size + 2 * chroma_size) {
+    // A truncated last frame, e.g. from a recording cut short.
+    offset_ = size;
+    return nullptr;
+  }
+  const uint8_t* y = data + frame_end;
+  const uint8_t* u = y + luma_size;
+  const uint8_t* v = u + chroma_size;
+  offset_ = frame_end + luma_size + 2 * chroma_size;
+  file_->Advance(offset_);
+
+  // No copy: the planes stay in the mapping, which lives as long as the
+  // last frame using it.
+  std::shared_ptr<TitanMappedFile> file = file_;
+  return webrtc::WrapI420Buffer(width_, height_, y, width_, u, chroma_width,
+                                v, chroma_width, [file] {});
+}
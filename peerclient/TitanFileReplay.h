@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include <api/video/video_frame_buffer.h>
+
+#include "TitanMappedFile.h"
+#include "TitanMediaSourceInterface.h"
+
+// Replays a memory mapped file through a TitanTrackSource, for benchmarks
+// that should be reproducible and for sending large files over the track.
+//
+// A raw file is cut into frame payloads in the kTitanRawStream, which the
+// receiving TitanTrackTransport hands to its observer one frame at a time.
+// A Y4M file (4:2:0 only) is sent frame by frame as video, the I420 planes
+// pointing straight into the mapping.
+class TitanFileReplay : public TitanPayloadProvider, public TitanFrameProvider {
+ public:
+  enum Format {
+    kRaw,
+    kY4m,
+  };
+
+  // Picks the format from the file contents.
+  static std::unique_ptr<TitanFileReplay> Open(const std::string& path,
+                                               bool loop);
+  ~TitanFileReplay() override;
+
+  Format format() const { return format_; }
+  // Frame rate stored in a Y4M file, 0 if it has none.
+  double fps() const { return fps_; }
+
+  // TitanPayloadProvider implementation, for raw files.
+  size_t FillPayload(uint8_t* data, size_t capacity) override;
+  uint8_t stream_id() const override { return kTitanRawStream; }
+
+  // TitanFrameProvider implementation, for Y4M files.
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> NextFrame() override;
+
+ private:
+  TitanFileReplay(std::shared_ptr<TitanMappedFile> file, bool loop);
+
+  bool ParseY4mHeader();
+  // True if the replay may go on at |offset_|, starting over if it loops.
+  bool Continue();
+
+  // Shared with the frames that still point into it.
+  const std::shared_ptr<TitanMappedFile> file_;
+  const bool loop_;
+  Format format_;
+  int width_;
+  int height_;
+  double fps_;
+  // Where the first frame starts.
+  size_t data_offset_;
+  // Only touched from the frame thread.
+  size_t offset_;
+  bool finished_;
+};
@@ -0,0 +1,289 @@
+#include "pch.h"
+
+#include "TitanFrameCodec.h"
+
+#include <string.h>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/crc32.h>
+
+namespace {
+
+const uint8_t kTitanMagic = 0xA7;
+const uint8_t kTitanVersion = 1;
+
+// Luma range that survives the limited range conversion of most encoders.
+const int kLumaLow = 16;
+const int kLumaHigh = 235;
+const uint8_t kChromaNeutral = 128;
+
+void WriteUint32(uint8_t* data, uint32_t value) {
+  data[0] = static_cast<uint8_t>(value >> 24);
+  data[1] = static_cast<uint8_t>(value >> 16);
+  data[2] = static_cast<uint8_t>(value >> 8);
+  data[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t ReadUint32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+uint8_t LevelToLuma(int level, int levels) {
+  return static_cast<uint8_t>(kLumaLow +
+                              level * (kLumaHigh - kLumaLow) / (levels - 1));
+}
+
+int LumaToLevel(int luma, int levels) {
+  int scaled = (luma - kLumaLow) * (levels - 1);
+  int span = kLumaHigh - kLumaLow;
+  int level = (scaled + span / 2) / span;
+  if (level < 0)
+    return 0;
+  if (level >= levels)
+    return levels - 1;
+  return level;
+}
+
+// LevelToLuma() and LumaToLevel() for one number of bits per symbol, looked
+// up instead of computed for every symbol.
+struct LevelTables {
+  explicit LevelTables(int bits) {
+    int levels = 1 << bits;
+    for (int level = 0; level < levels; ++level)
+      luma_of_level[level] = LevelToLuma(level, levels);
+    for (int luma = 0; luma < 256; ++luma)
+      level_of_luma[luma] = static_cast<uint8_t>(LumaToLevel(luma, levels));
+  }
+
+  uint8_t luma_of_level[16];
+  uint8_t level_of_luma[256];
+};
+
+const LevelTables& TablesFor(int bits) {
+  RTC_DCHECK(bits == 1 || bits == 2 || bits == 4);
+  static const LevelTables kTables[] = {LevelTables(1), LevelTables(2),
+                                        LevelTables(4)};
+  return kTables[bits == 1 ? 0 : bits == 2 ? 1 : 2];
+}
+
+// The kernels packing and unpacking the symbols of one geometry. A template
+// argument of 0 is taken from the layout at runtime instead; with both known
+// at compile time, the loops over the bits of a byte and over the pixels of
+// a block unroll completely and the block average divides by a constant.
+template <int kBlockSize, int kBitsPerSymbol>
+struct SymbolKernels {
+  static int block_size(const TitanFrameLayout& layout) {
+    return kBlockSize ? kBlockSize : layout.block_size;
+  }
+  static int bits_per_symbol(const TitanFrameLayout& layout) {
+    return kBitsPerSymbol ? kBitsPerSymbol : layout.bits_per_symbol;
+  }
+
+  static void FillBlock(uint8_t* block, int stride, int size,
+                        uint8_t value) {
+    for (int row = 0; row < size; ++row)
+      memset(block + row * stride, value, size);
+  }
+
+  // Averages the inner pixels of a block. The outermost ring is skipped for
+  // larger blocks since it picks up ringing from neighbouring blocks.
+  static int AverageBlock(const uint8_t* block, int stride, int size) {
+    const int inset = size >= 4 ? 1 : 0;
+    const int inner = size - 2 * inset;
+    int sum = 0;
+    for (int row = inset; row < size - inset; ++row) {
+      const uint8_t* line = block + row * stride;
+      for (int col = inset; col < size - inset; ++col)
+        sum += line[col];
+    }
+    return sum / (inner * inner);
+  }
+
+  // Writes |size| bytes starting at symbol |first_symbol|.
+  static void Write(const TitanFrameLayout& layout, const uint8_t* data,
+                    size_t size, size_t first_symbol, uint8_t* plane,
+                    int stride) {
+    const int block = block_size(layout);
+    const int bits = bits_per_symbol(layout);
+    const int mask = (1 << bits) - 1;
+    const LevelTables& tables = TablesFor(bits);
+    // The position of the symbol moves along instead of being computed
+    // from its index every time.
+    const int columns = layout.columns();
+    int column = static_cast<int>(first_symbol % columns);
+    uint8_t* row = plane + (first_symbol / columns) * block * stride;
+    for (size_t i = 0; i < size; ++i) {
+      for (int shift = 8 - bits; shift >= 0; shift -= bits) {
+        FillBlock(row + column * block, stride, block,
+                  tables.luma_of_level[(data[i] >> shift) & mask]);
+        if (++column == columns) {
+          column = 0;
+          row += block * stride;
+        }
+      }
+    }
+  }
+
+  static void Read(const TitanFrameLayout& layout, const uint8_t* plane,
+                   int stride, size_t first_symbol, size_t size,
+                   uint8_t* data) {
+    const int block = block_size(layout);
+    const int bits = bits_per_symbol(layout);
+    const LevelTables& tables = TablesFor(bits);
+    const int columns = layout.columns();
+    int column = static_cast<int>(first_symbol % columns);
+    const uint8_t* row = plane + (first_symbol / columns) * block * stride;
+    for (size_t i = 0; i < size; ++i) {
+      int byte = 0;
+      for (int shift = 8 - bits; shift >= 0; shift -= bits) {
+        int luma = AverageBlock(row + column * block, stride, block);
+        byte |= tables.level_of_luma[luma] << shift;
+        if (++column == columns) {
+          column = 0;
+          row += block * stride;
+        }
+      }
+      data[i] = static_cast<uint8_t>(byte);
+    }
+  }
+};
+
+typedef void (*WriteSymbolsFunction)(const TitanFrameLayout& layout,
+                                     const uint8_t* data, size_t size,
+                                     size_t first_symbol, uint8_t* plane,
+                                     int stride);
+typedef void (*ReadSymbolsFunction)(const TitanFrameLayout& layout,
+                                    const uint8_t* plane, int stride,
+                                    size_t first_symbol, size_t size,
+                                    uint8_t* data);
+
+struct SymbolCodec {
+  int block_size;
+  int bits_per_symbol;
+  WriteSymbolsFunction write;
+  ReadSymbolsFunction read;
+};
+
+template <int kBlockSize, int kBitsPerSymbol>
+SymbolCodec Codec() {
+  return {kBlockSize, kBitsPerSymbol,
+          &SymbolKernels<kBlockSize, kBitsPerSymbol>::Write,
+          &SymbolKernels<kBlockSize, kBitsPerSymbol>::Read};
+}
+
+// The geometries worth their own kernels: the default of 8x8 blocks at one
+// bit, and the denser and sparser ones simulcast layers use.
+const SymbolCodec kSpecializedCodecs[] = {
+    Codec<16, 1>(), Codec<8, 1>(), Codec<8, 2>(), Codec<8, 4>(),
+    Codec<4, 1>(),  Codec<4, 2>(), Codec<4, 4>(),
+};
+
+// Any other geometry.
+const SymbolCodec kGenericCodec = Codec<0, 0>();
+
+const SymbolCodec& CodecFor(const TitanFrameLayout& layout) {
+  for (const SymbolCodec& codec : kSpecializedCodecs) {
+    if (codec.block_size == layout.block_size &&
+        codec.bits_per_symbol == layout.bits_per_symbol) {
+      return codec;
+    }
+  }
+  return kGenericCodec;
+}
+
+size_t SymbolsPerByte(const TitanFrameLayout& layout) {
+  return 8 / layout.bits_per_symbol;
+}
+
+}  // namespace
+
+size_t TitanFrameLayout::payload_capacity() const {
+  size_t capacity = frame_capacity();
+  return capacity > kTitanFrameHeaderSize ? capacity - kTitanFrameHeaderSize
+                                          : 0;
+}
+
+bool TitanFrameLayout::IsValid() const {
+  if (width <= 0 || height <= 0 || block_size <= 0)
+    return false;
+  if (width % 2 != 0 || height % 2 != 0)
+    return false;
+  // More levels than this don't survive quantization in the encoder.
+  if (bits_per_symbol != 1 && bits_per_symbol != 2 && bits_per_symbol != 4)
+    return false;
+  return payload_capacity() > 0;
+}
+
+bool PackTitanFrame(const TitanFrameLayout& layout,
+                    TitanFrameHeader header,
+                    const uint8_t* payload,
+                    size_t size,
+                    webrtc::I420Buffer* buffer) {
+  RTC_DCHECK(layout.IsValid());
+  RTC_DCHECK_EQ(buffer->width(), layout.width);
+  RTC_DCHECK_EQ(buffer->height(), layout.height);
+  if (size > layout.payload_capacity())
+    return false;
+
+  header.length = static_cast<uint32_t>(size);
+  header.crc = rtc::ComputeCrc32(payload, size);
+
+  uint8_t header_data[kTitanFrameHeaderSize];
+  header_data[0] = kTitanMagic;
+  header_data[1] = kTitanVersion;
+  header_data[2] = header.flags;
+  header_data[3] = header.stream_id;
+  WriteUint32(header_data + 4, header.sequence);
+  WriteUint32(header_data + 8, header.length);
+  WriteUint32(header_data + 12, header.crc);
+
+  uint8_t* plane = buffer->MutableDataY();
+  const int stride = buffer->StrideY();
+  // Start from a blank frame so that unused symbols compress to nothing.
+  for (int row = 0; row < layout.height; ++row)
+    memset(plane + row * stride, kLumaLow, layout.width);
+  memset(buffer->MutableDataU(), kChromaNeutral,
+         buffer->StrideU() * buffer->ChromaHeight());
+  memset(buffer->MutableDataV(), kChromaNeutral,
+         buffer->StrideV() * buffer->ChromaHeight());
+
+  const SymbolCodec& codec = CodecFor(layout);
+  codec.write(layout, header_data, sizeof(header_data), 0, plane, stride);
+  codec.write(layout, payload, size,
+              kTitanFrameHeaderSize * SymbolsPerByte(layout), plane, stride);
+  return true;
+}
+
+bool UnpackTitanFrame(const TitanFrameLayout& layout,
+                      const webrtc::I420BufferInterface& buffer,
+                      TitanFrameHeader* header,
+                      std::vector<uint8_t>* payload) {
+  RTC_DCHECK(layout.IsValid());
+  if (buffer.width() != layout.width || buffer.height() != layout.height)
+    return false;
+
+  const uint8_t* plane = buffer.DataY();
+  const int stride = buffer.StrideY();
+
+  const SymbolCodec& codec = CodecFor(layout);
+  uint8_t header_data[kTitanFrameHeaderSize];
+  codec.read(layout, plane, stride, 0, sizeof(header_data), header_data);
+  if (header_data[0] != kTitanMagic || header_data[1] != kTitanVersion)
+    return false;
+
+  header->flags = header_data[2];
+  header->stream_id = header_data[3];
+  header->sequence = ReadUint32(header_data + 4);
+  header->length = ReadUint32(header_data + 8);
+  header->crc = ReadUint32(header_data + 12);
+  if (header->length > layout.payload_capacity())
+    return false;
+
+  payload->resize(header->length);
+  codec.read(layout, plane, stride,
+             kTitanFrameHeaderSize * SymbolsPerByte(layout), header->length,
+             payload->data());
+  return rtc::ComputeCrc32(payload->data(), payload->size()) == header->crc;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame_buffer.h>
+
+// Geometry of the symbols packed into the luma plane of a Titan frame. Each
+// symbol is a square block of pixels whose brightness carries
+// |bits_per_symbol| bits, so the blocks survive lossy video coding.
+struct TitanFrameLayout {
+  int width = 640;
+  int height = 480;
+  int block_size = 8;
+  int bits_per_symbol = 1;
+
+  int columns() const { return width / block_size; }
+  int rows() const { return height / block_size; }
+  size_t symbol_count() const {
+    return static_cast<size_t>(columns()) * rows();
+  }
+  // Bytes that fit into one frame, header included.
+  size_t frame_capacity() const {
+    return symbol_count() * bits_per_symbol / 8;
+  }
+  size_t payload_capacity() const;
+
+  bool IsValid() const;
+};
+
+// Fixed size header in front of the payload of every Titan frame.
+struct TitanFrameHeader {
+  uint8_t flags = 0;
+  uint8_t stream_id = 0;
+  uint32_t sequence = 0;
+  uint32_t length = 0;
+  uint32_t crc = 0;
+};
+
+const size_t kTitanFrameHeaderSize = 16;
+
+// TitanFrameHeader::stream_id values.
+enum : uint8_t {
+  // Chunks of transport messages, see TitanTrackTransport.
+  kTitanMessageStream = 0,
+  // Bytes that are delivered frame by frame as they are.
+  kTitanRawStream = 1,
+  // XOR parity of the kTitanMessageStream frames in front, see TitanFec.h.
+  kTitanParityStream = 2,
+};
+
+// Packs |payload| behind |header| into the luma plane of |buffer|, which must
+// have the dimensions of |layout|. The chroma planes are set to neutral grey.
+// |header.length| and |header.crc| are filled in from |payload|.
+bool PackTitanFrame(const TitanFrameLayout& layout,
+                    TitanFrameHeader header,
+                    const uint8_t* payload,
+                    size_t size,
+                    webrtc::I420Buffer* buffer);
+
+// Recovers header and payload from a frame produced by PackTitanFrame.
+// Returns false if the frame doesn't carry a Titan header or the payload
+// doesn't match its checksum.
+bool UnpackTitanFrame(const TitanFrameLayout& layout,
+                      const webrtc::I420BufferInterface& buffer,
+                      TitanFrameHeader* header,
+                      std::vector<uint8_t>* payload);
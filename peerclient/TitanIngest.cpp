@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "TitanIngest.h"
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+
+namespace {
+
+const int kTickIntervalMs = 5;
+// Bounds the time a single tick keeps the thread busy.
+const size_t kMaxBytesPerTick = 1024 * 1024;
+
+}  // namespace
+
+TitanIngest::TitanIngest(rtc::Thread* thread,
+                         TitanIngestInput* input,
+                         TitanTransport* transport)
+    : thread_(thread),
+      input_(input),
+      transport_(transport),
+      running_(false),
+      pending_(false),
+      messages_sent_(0),
+      bytes_sent_(0) {
+  RTC_DCHECK(thread_);
+  RTC_DCHECK(input_);
+  RTC_DCHECK(transport_);
+}
+
+TitanIngest::~TitanIngest() {
+  Stop();
+}
+
+void TitanIngest::Start() {
+  RTC_DCHECK(thread_->IsCurrent());
+  if (running_)
+    return;
+  running_ = true;
+  RTC_LOG(INFO) << "Forwarding " << input_->name() << " input to "
+                << transport_->name();
+  thread_->PostDelayed(RTC_FROM_HERE, kTickIntervalMs, this, MSG_TICK);
+}
+
+void TitanIngest::Stop() {
+  if (!running_)
+    return;
+  running_ = false;
+  thread_->Clear(this);
+  // A held back message is lost with the transport; everything after it is
+  // still with the input.
+  RTC_LOG(INFO) << "Forwarded " << messages_sent_ << " messages, "
+                << bytes_sent_ << " bytes"
+                << (pending_ ? ", dropped the one held back" : "");
+  pending_ = false;
+}
+
+void TitanIngest::OnMessage(rtc::Message* msg) {
+  RTC_DCHECK_EQ(msg->message_id, MSG_TICK);
+  if (!running_)
+    return;
+  Pump();
+  thread_->PostDelayed(RTC_FROM_HERE, kTickIntervalMs, this, MSG_TICK);
+}
+
+void TitanIngest::Pump() {
+  if (!transport_->ready())
+    return;
+  size_t bytes = 0;
+  while (bytes < kMaxBytesPerTick) {
+    if (!pending_) {
+      if (!input_->Read(&message_))
+        return;
+      pending_ = true;
+    }
+    if (!transport_->Send(message_.data(), message_.size()))
+      return;
+    pending_ = false;
+    bytes += message_.size();
+    ++messages_sent_;
+    bytes_sent_ += message_.size();
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <rtc_base/messagehandler.h>
+#include <rtc_base/thread.h>
+
+#include "TitanIngestInput.h"
+#include "TitanTransport.h"
+
+// Forwards messages from a TitanIngestInput to a transport, polling both on
+// |thread|. A message the transport doesn't accept yet is held back and
+// nothing more is read until it went out, so once the send buffer is full
+// (for the Titan track: until the source drained it at its frame rate) the
+// producer is the one that has to wait.
+class TitanIngest : public rtc::MessageHandler {
+ public:
+  TitanIngest(rtc::Thread* thread,
+              TitanIngestInput* input,
+              TitanTransport* transport);
+  ~TitanIngest() override;
+
+  void Start();
+  void Stop();
+
+ private:
+  enum { MSG_TICK };
+
+  void OnMessage(rtc::Message* msg) override;
+  void Pump();
+
+  rtc::Thread* const thread_;
+  TitanIngestInput* const input_;
+  TitanTransport* const transport_;
+
+  bool running_;
+  bool pending_;
+  std::vector<uint8_t> message_;
+  uint64_t messages_sent_;
+  uint64_t bytes_sent_;
+};
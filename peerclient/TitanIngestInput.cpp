@@ -0,0 +1,305 @@
+#include "pch.h"
+
+#include "TitanIngestInput.h"
+
+#include <string.h>
+
+#if defined(WEBRTC_POSIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/timeutils.h>
+
+namespace {
+
+const char kSharedRingPrefix[] = "shm:";
+const char kStreamPrefix[] = "pipe:";
+// How often a missing ring is looked for again.
+const int kReopenIntervalMs = 1000;
+const size_t kLengthSize = 4;
+const size_t kReceiveChunkSize = 64 * 1024;
+
+bool HasPrefix(const std::string& value, const char* prefix) {
+  return value.compare(0, strlen(prefix), prefix) == 0;
+}
+
+}  // namespace
+
+std::unique_ptr<TitanIngestInput> CreateTitanIngestInput(
+    const std::string& spec,
+    size_t max_message_size) {
+  if (HasPrefix(spec, kSharedRingPrefix)) {
+    return std::unique_ptr<TitanIngestInput>(new TitanSharedRingInput(
+        spec.substr(strlen(kSharedRingPrefix)), max_message_size));
+  }
+  if (HasPrefix(spec, kStreamPrefix)) {
+    return std::unique_ptr<TitanIngestInput>(new TitanStreamInput(
+        spec.substr(strlen(kStreamPrefix)), max_message_size));
+  }
+  RTC_LOG(LS_ERROR) << "Unknown ingest input " << spec;
+  return nullptr;
+}
+
+TitanSharedRingInput::TitanSharedRingInput(const std::string& ring_name,
+                                           size_t max_message_size)
+    : ring_name_(ring_name),
+      max_message_size_(max_message_size),
+      next_open_ms_(0) {}
+
+TitanSharedRingInput::~TitanSharedRingInput() {}
+
+bool TitanSharedRingInput::Read(std::vector<uint8_t>* message) {
+  if (!ring_) {
+    int64_t now_ms = rtc::TimeMillis();
+    if (now_ms < next_open_ms_)
+      return false;
+    next_open_ms_ = now_ms + kReopenIntervalMs;
+    ring_ = TitanSharedRingReader::Open(ring_name_);
+    if (!ring_)
+      return false;
+    if (!ring_->flow_controlled()) {
+      RTC_LOG(LS_ERROR) << "Shared ring " << ring_name_
+                        << " is not flow controlled, can't ingest from it";
+      ring_.reset();
+      return false;
+    }
+    RTC_LOG(INFO) << "Ingesting from shared ring " << ring_name_;
+  }
+
+  TitanSharedRingView view;
+  while (ring_->Read(&view)) {
+    // The writer can't reuse the slot before Release(), no need to
+    // Validate().
+    bool fits = view.size <= max_message_size_;
+    if (fits)
+      message->assign(view.data, view.data + view.size);
+    ring_->Release(view);
+    if (fits)
+      return true;
+    RTC_LOG(LS_WARNING) << "Dropping " << view.size
+                        << " byte message, larger than the transport takes";
+  }
+  // Checked after reading so that nothing the producer wrote before going
+  // away is lost.
+  if (ring_->closed()) {
+    RTC_LOG(INFO) << "Shared ring " << ring_name_ << " was closed";
+    ring_.reset();
+  }
+  return false;
+}
+
+bool TitanStreamInput::TakeMessage(std::vector<uint8_t>* message) {
+  if (buffer_.size() < kLengthSize)
+    return false;
+  size_t length = static_cast<size_t>(buffer_[0]) |
+                  static_cast<size_t>(buffer_[1]) << 8 |
+                  static_cast<size_t>(buffer_[2]) << 16 |
+                  static_cast<size_t>(buffer_[3]) << 24;
+  if (length > max_message_size_) {
+    RTC_LOG(LS_ERROR) << "Ingest producer sent a " << length
+                      << " byte message, disconnecting it";
+    Disconnect();
+    return false;
+  }
+  if (buffer_.size() < kLengthSize + length)
+    return false;
+  message->assign(buffer_.begin() + kLengthSize,
+                  buffer_.begin() + kLengthSize + length);
+  buffer_.erase(buffer_.begin(), buffer_.begin() + kLengthSize + length);
+  return true;
+}
+
+bool TitanStreamInput::Read(std::vector<uint8_t>* message) {
+  // Only receive more once the buffered messages are gone, which keeps the
+  // buffer bounded and leaves the rest in the pipe.
+  if (TakeMessage(message))
+    return true;
+  Receive();
+  return TakeMessage(message);
+}
+
+#if defined(WEBRTC_WIN)
+
+TitanStreamInput::TitanStreamInput(const std::string& pipe_name,
+                                   size_t max_message_size)
+    : path_("\\\\.\\pipe\\titan-" + pipe_name),
+      max_message_size_(max_message_size),
+      pipe_(INVALID_HANDLE_VALUE),
+      event_(::CreateEventA(nullptr, /*bManualReset=*/TRUE, FALSE, nullptr)),
+      io_pending_(false),
+      connected_(false),
+      chunk_(kReceiveChunkSize) {
+  memset(&overlapped_, 0, sizeof(overlapped_));
+  overlapped_.hEvent = event_;
+  pipe_ = ::CreateNamedPipeA(
+      path_.c_str(),
+      PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+          FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      1, 0, static_cast<DWORD>(kReceiveChunkSize), 0, nullptr);
+  if (pipe_ == INVALID_HANDLE_VALUE) {
+    RTC_LOG(LS_ERROR) << "Failed to create pipe " << path_ << ": "
+                      << ::GetLastError();
+  } else {
+    RTC_LOG(INFO) << "Ingesting from pipe " << path_;
+  }
+}
+
+TitanStreamInput::~TitanStreamInput() {
+  if (io_pending_) {
+    DWORD transferred;
+    ::CancelIoEx(pipe_, &overlapped_);
+    ::GetOverlappedResult(pipe_, &overlapped_, &transferred, TRUE);
+  }
+  if (pipe_ != INVALID_HANDLE_VALUE)
+    ::CloseHandle(pipe_);
+  if (event_)
+    ::CloseHandle(event_);
+}
+
+void TitanStreamInput::Receive() {
+  if (pipe_ == INVALID_HANDLE_VALUE || !event_)
+    return;
+
+  if (!io_pending_) {
+    ::ResetEvent(event_);
+    BOOL started;
+    if (connected_) {
+      started = ::ReadFile(pipe_, chunk_.data(),
+                           static_cast<DWORD>(chunk_.size()), nullptr,
+                           &overlapped_);
+    } else {
+      started = ::ConnectNamedPipe(pipe_, &overlapped_);
+    }
+    DWORD error = started ? ERROR_SUCCESS : ::GetLastError();
+    if (error == ERROR_PIPE_CONNECTED) {
+      connected_ = true;
+      return;
+    }
+    if (error != ERROR_SUCCESS && error != ERROR_IO_PENDING) {
+      // Also covers a producer that connected and left in between.
+      if (connected_)
+        Disconnect();
+      else
+        ::DisconnectNamedPipe(pipe_);
+      return;
+    }
+    io_pending_ = true;
+  }
+
+  // Both complete through |overlapped_|, even when they finished right away.
+  DWORD transferred = 0;
+  if (!::GetOverlappedResult(pipe_, &overlapped_, &transferred, FALSE)) {
+    if (::GetLastError() == ERROR_IO_INCOMPLETE)
+      return;
+    io_pending_ = false;
+    if (connected_)
+      Disconnect();
+    else
+      ::DisconnectNamedPipe(pipe_);
+    return;
+  }
+  io_pending_ = false;
+  if (!connected_) {
+    connected_ = true;
+    RTC_LOG(INFO) << "Ingest producer connected to " << path_;
+    return;
+  }
+  buffer_.insert(buffer_.end(), chunk_.begin(), chunk_.begin() + transferred);
+}
+
+void TitanStreamInput::Disconnect() {
+  RTC_LOG(INFO) << "Ingest producer disconnected from " << path_;
+  if (io_pending_) {
+    DWORD transferred;
+    ::CancelIoEx(pipe_, &overlapped_);
+    ::GetOverlappedResult(pipe_, &overlapped_, &transferred, TRUE);
+    io_pending_ = false;
+  }
+  ::DisconnectNamedPipe(pipe_);
+  connected_ = false;
+  buffer_.clear();
+}
+
+#elif defined(WEBRTC_POSIX)
+
+TitanStreamInput::TitanStreamInput(const std::string& pipe_name,
+                                   size_t max_message_size)
+    : path_("/tmp/titan-" + pipe_name + ".sock"),
+      max_message_size_(max_message_size),
+      listen_fd_(-1),
+      client_fd_(-1) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path_.size() >= sizeof(address.sun_path)) {
+    RTC_LOG(LS_ERROR) << "Socket path " << path_ << " is too long";
+    return;
+  }
+  memcpy(address.sun_path, path_.c_str(), path_.size());
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0)
+    return;
+  // A socket file left behind by an earlier run would make bind() fail.
+  unlink(path_.c_str());
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, 1) != 0 ||
+      fcntl(listen_fd_, F_SETFL, O_NONBLOCK) != 0) {
+    RTC_LOG(LS_ERROR) << "Failed to listen on " << path_ << ": " << errno;
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return;
+  }
+  RTC_LOG(INFO) << "Ingesting from socket " << path_;
+}
+
+TitanStreamInput::~TitanStreamInput() {
+  if (client_fd_ >= 0)
+    close(client_fd_);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+}
+
+void TitanStreamInput::Receive() {
+  if (listen_fd_ < 0)
+    return;
+
+  if (client_fd_ < 0) {
+    client_fd_ = accept(listen_fd_, nullptr, nullptr);
+    if (client_fd_ < 0)
+      return;
+    fcntl(client_fd_, F_SETFL, O_NONBLOCK);
+    RTC_LOG(INFO) << "Ingest producer connected to " << path_;
+  }
+
+  size_t offset = buffer_.size();
+  buffer_.resize(offset + kReceiveChunkSize);
+  ssize_t received = read(client_fd_, buffer_.data() + offset,
+                          kReceiveChunkSize);
+  buffer_.resize(offset + (received > 0 ? received : 0));
+  if (received == 0 ||
+      (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+       errno != EINTR)) {
+    Disconnect();
+  }
+}
+
+void TitanStreamInput::Disconnect() {
+  RTC_LOG(INFO) << "Ingest producer disconnected from " << path_;
+  close(client_fd_);
+  client_fd_ = -1;
+  buffer_.clear();
+}
+
+#endif
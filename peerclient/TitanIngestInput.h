@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(WEBRTC_WIN)
+#include <windows.h>
+#endif
+
+#include "TitanSharedRing.h"
+
+// A source of messages written by another process. Reading never blocks;
+// whatever the input hasn't been asked for yet stays with the producer, so a
+// consumer that stops reading pushes back on it.
+class TitanIngestInput {
+ public:
+  virtual ~TitanIngestInput() {}
+
+  virtual const char* name() const = 0;
+
+  // Moves the next complete message into |message|. Returns false if there
+  // is none right now.
+  virtual bool Read(std::vector<uint8_t>* message) = 0;
+};
+
+// Creates the input described by |spec|: "shm:<name>" for a flow controlled
+// TitanSharedRing created by the producer, or "pipe:<name>" for a byte stream
+// of messages. Messages larger than |max_message_size| are dropped.
+std::unique_ptr<TitanIngestInput> CreateTitanIngestInput(
+    const std::string& spec,
+    size_t max_message_size);
+
+// Reads from a flow controlled TitanSharedRing. The producer creates the
+// ring, this side keeps trying to open it and reopens it when the producer
+// comes back after going away.
+class TitanSharedRingInput : public TitanIngestInput {
+ public:
+  TitanSharedRingInput(const std::string& ring_name, size_t max_message_size);
+  ~TitanSharedRingInput() override;
+
+  const char* name() const override { return "shm"; }
+  bool Read(std::vector<uint8_t>* message) override;
+
+ private:
+  const std::string ring_name_;
+  const size_t max_message_size_;
+  std::unique_ptr<TitanSharedRingReader> ring_;
+  int64_t next_open_ms_;
+};
+
+// Listens on a named pipe on Windows and a Unix domain socket elsewhere, and
+// reads messages framed as a 4 byte little endian length followed by that
+// many bytes. One producer is served at a time; a producer that sends a bad
+// length is disconnected.
+class TitanStreamInput : public TitanIngestInput {
+ public:
+  TitanStreamInput(const std::string& pipe_name, size_t max_message_size);
+  ~TitanStreamInput() override;
+
+  const char* name() const override { return "pipe"; }
+  bool Read(std::vector<uint8_t>* message) override;
+
+ private:
+  // Returns the first message in |buffer_|, if it is complete.
+  bool TakeMessage(std::vector<uint8_t>* message);
+  // Reads whatever the producer has sent so far into |buffer_|.
+  void Receive();
+  void Disconnect();
+
+  const std::string path_;
+  const size_t max_message_size_;
+  std::vector<uint8_t> buffer_;
+#if defined(WEBRTC_WIN)
+  HANDLE pipe_;
+  HANDLE event_;
+  OVERLAPPED overlapped_;
+  bool io_pending_;
+  bool connected_;
+  std::vector<uint8_t> chunk_;
+#else
+  int listen_fd_;
+  int client_fd_;
+#endif
+};
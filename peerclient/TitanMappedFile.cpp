@@ -0,0 +1,138 @@
+#include "pch.h"
+
+#include "TitanMappedFile.h"
+
+#include <algorithm>
+
+#if defined(WEBRTC_WIN)
+#include <windows.h>
+#elif defined(WEBRTC_POSIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <rtc_base/logging.h>
+
+namespace {
+
+// Read ahead in steps of this much, keeping up to two steps in front of the
+// reader.
+const size_t kWindowSize = 8 * 1024 * 1024;
+
+}  // namespace
+
+#if defined(WEBRTC_WIN)
+
+// static
+std::unique_ptr<TitanMappedFile> TitanMappedFile::Open(
+    const std::string& path) {
+  std::unique_ptr<TitanMappedFile> file(new TitanMappedFile());
+  HANDLE handle = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                nullptr, OPEN_EXISTING,
+                                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    RTC_LOG(LS_ERROR) << "Failed to open " << path;
+    return nullptr;
+  }
+  file->file_ = handle;
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+    RTC_LOG(LS_ERROR) << path << " is empty";
+    return nullptr;
+  }
+  file->mapping_ =
+      ::CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!file->mapping_)
+    return nullptr;
+  file->data_ = static_cast<uint8_t*>(
+      ::MapViewOfFile(file->mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!file->data_)
+    return nullptr;
+  file->size_ = static_cast<size_t>(size.QuadPart);
+  file->Advance(0);
+  return file;
+}
+
+TitanMappedFile::~TitanMappedFile() {
+  if (data_)
+    ::UnmapViewOfFile(data_);
+  if (mapping_)
+    ::CloseHandle(mapping_);
+  if (file_)
+    ::CloseHandle(file_);
+}
+
+#elif defined(WEBRTC_POSIX)
+
+// static
+std::unique_ptr<TitanMappedFile> TitanMappedFile::Open(
+    const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    RTC_LOG(LS_ERROR) << "Failed to open " << path;
+    return nullptr;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    RTC_LOG(LS_ERROR) << path << " is empty";
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  std::unique_ptr<TitanMappedFile> file(new TitanMappedFile());
+  file->data_ = static_cast<uint8_t*>(data);
+  file->size_ = size;
+  file->Advance(0);
+  return file;
+}
+
+TitanMappedFile::~TitanMappedFile() {
+  if (data_)
+    munmap(data_, size_);
+}
+
+#endif
+
+void TitanMappedFile::Advance(size_t offset) {
+  if (offset < released_) {
+    // Started over, the front has to be read ahead again.
+    prefetched_ = 0;
+    released_ = 0;
+  }
+
+  // Windows start at multiples of kWindowSize into the page aligned mapping,
+  // as madvise() wants.
+  while (prefetched_ < size_ && prefetched_ < offset + 2 * kWindowSize) {
+    size_t length = std::min(kWindowSize, size_ - prefetched_);
+#if defined(WEBRTC_WIN)
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = data_ + prefetched_;
+    range.NumberOfBytes = length;
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#endif
+#elif defined(WEBRTC_POSIX)
+    madvise(data_ + prefetched_, length, MADV_WILLNEED);
+#endif
+    prefetched_ += length;
+  }
+
+  // Frames handed out may still point into the window right behind the
+  // reader, so only a window further back is let go. The pages stay valid
+  // either way, a later access just reads them from disk again. Windows
+  // trims them from the working set on its own.
+  while (released_ + 2 * kWindowSize <= offset) {
+#if defined(WEBRTC_POSIX)
+    madvise(data_ + released_, kWindowSize, MADV_DONTNEED);
+#endif
+    released_ += kWindowSize;
+  }
+}
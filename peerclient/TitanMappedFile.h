@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+// Read only mapping of a whole file that is consumed front to back. The OS
+// is told so up front, and Advance() keeps a window ahead of the reader
+// prefetched and lets go of what is behind it, so replaying a file larger
+// than memory stays disk bound instead of fault bound.
+class TitanMappedFile {
+ public:
+  static std::unique_ptr<TitanMappedFile> Open(const std::string& path);
+  ~TitanMappedFile();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Tells the mapping the reader has moved on to |offset|.
+  void Advance(size_t offset);
+
+ private:
+  TitanMappedFile() {}
+
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  // End of the range already asked to be read ahead.
+  size_t prefetched_ = 0;
+  // Start of the range still considered in use.
+  size_t released_ = 0;
+#if defined(WEBRTC_WIN)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
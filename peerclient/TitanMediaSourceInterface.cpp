@@ -2,110 +2,404 @@
 #include "pch.h"
 
 #include "TitanMediaSourceInterface.h"
-#include <iostream>
+#include "TitanEncoderFeedback.h"
+#include "TitanMetrics.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
 #include <thread>
 #include <api/video/i420_buffer.h>
+#include <rtc_base/checks.h>
+#include <rtc_base/timeutils.h>
 
 
 class Timer {
   std::thread th;
+  std::mutex lock;
+  std::condition_variable wakeup;
   bool running = false;
 
  public:
   typedef std::chrono::milliseconds Interval;
   typedef std::function<void(void)> Timeout;
 
+  ~Timer() { stop(); }
+
   void start(const Interval& interval, const Timeout& timeout) {
     running = true;
 
     th = std::thread([=]() {
+      std::unique_lock<std::mutex> guard(lock);
       while (running == true) {
-        std::this_thread::sleep_for(interval);
+        // Waiting rather than sleeping lets stop() cut the interval short.
+        if (wakeup.wait_for(guard, interval, [this] { return !running; }))
+          break;
+        guard.unlock();
         timeout();
+        guard.lock();
       }
     });
   }
 
-  void stop() { running = false; }
+  void stop() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      running = false;
+    }
+    wakeup.notify_all();
+    if (th.joinable())
+      th.join();
+  }
 };
 
-Timer* timer;
+// A handful of frames can be in flight between us and the encoder.
+const size_t kMaxPooledBuffers = 8;
+
+bool ParseTitanBackpressurePolicy(const char* name,
+                                  TitanBackpressure::Policy* policy) {
+  if (strcmp(name, "latest") == 0) {
+    *policy = TitanBackpressure::kLatestWins;
+  } else if (strcmp(name, "block") == 0) {
+    *policy = TitanBackpressure::kBlockProducer;
+  } else if (strcmp(name, "queue") == 0) {
+    *policy = TitanBackpressure::kBoundedQueue;
+  } else {
+    return false;
+  }
+  return true;
+}
 
-TitanTrackSource::TitanTrackSource(bool changes, bool remote)
-    : remote_(remote) {
+TitanTrackSource::TitanTrackSource(bool changes, bool remote,
+                                   int frame_interval_ms)
+    : state_(kInitializing),
+      remote_(remote),
+      signaling_thread_(rtc::Thread::Current()),
+      buffer_pool_(false, kMaxPooledBuffers) {
+  RTC_DCHECK(signaling_thread_);
+  // Both bind to the first thread that uses them.
+  worker_thread_checker_.DetachFromThread();
+  frame_thread_checker_.DetachFromThread();
+  // The pool gauges sum over every source alive.
+  TitanMetrics::Get().buffer_pool_capacity.fetch_add(
+      kMaxPooledBuffers, std::memory_order_relaxed);
   if (changes == true) {
-    timer = new Timer;
-    timer->start(std::chrono::milliseconds(1000),
-                 [this] { this->CompleteFrame(); });
+    timer_.reset(new Timer);
+    timer_->start(std::chrono::milliseconds(frame_interval_ms),
+                  [this] { this->CompleteFrame(); });
   }
 }
 
+TitanTrackSource::~TitanTrackSource() {
+  if (timer_)
+    timer_->stop();
+  signaling_thread_->Clear(this);
+  TitanMetrics& metrics = TitanMetrics::Get();
+  metrics.buffer_pool_capacity.fetch_sub(kMaxPooledBuffers,
+                                         std::memory_order_relaxed);
+  metrics.buffer_pool_allocated.fetch_sub(pooled_buffers_.size(),
+                                          std::memory_order_relaxed);
+}
+
+void TitanTrackSource::Stop() {
+  if (timer_)
+    timer_->stop();
+  // The frame thread is gone, the held back frames won't be sent anymore.
+  queue_.clear();
+  SetState(kEnded);
+}
+
+void TitanTrackSource::SetState(SourceState state) {
+  SourceState previous = state_.load();
+  do {
+    if (previous == state || previous == kEnded)
+      return;
+  } while (!state_.compare_exchange_weak(previous, state));
+  signaling_thread_->Post(RTC_FROM_HERE, this, MSG_STATE_CHANGED);
+}
+
+void TitanTrackSource::OnMessage(rtc::Message* msg) {
+  RTC_DCHECK_EQ(msg->message_id, MSG_STATE_CHANGED);
+  FireOnChanged();
+}
+
+void TitanTrackSource::SetPayloadProvider(TitanPayloadProvider* provider,
+                                          const TitanFrameLayout& layout) {
+  RTC_DCHECK(layout.IsValid());
+  layout_ = layout;
+  payload_provider_.store(provider, std::memory_order_release);
+}
+
+void TitanTrackSource::ClearPayloadProvider() {
+  payload_provider_.store(nullptr, std::memory_order_release);
+}
+
+void TitanTrackSource::SetFrameProvider(TitanFrameProvider* provider) {
+  frame_provider_.store(provider, std::memory_order_release);
+}
+
+void TitanTrackSource::ClearFrameProvider() {
+  frame_provider_.store(nullptr, std::memory_order_release);
+}
+
+void TitanTrackSource::SetBackpressure(TitanEncoderFeedback* feedback,
+                                       const TitanBackpressure& backpressure) {
+  backpressure_ = backpressure;
+  backpressure_.max_pending = std::max<size_t>(backpressure_.max_pending, 1);
+  // Queued frames hold on to pooled buffers, leave some for the encoder.
+  backpressure_.queue_size = std::max<size_t>(
+      1, std::min(backpressure_.queue_size, kMaxPooledBuffers / 2));
+  feedback_.store(feedback, std::memory_order_release);
+}
+
 void TitanTrackSource::AddOrUpdateSink(
     rtc::VideoSinkInterface<webrtc::VideoFrame>* sink,
     const rtc::VideoSinkWants& wants) {
-  VideoSourceBase::AddOrUpdateSink(sink, wants);
-  std::cout << __FUNCTION__ << std::endl;
+  RTC_DCHECK(worker_thread_checker_.CalledOnValidThread());
+  sinks_.AddOrUpdateSink(sink, wants);
 }
 
 void TitanTrackSource::RemoveSink(
     rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) {
-  VideoSourceBase::RemoveSink(sink);
-  std::cout << __FUNCTION__ << std::endl;
+  RTC_DCHECK(worker_thread_checker_.CalledOnValidThread());
+  sinks_.RemoveSink(sink);
 }
 
-int timestamp = 0;
+bool TitanTrackSource::GetStats(Stats* stats) {
+  if (frames_produced_.load(std::memory_order_relaxed) == 0)
+    return false;
+  stats->input_width = last_width_.load(std::memory_order_relaxed);
+  stats->input_height = last_height_.load(std::memory_order_relaxed);
+  return true;
+}
 
-uint8_t red[25] = {0xFF, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+TitanSourceStats TitanTrackSource::GetTitanStats() const {
+  TitanSourceStats stats;
+  stats.input_width = last_width_.load(std::memory_order_relaxed);
+  stats.input_height = last_height_.load(std::memory_order_relaxed);
+  stats.frames_produced = frames_produced_.load(std::memory_order_relaxed);
+  stats.payload_bytes = payload_bytes_.load(std::memory_order_relaxed);
+  stats.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  stats.frames_deferred = frames_deferred_.load(std::memory_order_relaxed);
+  stats.frames_overflowed = frames_overflowed_.load(std::memory_order_relaxed);
+  TitanEncoderFeedback* feedback = feedback_.load(std::memory_order_acquire);
+  if (feedback) {
+    stats.encoder_pending = feedback->pending();
+    stats.frames_superseded = feedback->frames_skipped();
+  }
+  int64_t interval_us = frame_interval_us_.load(std::memory_order_relaxed);
+  if (interval_us > 0)
+    stats.produced_fps = static_cast<double>(rtc::kNumMicrosecsPerSec) /
+                         interval_us;
+  return stats;
+}
 
-uint8_t green[25] = {0x00, 0xFF, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+namespace {
 
-uint8_t blue[25] = {0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+// The luma planes of the test pattern, shown in turn.
+const uint8_t kPatternRed[25] = {
+    0xFF, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF};
+const uint8_t kPatternGreen[25] = {
+    0x00, 0xFF, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF};
+const uint8_t kPatternBlue[25] = {
+    0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF};
 
-int type = 0;
+}  // namespace
 
 void TitanTrackSource::CompleteFrame()
 {
-  for (auto& sink_pair : sink_pairs()) {
+  RTC_DCHECK(frame_thread_checker_.CalledOnValidThread());
+  TitanMetrics& metrics = TitanMetrics::Get();
+
+  // Nobody is consuming frames yet, so this tick is lost.
+  if (sinks_.empty()) {
+    frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+    metrics.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    if (state_.load() == kLive)
+      SetState(kMuted);
+    return;
+  }
+
+  int64_t now_us = rtc::TimeMicros();
+  if (last_frame_time_us_ != 0) {
+    // Exponentially smoothed so that a single late tick doesn't skew the fps.
+    int64_t interval_us = now_us - last_frame_time_us_;
+    int64_t smoothed_us = frame_interval_us_.load(std::memory_order_relaxed);
+    smoothed_us = smoothed_us == 0 ? interval_us
+                                   : (smoothed_us * 7 + interval_us) / 8;
+    frame_interval_us_.store(smoothed_us, std::memory_order_relaxed);
+  }
+  last_frame_time_us_ = now_us;
+
+  TitanEncoderFeedback* feedback = feedback_.load(std::memory_order_acquire);
+  if (feedback && backpressure_.policy == TitanBackpressure::kBlockProducer &&
+      feedback->pending() >= backpressure_.max_pending) {
+    // Whatever the provider has stays there until the next tick.
+    frames_deferred_.fetch_add(1, std::memory_order_relaxed);
+    metrics.frames_deferred.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
 
-      
-      rtc::scoped_refptr<webrtc::I420Buffer> buffer(
-          webrtc::I420Buffer::Create(5, 5));
+  TitanFrameProvider* frame_provider =
+      frame_provider_.load(std::memory_order_acquire);
+  if (frame_provider) {
+    CompleteProvidedFrame(frame_provider);
+    return;
+  }
+  TitanPayloadProvider* provider =
+      payload_provider_.load(std::memory_order_acquire);
+  if (provider) {
+    CompletePayloadFrame(provider);
+    return;
+  }
+
+  TitanSinkRegistry::ReadScope scope(&sinks_);
+  for (const auto& entry : scope.sinks()) {
+      int64_t build_start_us = rtc::TimeMicros();
+      rtc::scoped_refptr<webrtc::I420Buffer> buffer(CreateBuffer(5, 5));
+      if (!buffer)
+        continue;
       buffer->InitializeData();
 
-      if (type == 0)
+      if (pattern_colour_ == 0)
       {
-        memcpy((void*)buffer->DataY(), red, 25);
-        std::cout << "send red" << std::endl;
-        type++;
-      }else if (type == 1)
+        memcpy((void*)buffer->DataY(), kPatternRed, 25);
+        pattern_colour_++;
+      }else if (pattern_colour_ == 1)
       {
-        memcpy((void*)buffer->DataY(), green, 25);
-        std::cout << "send green" << std::endl;
-        type++;
-      }else if (type == 2)
+        memcpy((void*)buffer->DataY(), kPatternGreen, 25);
+        pattern_colour_++;
+      }else if (pattern_colour_ == 2)
       {
-        memcpy((void*)buffer->DataY(), blue, 25);
-        std::cout << "send blue" << std::endl;
-        type = 0;
+        memcpy((void*)buffer->DataY(), kPatternBlue, 25);
+        pattern_colour_ = 0;
       }
-      
-      const uint8_t *data = buffer->DataY();
 
-      time_t ltime;
-      time(&ltime);
+      pattern_timestamp_us_ += rtc::kNumMicrosecsPerSec / 30;
+
+      metrics.frame_build_ms.Observe(
+          (rtc::TimeMicros() - build_start_us) /
+          static_cast<double>(rtc::kNumMicrosecsPerMillisec));
+
+      entry.sink->OnFrame(
+          webrtc::VideoFrame(buffer, webrtc::kVideoRotation_0,
+                             pattern_timestamp_us_));
+
+      OnFrameProduced(buffer->width(), buffer->height(),
+                      sizeof(kPatternRed));
+  }
+}
+
+void TitanTrackSource::CompletePayloadFrame(TitanPayloadProvider* provider) {
+  int64_t build_start_us = rtc::TimeMicros();
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer(
+      CreateBuffer(layout_.width, layout_.height));
+  if (!buffer)
+    return;
+
+  payload_scratch_.resize(layout_.payload_capacity());
+  size_t size =
+      provider->FillPayload(payload_scratch_.data(), payload_scratch_.size());
+  RTC_DCHECK_LE(size, payload_scratch_.size());
+
+  TitanFrameHeader header;
+  header.stream_id = provider->stream_id();
+  header.sequence = sequence_++;
+  PackTitanFrame(layout_, header, payload_scratch_.data(), size, buffer.get());
+
+  TitanMetrics::Get().frame_build_ms.Observe(
+      (rtc::TimeMicros() - build_start_us) /
+      static_cast<double>(rtc::kNumMicrosecsPerMillisec));
 
-      timestamp += rtc::kNumMicrosecsPerSec / 30;
+  DeliverFrame(webrtc::VideoFrame(buffer, webrtc::kVideoRotation_0,
+                                  rtc::TimeMicros()),
+               size);
+}
+
+void TitanTrackSource::CompleteProvidedFrame(TitanFrameProvider* provider) {
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer = provider->NextFrame();
+  if (!buffer)
+    return;
+
+  DeliverFrame(webrtc::VideoFrame(buffer, webrtc::kVideoRotation_0,
+                                  rtc::TimeMicros()),
+               0);
+}
 
-      // timestamp = ltime;
-      // std::cout << "timestamp = " << timestamp;
-      sink_pair.sink->OnFrame(
-          webrtc::VideoFrame(buffer, webrtc::kVideoRotation_0, timestamp));
-      this->FireOnChanged();
+void TitanTrackSource::DeliverFrame(const webrtc::VideoFrame& frame,
+                                    size_t payload_size) {
+  TitanEncoderFeedback* feedback = feedback_.load(std::memory_order_acquire);
+  if (!feedback || backpressure_.policy != TitanBackpressure::kBoundedQueue) {
+    SendFrame(frame, payload_size);
+    return;
   }
-}
\ No newline at end of file
+
+  if (queue_.size() == backpressure_.queue_size) {
+    queue_.pop_front();
+    frames_overflowed_.fetch_add(1, std::memory_order_relaxed);
+    TitanMetrics::Get().frames_overflowed.fetch_add(1,
+                                                    std::memory_order_relaxed);
+  }
+  queue_.push_back({frame, payload_size});
+  while (!queue_.empty() && feedback->pending() < backpressure_.max_pending) {
+    SendFrame(queue_.front().frame, queue_.front().payload_size);
+    queue_.pop_front();
+  }
+}
+
+void TitanTrackSource::SendFrame(const webrtc::VideoFrame& frame,
+                                 size_t payload_size) {
+  // Registered first, the encoder may take the frame before OnFrame returns.
+  TitanEncoderFeedback* feedback = feedback_.load(std::memory_order_acquire);
+  if (feedback)
+    feedback->OnFrameSent(frame.timestamp_us());
+  // The same frame goes to every sink.
+  {
+    TitanSinkRegistry::ReadScope scope(&sinks_);
+    for (const auto& entry : scope.sinks())
+      entry.sink->OnFrame(frame);
+  }
+
+  OnFrameProduced(frame.width(), frame.height(), payload_size);
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> TitanTrackSource::CreateBuffer(
+    int width, int height) {
+  TitanMetrics& metrics = TitanMetrics::Get();
+  metrics.buffer_pool_requests.fetch_add(1, std::memory_order_relaxed);
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer(
+      buffer_pool_.CreateBuffer(width, height));
+  if (!buffer) {
+    // Every pooled buffer is still held downstream.
+    metrics.buffer_pool_exhausted.fetch_add(1, std::memory_order_relaxed);
+    metrics.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  if (std::find(pooled_buffers_.begin(), pooled_buffers_.end(),
+                buffer.get()) == pooled_buffers_.end()) {
+    pooled_buffers_.push_back(buffer.get());
+    metrics.buffer_pool_allocated.fetch_add(1, std::memory_order_relaxed);
+  }
+  return buffer;
+}
+
+void TitanTrackSource::OnFrameProduced(int width, int height,
+                                       size_t payload_size) {
+  SetState(kLive);
+  last_width_.store(width, std::memory_order_relaxed);
+  last_height_.store(height, std::memory_order_relaxed);
+  frames_produced_.fetch_add(1, std::memory_order_relaxed);
+  payload_bytes_.fetch_add(payload_size, std::memory_order_relaxed);
+
+  TitanMetrics& metrics = TitanMetrics::Get();
+  metrics.frames_produced.fetch_add(1, std::memory_order_relaxed);
+  metrics.payload_bytes_sent.fetch_add(payload_size,
+                                       std::memory_order_relaxed);
+}
@@ -1,10 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <stdint.h>
+
 #include <api/mediastreaminterface.h>
 #include <api/notifier.h>
+#include <common_video/include/i420_buffer_pool.h>
 #include <media/base/mediachannel.h>
 #include <media/base/videosourcebase.h>
+#include <rtc_base/messagehandler.h>
 #include <rtc_base/refcountedobject.h>
+#include <rtc_base/thread.h>
+#include <rtc_base/thread_checker.h>
+
+#include "TitanFrameCodec.h"
+#include "TitanSinkRegistry.h"
 
 class FrameBuffer : rtc::RefCountedObject<webrtc::VideoFrameBuffer> 
 {
@@ -22,6 +34,74 @@ class FrameBuffer : rtc::RefCountedObject<webrtc::VideoFrameBuffer>
 
 };
 
+// Counters describing what the source has produced so far. Written from the
+// frame thread, read from anywhere.
+struct TitanSourceStats {
+  int input_width = 0;
+  int input_height = 0;
+  double produced_fps = 0.0;
+  uint64_t frames_produced = 0;
+  uint64_t payload_bytes = 0;
+  uint64_t frames_dropped = 0;
+  // Backpressure from the encoder, see TitanBackpressure.
+  size_t encoder_pending = 0;
+  uint64_t frames_superseded = 0;
+  uint64_t frames_deferred = 0;
+  uint64_t frames_overflowed = 0;
+};
+
+class TitanEncoderFeedback;
+
+// What the source does once the encoder falls behind, i.e. once
+// |max_pending| frames wait for it.
+struct TitanBackpressure {
+  enum Policy {
+    // Keep producing and let the encoder skip stale frames. For payloads
+    // that carry state, where only the latest one matters.
+    kLatestWins,
+    // Leave the payload with its provider until the encoder caught up. For
+    // bulk data, which then queues up in the transport instead.
+    kBlockProducer,
+    // Keep producing into a queue of |queue_size| frames in front of the
+    // encoder, dropping the oldest once it is full.
+    kBoundedQueue,
+  };
+
+  Policy policy = kLatestWins;
+  size_t max_pending = 2;
+  size_t queue_size = 4;
+};
+
+bool ParseTitanBackpressurePolicy(const char* name,
+                                  TitanBackpressure::Policy* policy);
+
+// Supplies the bytes packed into each frame once the source runs in payload
+// mode.
+class TitanPayloadProvider {
+ public:
+  // Called on the frame thread. Writes up to |capacity| bytes into |data| and
+  // returns how many were written; 0 still produces an (empty) frame.
+  virtual size_t FillPayload(uint8_t* data, size_t capacity) = 0;
+
+  // Tells the receiver how to interpret the payload. Asked after every
+  // FillPayload(), so it may change from frame to frame.
+  virtual uint8_t stream_id() const { return kTitanMessageStream; }
+
+ protected:
+  virtual ~TitanPayloadProvider() {}
+};
+
+// Supplies ready made frames, e.g. video read from a file. Takes precedence
+// over a TitanPayloadProvider.
+class TitanFrameProvider {
+ public:
+  // Called on the frame thread. Returns null if there is no frame this time.
+  virtual rtc::scoped_refptr<webrtc::VideoFrameBuffer> NextFrame() = 0;
+
+ protected:
+  virtual ~TitanFrameProvider() {}
+};
+
 class TitanTrackSourceInterface
     : public rtc::RefCountedObject<
           webrtc::Notifier<webrtc::VideoTrackSourceInterface>> {
@@ -29,33 +109,120 @@ class TitanTrackSourceInterface
   TitanTrackSourceInterface() = default;
 };
 
+class Timer;
+
+// Starts out initializing, goes live with the first frame delivered, is
+// muted while frames are lost for lack of sinks, and ends with Stop().
+// Observers are notified on the thread the source was created on, and only
+// when the state actually changes.
 class TitanTrackSource : public TitanTrackSourceInterface,
-                         public rtc::VideoSourceBase {
+                         public rtc::MessageHandler {
  public:
-  TitanTrackSource(bool changes = false, bool remote = false);
-
-  SourceState state() const override { return state_; }
+  TitanTrackSource(bool changes = false, bool remote = false,
+                   int frame_interval_ms = 1000);
+
+  // Stops producing frames for good and ends the source. Returns once the
+  // frame thread is gone.
+  void Stop();
+
+  // Switches the source from the colour test pattern to frames carrying the
+  // payload of |provider|, packed according to |layout|. Must be called
+  // before frames start flowing.
+  void SetPayloadProvider(TitanPayloadProvider* provider,
+                          const TitanFrameLayout& layout);
+  // Goes back to the test pattern, call before the provider is destroyed.
+  void ClearPayloadProvider();
+
+  // Sends the frames of |provider| as they are. Same rules as above.
+  void SetFrameProvider(TitanFrameProvider* provider);
+  void ClearFrameProvider();
+
+  // Applies |backpressure| according to |feedback| from the encoder. Must
+  // be called before frames start flowing, |feedback| must outlive the
+  // source.
+  void SetBackpressure(TitanEncoderFeedback* feedback,
+                       const TitanBackpressure& backpressure);
+
+  SourceState state() const override { return state_.load(); }
   bool remote() const override { return remote_; }
 
   bool is_screencast() const override { return false; }
   rtc::Optional<bool> needs_denoising() const override { return rtc::nullopt; }
 
-  bool GetStats(Stats* stats) override { return false; }
+  bool GetStats(Stats* stats) override;
+
+  TitanSourceStats GetTitanStats() const;
 
   void AddOrUpdateSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink,
                        const rtc::VideoSinkWants& wants) override;
   void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>* sink) override;
 
+ protected:
+  ~TitanTrackSource() override;
+
  private:
+  enum { MSG_STATE_CHANGED };
+
+  // Sinks are added and removed on the worker thread, frames are delivered
+  // on the frame thread.
   rtc::ThreadChecker worker_thread_checker_;
-  rtc::VideoSourceInterface<webrtc::VideoFrame>* source_;
-  std::vector<rtc::VideoSinkInterface<webrtc::VideoFrame>*> _container;
+  rtc::ThreadChecker frame_thread_checker_;
+  TitanSinkRegistry sinks_;
 
   cricket::VideoOptions options_;
-  SourceState state_;
+  std::atomic<SourceState> state_;
   const bool remote_;
+  rtc::Thread* const signaling_thread_;
+  std::unique_ptr<Timer> timer_;
 
   const rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;
 
+  // Only touched from the frame thread.
+  webrtc::I420BufferPool buffer_pool_;
+  std::vector<const void*> pooled_buffers_;
+
+  // |layout_| is written before |payload_provider_| is published.
+  std::atomic<TitanPayloadProvider*> payload_provider_{nullptr};
+  std::atomic<TitanFrameProvider*> frame_provider_{nullptr};
+
+  // |backpressure_| is written before |feedback_| is published.
+  std::atomic<TitanEncoderFeedback*> feedback_{nullptr};
+  TitanBackpressure backpressure_;
+  struct QueuedFrame {
+    webrtc::VideoFrame frame;
+    size_t payload_size;
+  };
+  // Frames held back for the encoder, only touched from the frame thread.
+  std::deque<QueuedFrame> queue_;
+  TitanFrameLayout layout_;
+  std::vector<uint8_t> payload_scratch_;
+  uint32_t sequence_ = 0;
+  // Test pattern state, only touched from the frame thread.
+  int pattern_colour_ = 0;
+  int64_t pattern_timestamp_us_ = 0;
+
+  std::atomic<int> last_width_{0};
+  std::atomic<int> last_height_{0};
+  std::atomic<uint64_t> frames_produced_{0};
+  std::atomic<uint64_t> payload_bytes_{0};
+  std::atomic<uint64_t> frames_dropped_{0};
+  std::atomic<uint64_t> frames_deferred_{0};
+  std::atomic<uint64_t> frames_overflowed_{0};
+  // Smoothed interval between produced frames, in microseconds.
+  std::atomic<int64_t> frame_interval_us_{0};
+  int64_t last_frame_time_us_ = 0;
+
+  // Moves to |state| unless the source has ended, and schedules observers to
+  // be notified if that changed anything.
+  void SetState(SourceState state);
+  void OnMessage(rtc::Message* msg) override;
+
   void CompleteFrame();
+  void CompletePayloadFrame(TitanPayloadProvider* provider);
+  void CompleteProvidedFrame(TitanFrameProvider* provider);
+  // Hands |frame| to the sinks, or to |queue_| first if so configured.
+  void DeliverFrame(const webrtc::VideoFrame& frame, size_t payload_size);
+  void SendFrame(const webrtc::VideoFrame& frame, size_t payload_size);
+  rtc::scoped_refptr<webrtc::I420Buffer> CreateBuffer(int width, int height);
+  void OnFrameProduced(int width, int height, size_t payload_size);
 };
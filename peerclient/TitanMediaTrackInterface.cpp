@@ -2,6 +2,28 @@
 
 #include "TitanMediaTrackInterface.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+bool ParseTitanBitratePriority(const char* name, double* priority) {
+  if (strcmp(name, "very-low") == 0) {
+    *priority = 0.5;
+  } else if (strcmp(name, "low") == 0) {
+    *priority = 1.0;
+  } else if (strcmp(name, "medium") == 0) {
+    *priority = 2.0;
+  } else if (strcmp(name, "high") == 0) {
+    *priority = 4.0;
+  } else {
+    char* end = nullptr;
+    double value = strtod(name, &end);
+    if (end == name || *end != '\0' || !(value > 0))
+      return false;
+    *priority = value;
+  }
+  return true;
+}
+
 
 TitanTrack::TitanTrack(const std::string& id, TitanTrackSourceInterface* titan_source)
     : MediaStreamTrack<TitanTrackInterface>(id), _titanSource(titan_source) 
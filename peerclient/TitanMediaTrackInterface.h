@@ -6,6 +6,19 @@
 #include <rtc_base/refcountedobject.h>
 #include "pc/mediastreamtrack.h"
 
+// How a sent Titan track competes with the others of the connection for
+// bandwidth, applied to its RtpEncodingParameters.
+struct TitanTrackPriority {
+  // Relative share of the available bitrate, 1.0 being WebRTC's default.
+  double bitrate_priority = 1.0;
+  // Cap in kbps, 0 leaves it to the bandwidth estimate.
+  int max_bitrate_kbps = 0;
+};
+
+// Accepts "very-low", "low", "medium" and "high", which WebRTC maps to 0.5,
+// 1, 2 and 4, or a positive number.
+bool ParseTitanBitratePriority(const char* name, double* priority);
+
 class TitanTrackInterface : public rtc::RefCountedObject<webrtc::VideoTrackInterface> 
 {
 public:
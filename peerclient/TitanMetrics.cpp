@@ -0,0 +1,202 @@
+#include "pch.h"
+
+#include "TitanMetrics.h"
+
+#include <stdio.h>
+
+#include <rtc_base/checks.h>
+
+namespace {
+
+const double kFrameBuildBounds[] = {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25};
+const double kFrameIntervalBounds[] = {5,   10,  20,  33,  50,
+                                       100, 250, 500, 1000};
+const double kSignalingBounds[] = {1, 5, 10, 25, 50, 100, 250, 500, 1000};
+const double kIceConnectBounds[] = {10,  25,   50,   100,  250,
+                                    500, 1000, 2500, 5000, 10000};
+
+template <typename T, size_t N>
+int BoundCount(const T (&)[N]) {
+  return static_cast<int>(N);
+}
+
+void AppendCounter(std::string* out, const char* name, const char* help,
+                   const std::atomic<uint64_t>& value) {
+  AppendMetricHeader(out, name, help, "counter");
+  AppendMetricValue(out, name,
+                    static_cast<double>(value.load(std::memory_order_relaxed)));
+}
+
+void AppendGauge(std::string* out, const char* name, const char* help,
+                 const std::atomic<uint64_t>& value) {
+  AppendMetricHeader(out, name, help, "gauge");
+  AppendMetricValue(out, name,
+                    static_cast<double>(value.load(std::memory_order_relaxed)));
+}
+
+}  // namespace
+
+void AppendMetricHeader(std::string* out, const char* name, const char* help,
+                        const char* type) {
+  out->append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out->append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void AppendMetricValue(std::string* out, const char* name, double value,
+                       const char* labels) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.17g", value);
+  out->append(name);
+  if (labels)
+    out->append("{").append(labels).append("}");
+  out->append(" ").append(buffer).append("\n");
+}
+
+TitanHistogram::TitanHistogram(const char* name, const char* help,
+                               const double* bounds, int bound_count)
+    : name_(name),
+      help_(help),
+      bounds_(bounds),
+      bound_count_(bound_count),
+      count_(0),
+      sum_micros_(0) {
+  RTC_DCHECK_LE(bound_count_, kMaxBuckets);
+  for (auto& bucket : buckets_)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+void TitanHistogram::Observe(double value) {
+  int i = 0;
+  while (i < bound_count_ && value > bounds_[i])
+    ++i;
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_micros_.fetch_add(static_cast<int64_t>(value * 1000000),
+                        std::memory_order_relaxed);
+}
+
+void TitanHistogram::Render(std::string* out) const {
+  AppendMetricHeader(out, name_, help_, "histogram");
+  std::string bucket_name = std::string(name_) + "_bucket";
+  uint64_t cumulative = 0;
+  char labels[32];
+  for (int i = 0; i <= bound_count_; ++i) {
+    cumulative += buckets_[i].load(std::memory_order_relaxed);
+    if (i < bound_count_)
+      snprintf(labels, sizeof(labels), "le=\"%g\"", bounds_[i]);
+    else
+      snprintf(labels, sizeof(labels), "le=\"+Inf\"");
+    AppendMetricValue(out, bucket_name.c_str(),
+                      static_cast<double>(cumulative), labels);
+  }
+  AppendMetricValue(
+      out, (std::string(name_) + "_sum").c_str(),
+      sum_micros_.load(std::memory_order_relaxed) / 1000000.0);
+  AppendMetricValue(
+      out, (std::string(name_) + "_count").c_str(),
+      static_cast<double>(count_.load(std::memory_order_relaxed)));
+}
+
+TitanMetrics::TitanMetrics()
+    : frame_build_ms("titan_frame_build_ms",
+                     "Time spent building one frame in the source.",
+                     kFrameBuildBounds, BoundCount(kFrameBuildBounds)),
+      frame_interval_ms("titan_frame_receive_interval_ms",
+                        "Time between two frames arriving at the receiver.",
+                        kFrameIntervalBounds,
+                        BoundCount(kFrameIntervalBounds)),
+      signaling_send_ms("titan_signaling_send_ms",
+                        "Time to deliver one message to the signaling server.",
+                        kSignalingBounds, BoundCount(kSignalingBounds)),
+      ice_connect_ms("titan_ice_connect_ms",
+                     "Time from the start of a call until ICE connected.",
+                     kIceConnectBounds, BoundCount(kIceConnectBounds)) {}
+
+// static
+TitanMetrics& TitanMetrics::Get() {
+  static TitanMetrics* metrics = new TitanMetrics();
+  return *metrics;
+}
+
+void TitanMetrics::Render(std::string* out) const {
+  AppendCounter(out, "titan_frames_produced_total",
+                "Frames handed to the sinks of the Titan source.",
+                frames_produced);
+  AppendCounter(out, "titan_frames_dropped_total",
+                "Frames the Titan source could not deliver.", frames_dropped);
+  AppendCounter(out, "titan_frames_superseded_total",
+                "Frames replaced by a newer one before the encoder took them.",
+                frames_superseded);
+  AppendCounter(out, "titan_frames_deferred_total",
+                "Frames not produced because the encoder was behind.",
+                frames_deferred);
+  AppendCounter(out, "titan_frames_overflowed_total",
+                "Frames dropped from the full queue in front of the encoder.",
+                frames_overflowed);
+  AppendCounter(out, "titan_frames_received_total",
+                "Frames delivered to the receiving sink.", frames_received);
+  AppendCounter(out, "titan_payload_bytes_sent_total",
+                "Payload bytes packed into produced frames.",
+                payload_bytes_sent);
+  AppendCounter(out, "titan_payload_bytes_received_total",
+                "Payload bytes recovered from received frames.",
+                payload_bytes_received);
+  AppendCounter(out, "titan_frames_lost_total",
+                "Received frames missing without FEC to rebuild them.",
+                frames_lost);
+  AppendCounter(out, "titan_fec_frames_recovered_total",
+                "Missing frames rebuilt from parity frames.",
+                fec_frames_recovered);
+  AppendCounter(out, "titan_fec_parity_frames_sent_total",
+                "Parity frames sent after groups of data frames.",
+                fec_parity_frames_sent);
+  AppendCounter(out, "titan_raw_frames_lost_total",
+                "Raw replay frames missing on the receiving side.",
+                raw_frames_lost);
+  AppendCounter(out, "titan_messages_resent_total",
+                "Messages sent again after the path to the peer came back.",
+                messages_resent);
+  AppendCounter(out, "titan_ice_restarts_total",
+                "ICE restarts started after the connection was lost.",
+                ice_restarts);
+  AppendCounter(out, "titan_compression_input_bytes_total",
+                "Message bytes handed to the compression stage.",
+                compression_input_bytes);
+  AppendCounter(out, "titan_compression_output_bytes_total",
+                "Bytes the compression stage sent for them.",
+                compression_output_bytes);
+  AppendCounter(out, "titan_compression_blocks_stored_total",
+                "Blocks sent uncompressed since they wouldn't shrink.",
+                compression_blocks_stored);
+  AppendGauge(out, "titan_buffer_pool_capacity",
+              "Maximum number of frame buffers in the source pools.",
+              buffer_pool_capacity);
+  AppendGauge(out, "titan_buffer_pool_allocated",
+              "Frame buffers the source pools have allocated so far.",
+              buffer_pool_allocated);
+  AppendCounter(out, "titan_buffer_pool_requests_total",
+                "Frame buffers requested from the source pool.",
+                buffer_pool_requests);
+  AppendCounter(out, "titan_buffer_pool_exhausted_total",
+                "Requests that found every pooled buffer in use.",
+                buffer_pool_exhausted);
+  AppendCounter(out, "titan_signaling_messages_sent_total",
+                "Messages delivered to the signaling server.",
+                signaling_messages_sent);
+  AppendCounter(out, "titan_signaling_reconnects_total",
+                "Attempts to reach the signaling server after a failure.",
+                signaling_reconnects);
+  AppendCounter(out, "titan_dns_cache_hits_total",
+                "Server connections that reused a cached address.",
+                dns_cache_hits);
+  AppendCounter(out, "titan_peer_connections_created_total",
+                "PeerConnections created, for calls or ahead of them.",
+                peer_connections_created);
+  AppendCounter(out, "titan_peer_connections_pooled_total",
+                "Calls that took a PeerConnection created ahead of time.",
+                peer_connections_pooled);
+  frame_build_ms.Render(out);
+  frame_interval_ms.Render(out);
+  signaling_send_ms.Render(out);
+  ice_connect_ms.Render(out);
+}
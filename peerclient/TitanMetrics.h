@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// Fixed bucket histogram that can be observed from any thread without taking
+// a lock. Bucket bounds are inclusive upper bounds, the last bucket is +Inf.
+class TitanHistogram {
+ public:
+  static const int kMaxBuckets = 16;
+
+  TitanHistogram(const char* name, const char* help,
+                 const double* bounds, int bound_count);
+
+  void Observe(double value);
+
+  void Render(std::string* out) const;
+
+ private:
+  const char* const name_;
+  const char* const help_;
+  const double* const bounds_;
+  const int bound_count_;
+  std::atomic<uint64_t> buckets_[kMaxBuckets + 1];
+  std::atomic<uint64_t> count_;
+  // Sum is kept in microunits so that it can be a plain integer atomic.
+  std::atomic<int64_t> sum_micros_;
+};
+
+// Process wide counters exported by the metrics endpoint. Everything in here
+// is a relaxed atomic, so it is safe to bump from the frame path.
+struct TitanMetrics {
+  static TitanMetrics& Get();
+
+  std::atomic<uint64_t> frames_produced{0};
+  std::atomic<uint64_t> frames_dropped{0};
+  // What backpressure between the source and the encoder cost, see
+  // TitanBackpressure.
+  std::atomic<uint64_t> frames_superseded{0};
+  std::atomic<uint64_t> frames_deferred{0};
+  std::atomic<uint64_t> frames_overflowed{0};
+  std::atomic<uint64_t> frames_received{0};
+  std::atomic<uint64_t> payload_bytes_sent{0};
+  std::atomic<uint64_t> payload_bytes_received{0};
+  // Frames missing on the receiving side, and what FEC did about it, see
+  // TitanFecDecoder.
+  std::atomic<uint64_t> frames_lost{0};
+  std::atomic<uint64_t> fec_frames_recovered{0};
+  std::atomic<uint64_t> fec_parity_frames_sent{0};
+  // Gaps in the sequence of kTitanRawStream frames, which have no FEC.
+  std::atomic<uint64_t> raw_frames_lost{0};
+  // Messages sent once more after the path came back, see
+  // TitanTrackTransport::Resume().
+  std::atomic<uint64_t> messages_resent{0};
+  std::atomic<uint64_t> ice_restarts{0};
+  // What TitanCompressedTransport was given and what it sent for it, and
+  // the blocks it sent as they were.
+  std::atomic<uint64_t> compression_input_bytes{0};
+  std::atomic<uint64_t> compression_output_bytes{0};
+  std::atomic<uint64_t> compression_blocks_stored{0};
+
+  std::atomic<uint64_t> buffer_pool_capacity{0};
+  std::atomic<uint64_t> buffer_pool_allocated{0};
+  std::atomic<uint64_t> buffer_pool_requests{0};
+  std::atomic<uint64_t> buffer_pool_exhausted{0};
+
+  std::atomic<uint64_t> signaling_messages_sent{0};
+  // Attempts to reach the signaling server again after it failed, and
+  // connections that found its address in the DNS cache.
+  std::atomic<uint64_t> signaling_reconnects{0};
+  std::atomic<uint64_t> dns_cache_hits{0};
+  std::atomic<uint64_t> peer_connections_created{0};
+  // Calls that found a connection created ahead of time.
+  std::atomic<uint64_t> peer_connections_pooled{0};
+
+  // Time spent building one frame in the source, in milliseconds.
+  TitanHistogram frame_build_ms;
+  // Time between two frames arriving at the receiving sink, in milliseconds.
+  TitanHistogram frame_interval_ms;
+  // Time from handing a message to the signaling server until it was sent.
+  TitanHistogram signaling_send_ms;
+  // Time from the start of a call until ICE connected.
+  TitanHistogram ice_connect_ms;
+
+  // Appends all counters in the Prometheus text exposition format.
+  void Render(std::string* out) const;
+
+ private:
+  TitanMetrics();
+};
+
+// Helpers for writing single samples in the Prometheus text format.
+void AppendMetricHeader(std::string* out, const char* name, const char* help,
+                        const char* type);
+void AppendMetricValue(std::string* out, const char* name, double value,
+                       const char* labels = nullptr);
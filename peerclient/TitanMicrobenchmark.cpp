@@ -0,0 +1,308 @@
+#include "pch.h"
+
+#include "TitanMicrobenchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame.h>
+#include <rtc_base/json.h>
+#include <rtc_base/timeutils.h>
+
+#include "TitanFrameCodec.h"
+#include "TitanTrackTransport.h"
+#include "peer_connection_client.h"
+
+namespace {
+
+// Peers in the roster ParseEntry() goes through, about what a busy server
+// hands out at sign-in.
+const int kRosterSize = 1000;
+// Frames the receive cases cycle through.
+const size_t kReceiveFrames = 16;
+// Iterations are capped so that a case the compiler hollowed out still ends.
+const uint64_t kMaxIterations = 1ull << 32;
+
+const struct {
+  int width;
+  int height;
+} kResolutions[] = {{320, 240}, {640, 480}, {1280, 720}};
+
+// Written by every case, so that the work can't be optimized away.
+volatile size_t g_sink = 0;
+
+struct Case {
+  std::string name;
+  // Runs one operation and returns the bytes it processed.
+  std::function<size_t()> run;
+};
+
+// Doubles the iterations until a run takes |min_time_ms|, then reports it.
+void RunCase(const Case& c, int min_time_ms) {
+  const int64_t min_time_ns = min_time_ms * rtc::kNumNanosecsPerMillisec;
+  for (uint64_t iterations = 1;; iterations *= 2) {
+    size_t bytes = 0;
+    int64_t start_ns = rtc::TimeNanos();
+    for (uint64_t i = 0; i < iterations; ++i)
+      bytes += c.run();
+    int64_t elapsed_ns = rtc::TimeNanos() - start_ns;
+    if (elapsed_ns < min_time_ns && iterations < kMaxIterations)
+      continue;
+
+    g_sink = g_sink + bytes;
+    double seconds = static_cast<double>(elapsed_ns) /
+                     rtc::kNumNanosecsPerSec;
+    printf("%-36s %12.1f ns/op %10.2f MB/s %12llu\n", c.name.c_str(),
+           static_cast<double>(elapsed_ns) / iterations,
+           seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+           static_cast<unsigned long long>(iterations));
+    return;
+  }
+}
+
+// Lets the cases at the parsers the client keeps to itself.
+class BenchmarkedClient : public PeerConnectionClient {
+ public:
+  using PeerConnectionClient::GetHeaderValue;
+  using PeerConnectionClient::ParseEntry;
+  using PeerConnectionClient::ParseServerResponse;
+  using PeerConnectionClient::RosterEntry;
+};
+
+// A sign-in response of peerconnection_server with |body|.
+std::string ServerResponse(const std::string& body) {
+  return "HTTP/1.1 200 Added\r\n"
+         "Server: PeerConnectionTestServer/0.1\r\n"
+         "Cache-Control: no-cache\r\n"
+         "Connection: close\r\n"
+         "Content-Type: text/plain\r\n"
+         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+         "Pragma: 17\r\n"
+         "Access-Control-Allow-Origin: *\r\n"
+         "Access-Control-Allow-Credentials: true\r\n"
+         "Access-Control-Allow-Methods: POST, GET, OPTIONS\r\n"
+         "Access-Control-Allow-Headers: Content-Type, Content-Length, "
+         "Connection, Cache-Control\r\n"
+         "Access-Control-Expose-Headers: Content-Length\r\n"
+         "\r\n" + body;
+}
+
+void AddSignalingCases(std::vector<Case>* cases) {
+  auto client = std::make_shared<BenchmarkedClient>();
+  std::string roster;
+  for (int i = 0; i < kRosterSize; ++i)
+    roster += "user@host-" + std::to_string(i) + "," + std::to_string(i) +
+              ",1\n";
+  auto response = std::make_shared<std::string>(ServerResponse(roster));
+  size_t eoh = response->find("\r\n\r\n");
+
+  cases->push_back({"signaling/GetHeaderValue", [=] {
+    size_t content_length = 0, peer_id = 0;
+    client->GetHeaderValue(*response, eoh, "\r\nContent-Length: ",
+                           &content_length);
+    client->GetHeaderValue(*response, eoh, "\r\nPragma: ", &peer_id);
+    return eoh;
+  }});
+  cases->push_back({"signaling/ParseServerResponse", [=] {
+    size_t peer_id = 0, end_of_headers = 0;
+    client->ParseServerResponse(*response, roster.size(), &peer_id,
+                                &end_of_headers);
+    return end_of_headers;
+  }});
+  cases->push_back({"signaling/ParseEntry", [=] {
+    const char* pos = response->data() + eoh + 4;
+    const char* end = response->data() + response->size();
+    while (pos < end) {
+      const char* eol =
+          static_cast<const char*>(memchr(pos, '\n', end - pos));
+      BenchmarkedClient::RosterEntry entry;
+      client->ParseEntry(pos, eol - pos, &entry);
+      pos = eol + 1;
+    }
+    return roster.size();
+  }});
+}
+
+void AddJsonCases(std::vector<Case>* cases) {
+  // An offer of the size minimized Titan sessions send, see TitanSdp.h.
+  std::string sdp =
+      "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+      "a=group:BUNDLE 0 1\r\na=msid-semantic: WMS titan\r\n";
+  for (int section = 0; section < 2; ++section) {
+    sdp += "m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\nc=IN IP4 0.0.0.0\r\n"
+           "a=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:Ns4F\r\n"
+           "a=ice-pwd:Qq0VlWTq6zVrl2fHEPUVx7oF\r\na=ice-options:trickle\r\n"
+           "a=fingerprint:sha-256 7B:3A:1C:54:92:0E:AD:6F:21:90:D2:1B:5C:0E:"
+           "93:11:4F:A8:3D:2B:66:71:C5:0A:E2:9F:1D:84:B0:37:C8:55\r\n"
+           "a=setup:actpass\r\na=mid:" + std::to_string(section) + "\r\n"
+           "a=extmap:3 http://www.webrtc.org/experiments/rtp-hdrext/"
+           "abs-send-time\r\na=sendrecv\r\na=rtcp-mux\r\na=rtcp-rsize\r\n"
+           "a=rtpmap:96 VP8/90000\r\na=rtcp-fb:96 goog-remb\r\n"
+           "a=rtcp-fb:96 transport-cc\r\na=rtcp-fb:96 ccm fir\r\n"
+           "a=rtcp-fb:96 nack\r\na=rtcp-fb:96 nack pli\r\n"
+           "a=rtpmap:97 rtx/90000\r\na=fmtp:97 apt=96\r\n"
+           "a=ssrc-group:FID 2231627014 632943048\r\n"
+           "a=ssrc:2231627014 cname:4TOk42mSjXCkVIa6\r\n"
+           "a=ssrc:2231627014 msid:titan titan\r\n";
+  }
+  std::string candidate =
+      "candidate:1467250027 1 udp 2122260223 192.168.0.196 46243 typ host "
+      "generation 0 ufrag Ns4F network-id 1";
+
+  auto offer = std::make_shared<std::string>();
+  auto ice = std::make_shared<std::string>();
+  {
+    Json::StyledWriter writer;
+    Json::Value jmessage;
+    jmessage["type"] = "offer";
+    jmessage["sdp"] = sdp;
+    *offer = writer.write(jmessage);
+    jmessage.clear();
+    jmessage["sdpMid"] = "0";
+    jmessage["sdpMLineIndex"] = 0;
+    jmessage["candidate"] = candidate;
+    *ice = writer.write(jmessage);
+  }
+
+  cases->push_back({"json/EncodeOffer", [=] {
+    Json::StyledWriter writer;
+    Json::Value jmessage;
+    jmessage["type"] = "offer";
+    jmessage["sdp"] = sdp;
+    return writer.write(jmessage).size();
+  }});
+  cases->push_back({"json/DecodeOffer", [=] {
+    Json::Reader reader;
+    Json::Value jmessage;
+    std::string type, parsed;
+    reader.parse(*offer, jmessage);
+    rtc::GetStringFromJsonObject(jmessage, "type", &type);
+    rtc::GetStringFromJsonObject(jmessage, "sdp", &parsed);
+    return offer->size();
+  }});
+  cases->push_back({"json/EncodeCandidate", [=] {
+    Json::StyledWriter writer;
+    Json::Value jmessage;
+    jmessage["sdpMid"] = "0";
+    jmessage["sdpMLineIndex"] = 0;
+    jmessage["candidate"] = candidate;
+    return writer.write(jmessage).size();
+  }});
+  cases->push_back({"json/DecodeCandidate", [=] {
+    Json::Reader reader;
+    Json::Value jmessage;
+    std::string mid, parsed;
+    int mline_index = 0;
+    reader.parse(*ice, jmessage);
+    rtc::GetStringFromJsonObject(jmessage, "sdpMid", &mid);
+    rtc::GetIntFromJsonObject(jmessage, "sdpMLineIndex", &mline_index);
+    rtc::GetStringFromJsonObject(jmessage, "candidate", &parsed);
+    return ice->size();
+  }});
+}
+
+// What TitanTrackSource::CompleteFrame() does for a payload provider, minus
+// the frame thread and the buffer pool.
+struct FrameBuilder {
+  explicit FrameBuilder(const TitanFrameLayout& frame_layout)
+      : layout(frame_layout),
+        transport(layout, 4 * layout.payload_capacity()),
+        message(layout.payload_capacity(), 0x5a),
+        payload(layout.payload_capacity()),
+        sequence(0) {}
+
+  // Packs the next frame into |buffer| and returns its payload size.
+  size_t Build(webrtc::I420Buffer* buffer) {
+    // Keeps a message ahead, so that every frame is full.
+    if (transport.buffered_amount() < payload.size())
+      transport.Send(message.data(), message.size());
+    size_t size = transport.FillPayload(payload.data(), payload.size());
+    TitanFrameHeader header;
+    header.stream_id = transport.stream_id();
+    header.sequence = sequence++;
+    PackTitanFrame(layout, header, payload.data(), size, buffer);
+    return size;
+  }
+
+  TitanFrameLayout layout;
+  TitanTrackTransport transport;
+  std::vector<uint8_t> message;
+  std::vector<uint8_t> payload;
+  uint32_t sequence;
+};
+
+class CountingObserver : public TitanTransportObserver {
+ public:
+  void OnTransportMessage(const uint8_t* data, size_t size) override {
+    bytes += size;
+  }
+
+  size_t bytes = 0;
+};
+
+void AddFrameCases(std::vector<Case>* cases) {
+  for (const auto& resolution : kResolutions) {
+    TitanFrameLayout layout;
+    layout.width = resolution.width;
+    layout.height = resolution.height;
+    std::string suffix = "/" + std::to_string(layout.width) + "x" +
+                         std::to_string(layout.height);
+
+    auto builder = std::make_shared<FrameBuilder>(layout);
+    rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+        webrtc::I420Buffer::Create(layout.width, layout.height);
+    cases->push_back({"frame/Build" + suffix, [=] {
+      return builder->Build(buffer.get());
+    }});
+
+    // The receiver sees the same frames over and over again, which the
+    // sequence numbers going back make look like a restarted sender.
+    auto frames = std::make_shared<std::vector<webrtc::VideoFrame>>();
+    FrameBuilder sender(layout);
+    for (size_t i = 0; i < kReceiveFrames; ++i) {
+      rtc::scoped_refptr<webrtc::I420Buffer> frame_buffer =
+          webrtc::I420Buffer::Create(layout.width, layout.height);
+      sender.Build(frame_buffer.get());
+      frames->push_back(webrtc::VideoFrame(
+          frame_buffer, webrtc::kVideoRotation_0, 0));
+    }
+    // Takes the messages, so that their delivery is part of the case.
+    auto observer = std::make_shared<CountingObserver>();
+    auto receiver = std::make_shared<TitanTrackTransport>(
+        layout, 4 * layout.payload_capacity());
+    receiver->SetObserver(observer.get());
+    auto next = std::make_shared<size_t>(0);
+    size_t frame_bytes = layout.payload_capacity();
+    cases->push_back({"frame/Receive" + suffix, [=] {
+      (void)observer;
+      receiver->OnFrame((*frames)[(*next)++ % frames->size()]);
+      return frame_bytes;
+    }});
+  }
+}
+
+}  // namespace
+
+int RunTitanMicrobenchmarks(const char* filter, int min_time_ms) {
+  std::vector<Case> cases;
+  AddSignalingCases(&cases);
+  AddJsonCases(&cases);
+  AddFrameCases(&cases);
+
+  printf("%-36s %18s %15s %12s\n", "Case", "Time", "Throughput",
+         "Iterations");
+  int ran = 0;
+  for (const Case& c : cases) {
+    if (filter && strstr(c.name.c_str(), filter) == nullptr)
+      continue;
+    RunCase(c, min_time_ms);
+    ++ran;
+  }
+  return ran;
+}
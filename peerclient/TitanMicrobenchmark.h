@@ -0,0 +1,12 @@
+#pragma once
+
+// Times the hot paths of the client one at a time, without a call: parsing
+// what the signaling server sends, encoding and decoding the JSON messages
+// exchanged through it, and building and receiving Titan frames at several
+// resolutions.
+//
+// Each case runs at least |min_time_ms| and prints its time per operation
+// and the bytes per second it got through. Only the cases whose name
+// contains |filter| run, all of them for an empty filter. Returns how many
+// ran.
+int RunTitanMicrobenchmarks(const char* filter, int min_time_ms);
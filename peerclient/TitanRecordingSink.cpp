@@ -0,0 +1,170 @@
+#include "pch.h"
+
+#include "TitanRecordingSink.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include <api/video/i420_buffer.h>
+#include <rtc_base/logging.h>
+
+namespace {
+
+// The I/O thread writes once this much is buffered, or after the interval.
+const size_t kBatchSize = 1024 * 1024;
+const auto kFlushInterval = std::chrono::milliseconds(100);
+// Past this, counting what is being written, data is dropped.
+const size_t kMaxBufferedBytes = 64 * 1024 * 1024;
+
+const char kY4mFrame[] = "FRAME\n";
+
+uint8_t* CopyPlane(const uint8_t* source, int stride, int width, int height,
+                   uint8_t* destination) {
+  for (int row = 0; row < height; ++row) {
+    memcpy(destination, source + row * stride, width);
+    destination += width;
+  }
+  return destination;
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<TitanRecordingSink> TitanRecordingSink::Create(
+    const std::string& path,
+    Format format) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    RTC_LOG(LS_ERROR) << "Failed to open " << path << " for recording";
+    return nullptr;
+  }
+  // Writes come in large batches already.
+  setvbuf(file, nullptr, _IONBF, 0);
+  RTC_LOG(INFO) << "Recording " << (format == kY4m ? "frames" : "messages")
+                << " to " << path;
+  return std::unique_ptr<TitanRecordingSink>(
+      new TitanRecordingSink(file, format));
+}
+
+TitanRecordingSink::TitanRecordingSink(FILE* file, Format format)
+    : file_(file),
+      format_(format),
+      running_(true),
+      writing_size_(0),
+      width_(0),
+      height_(0),
+      dropped_(0) {
+  thread_ = std::thread([this] { Run(); });
+}
+
+TitanRecordingSink::~TitanRecordingSink() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    running_ = false;
+  }
+  wakeup_.notify_all();
+  thread_.join();
+  fclose(file_);
+  if (dropped_ > 0) {
+    RTC_LOG(LS_WARNING) << "Recording dropped " << dropped_
+                        << (format_ == kY4m ? " frames" : " messages");
+  }
+}
+
+uint8_t* TitanRecordingSink::Reserve(size_t size) {
+  size_t offset = filling_.size();
+  if (offset + writing_size_ + size > kMaxBufferedBytes) {
+    ++dropped_;
+    return nullptr;
+  }
+  filling_.resize(offset + size);
+  if (filling_.size() >= kBatchSize)
+    wakeup_.notify_one();
+  return filling_.data() + offset;
+}
+
+void TitanRecordingSink::OnTransportMessage(const uint8_t* data,
+                                            size_t size) {
+  if (format_ != kRaw)
+    return;
+  std::lock_guard<std::mutex> guard(lock_);
+  uint8_t* destination = Reserve(size);
+  if (destination)
+    memcpy(destination, data, size);
+}
+
+void TitanRecordingSink::OnFrame(const webrtc::VideoFrame& frame) {
+  if (format_ != kY4m)
+    return;
+  rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
+      frame.video_frame_buffer()->ToI420());
+  int width = buffer->width();
+  int height = buffer->height();
+  int chroma_width = buffer->ChromaWidth();
+  int chroma_height = buffer->ChromaHeight();
+  size_t size = strlen(kY4mFrame) + static_cast<size_t>(width) * height +
+                2 * static_cast<size_t>(chroma_width) * chroma_height;
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (width_ == 0) {
+    // The real frame rate isn't known, players need some value.
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C420jpeg\n", width,
+                          height);
+    uint8_t* destination = Reserve(length);
+    if (!destination)
+      return;
+    memcpy(destination, header, length);
+    width_ = width;
+    height_ = height;
+  } else if (width != width_ || height != height_) {
+    if (dropped_++ == 0) {
+      RTC_LOG(LS_WARNING) << "Not recording " << width << "x" << height
+                          << " frames, the file is " << width_ << "x"
+                          << height_;
+    }
+    return;
+  }
+
+  uint8_t* destination = Reserve(size);
+  if (!destination)
+    return;
+  memcpy(destination, kY4mFrame, strlen(kY4mFrame));
+  destination += strlen(kY4mFrame);
+  destination = CopyPlane(buffer->DataY(), buffer->StrideY(), width, height,
+                          destination);
+  destination = CopyPlane(buffer->DataU(), buffer->StrideU(), chroma_width,
+                          chroma_height, destination);
+  CopyPlane(buffer->DataV(), buffer->StrideV(), chroma_width, chroma_height,
+            destination);
+}
+
+void TitanRecordingSink::Run() {
+  std::vector<uint8_t> writing;
+  bool failed = false;
+  std::unique_lock<std::mutex> guard(lock_);
+  for (;;) {
+    wakeup_.wait_for(guard, kFlushInterval, [this] {
+      return !running_ || filling_.size() >= kBatchSize;
+    });
+    bool stopping = !running_;
+    // The delivering threads go on with the buffer written last time.
+    writing.swap(filling_);
+    writing_size_ = writing.size();
+    guard.unlock();
+
+    if (!writing.empty() && !failed &&
+        fwrite(writing.data(), 1, writing.size(), file_) != writing.size()) {
+      RTC_LOG(LS_ERROR) << "Recording failed, the rest is discarded";
+      failed = true;
+    }
+    writing.clear();
+
+    guard.lock();
+    writing_size_ = 0;
+    if (stopping)
+      break;
+  }
+}
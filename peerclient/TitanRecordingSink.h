@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+
+#include "TitanTransport.h"
+
+// Records what arrives from the remote peer for offline analysis. In Y4M
+// mode it is a sink on the remote video track and writes every decoded
+// frame; in raw mode it observes the Titan transport and appends every
+// message as it is, without framing. Transport messages and the chunks of a
+// --replay file end up interleaved in one stream, and replay chunks the
+// track dropped are missing, so a replayed file only comes back whole from
+// a loss free call without other traffic.
+//
+// The threads delivering frames and messages only copy into a memory
+// buffer. A dedicated thread swaps that buffer for a second one and writes
+// it out in one batch, so a slow disk costs memory, up to a limit past
+// which data is dropped, but never stalls the decoder.
+class TitanRecordingSink : public TitanTransportObserver,
+                           public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  enum Format {
+    kY4m,
+    kRaw,
+  };
+
+  static std::unique_ptr<TitanRecordingSink> Create(const std::string& path,
+                                                    Format format);
+  // Writes out what is still buffered.
+  ~TitanRecordingSink() override;
+
+  Format format() const { return format_; }
+
+  // TitanTransportObserver implementation.
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+
+  // VideoSinkInterface implementation, called on the decoder thread.
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+ private:
+  TitanRecordingSink(FILE* file, Format format);
+
+  // Returns room for |size| more bytes at the end of the buffer being
+  // filled, or null if that would exceed the limit. Called with |lock_|
+  // held.
+  uint8_t* Reserve(size_t size);
+  void Run();
+
+  FILE* const file_;
+  const Format format_;
+
+  std::mutex lock_;
+  std::condition_variable wakeup_;
+  bool running_;
+  // Filled by the delivering threads.
+  std::vector<uint8_t> filling_;
+  // Bytes handed to the I/O thread that aren't on disk yet.
+  size_t writing_size_;
+  // Y4M only supports one size per file, set by the first frame.
+  int width_;
+  int height_;
+  uint64_t dropped_;
+  std::thread thread_;
+};
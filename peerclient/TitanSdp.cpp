@@ -0,0 +1,168 @@
+#include "pch.h"
+
+#include "TitanSdp.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+// Header extensions worth their bytes: the MID bundling demultiplexes on
+// and those the send side bandwidth estimate runs on.
+const char* const kKeptExtensions[] = {
+    "urn:ietf:params:rtp-hdrext:sdes:mid",
+    "http://www.ietf.org/id/"
+    "draft-holmer-rmcat-transport-wide-cc-extensions-01",
+    "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+};
+
+bool StartsWith(const std::string& line, const char* prefix) {
+  return line.compare(0, strlen(prefix), prefix) == 0;
+}
+
+bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return tolower(static_cast<unsigned char>(x)) ==
+                  tolower(static_cast<unsigned char>(y));
+         });
+}
+
+// Payload type an "a=<attribute>:<pt> ..." line is about, or -1.
+int PayloadTypeOf(const std::string& line, const char* attribute) {
+  if (!StartsWith(line, attribute))
+    return -1;
+  const char* value = line.c_str() + strlen(attribute);
+  char* end = nullptr;
+  long pt = strtol(value, &end, 10);
+  if (end == value)
+    return -1;
+  return static_cast<int>(pt);
+}
+
+// Filters the lines of one media section, |lines|[0] being its m-line.
+void MinimizeSection(const std::vector<std::string>& lines,
+                     const TitanSdpProfile& profile,
+                     std::string* out) {
+  const std::string& m_line = lines.front();
+  const std::string* codec = nullptr;
+  if (StartsWith(m_line, "m=video "))
+    codec = &profile.video_codec;
+  else if (StartsWith(m_line, "m=audio "))
+    codec = &profile.audio_codec;
+
+  int primary = -1;
+  if (codec) {
+    for (const std::string& line : lines) {
+      int pt = PayloadTypeOf(line, "a=rtpmap:");
+      if (pt < 0)
+        continue;
+      std::string name = line.substr(line.find(' ') + 1);
+      name = name.substr(0, name.find('/'));
+      if (EqualsIgnoreCase(name, *codec)) {
+        primary = pt;
+        break;
+      }
+    }
+  }
+  if (primary < 0) {
+    for (const std::string& line : lines)
+      *out += line + "\r\n";
+    return;
+  }
+
+  // The codec first, in order of preference, then its RTX.
+  std::vector<int> kept = {primary};
+  std::string apt = "apt=" + std::to_string(primary);
+  for (const std::string& line : lines) {
+    int pt = PayloadTypeOf(line, "a=fmtp:");
+    if (pt < 0)
+      continue;
+    std::string parameters = line.substr(line.find(' ') + 1);
+    size_t start = 0;
+    while (start <= parameters.size()) {
+      size_t end = std::min(parameters.find(';', start), parameters.size());
+      if (parameters.compare(start, end - start, apt) == 0) {
+        kept.push_back(pt);
+        break;
+      }
+      start = end + 1;
+    }
+  }
+
+  // m=<media> <port> <proto> <fmt> ...
+  size_t formats = m_line.find(' ');
+  for (int i = 0; i < 2 && formats != std::string::npos; ++i)
+    formats = m_line.find(' ', formats + 1);
+  *out += m_line.substr(0, formats);
+  for (int pt : kept)
+    *out += " " + std::to_string(pt);
+  *out += "\r\n";
+
+  for (size_t i = 1; i < lines.size(); ++i) {
+    const std::string& line = lines[i];
+    int pt = PayloadTypeOf(line, "a=rtpmap:");
+    if (pt < 0)
+      pt = PayloadTypeOf(line, "a=fmtp:");
+    if (pt < 0)
+      pt = PayloadTypeOf(line, "a=rtcp-fb:");
+    if (pt >= 0 && std::find(kept.begin(), kept.end(), pt) == kept.end())
+      continue;
+    if (StartsWith(line, "a=extmap:")) {
+      std::string uri = line.substr(line.find(' ') + 1);
+      uri = uri.substr(0, uri.find(' '));
+      if (std::find(std::begin(kKeptExtensions), std::end(kKeptExtensions),
+                    uri) == std::end(kKeptExtensions)) {
+        continue;
+      }
+    }
+    // Plan B leftovers, a=msid says the same.
+    if (StartsWith(line, "a=ssrc:") &&
+        (line.find(" mslabel:") != std::string::npos ||
+         line.find(" label:") != std::string::npos)) {
+      continue;
+    }
+    *out += line + "\r\n";
+  }
+}
+
+}  // namespace
+
+std::string MinimizeTitanSdp(const std::string& sdp,
+                             const TitanSdpProfile& profile) {
+  std::string out;
+  out.reserve(sdp.size());
+  std::vector<std::string> section;
+  size_t pos = 0;
+  while (pos < sdp.size()) {
+    size_t end = sdp.find('\n', pos);
+    if (end == std::string::npos)
+      end = sdp.size();
+    std::string line = sdp.substr(pos, end - pos);
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    pos = end + 1;
+    if (line.empty())
+      continue;
+
+    if (StartsWith(line, "m=")) {
+      if (!section.empty())
+        MinimizeSection(section, profile, &out);
+      section.clear();
+    }
+    if (section.empty() && !StartsWith(line, "m=")) {
+      // Session level.
+      out += line + "\r\n";
+      continue;
+    }
+    section.push_back(line);
+  }
+  if (!section.empty())
+    MinimizeSection(section, profile, &out);
+  return out;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+// What MinimizeTitanSdp() keeps of a session description.
+struct TitanSdpProfile {
+  // The one video codec offered, along with its RTX.
+  std::string video_codec = "VP8";
+  // Likewise for audio; the Titan audio lane is tuned for Opus.
+  std::string audio_codec = "opus";
+};
+
+// Strips a session description down to what a Titan session uses: one codec
+// per media section and its retransmissions, none of RED, ULPFEC or the
+// other codecs, only the header extensions that bundling and the bandwidth
+// estimate need, and no legacy SSRC labels. Data channel sections stay as
+// they are, as do media sections lacking the codec of |profile|.
+//
+// Applied to both offers and answers it only ever removes what the other
+// side would have to parse and ignore.
+std::string MinimizeTitanSdp(const std::string& sdp,
+                             const TitanSdpProfile& profile);
@@ -0,0 +1,546 @@
+#include "pch.h"
+
+#include "TitanSharedRing.h"
+
+#include <string.h>
+#include <utility>
+
+#if defined(WEBRTC_WIN)
+#include <windows.h>
+#elif defined(WEBRTC_POSIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(WEBRTC_LINUX)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+
+namespace {
+
+const uint32_t kRingMagic = 0x5452494e;  // "TRIN"
+const uint32_t kRingVersion = 2;
+const size_t kCacheLine = 64;
+
+// TitanSharedRingHeader::flags
+const uint32_t kFlowControlled = 1;
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+// Lives at the start of the mapping. Other processes map the same bytes, so
+// the atomics have to be lock free to be address free.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Shared ring needs lock free atomics");
+
+struct TitanSharedRingHeader {
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  uint32_t slot_stride;
+  uint32_t slots_offset;
+  uint32_t flags;
+  std::atomic<uint32_t> closed;
+  // Kept on their own cache line, they change with every record.
+  alignas(kCacheLine) std::atomic<uint64_t> write_index;
+  std::atomic<uint32_t> wake_sequence;
+  std::atomic<uint32_t> waiters;
+  // Only used by flow controlled rings, written by the reader.
+  alignas(kCacheLine) std::atomic<uint64_t> read_index;
+  std::atomic<uint32_t> space_sequence;
+  std::atomic<uint32_t> writer_waiting;
+};
+
+struct TitanSharedRingSlot {
+  // 2 * index + 1 while record |index| is written, 2 * index + 2 once done.
+  std::atomic<uint64_t> sequence;
+  uint32_t type;
+  uint32_t size;
+  int32_t width;
+  int32_t height;
+  int64_t timestamp_us;
+
+  uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+namespace {
+
+TitanSharedRingSlot* SlotAt(TitanSharedRingHeader* header, uint64_t index) {
+  uint8_t* base = reinterpret_cast<uint8_t*>(header) + header->slots_offset;
+  return reinterpret_cast<TitanSharedRingSlot*>(
+      base + (index % header->slot_count) * header->slot_stride);
+}
+
+uint64_t RecordSequence(uint64_t index) {
+  return 2 * index + 2;
+}
+
+}  // namespace
+
+// A named shared memory mapping, plus the event used for wakeups on Windows.
+class TitanSharedMemory {
+ public:
+  static std::unique_ptr<TitanSharedMemory> Create(const std::string& name,
+                                                   size_t size);
+  static std::unique_ptr<TitanSharedMemory> Open(const std::string& name);
+  ~TitanSharedMemory();
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+#if defined(WEBRTC_WIN)
+  // Manual reset, signaled when records are written.
+  HANDLE data_event() const { return data_event_; }
+  // Auto reset, signaled when a flow controlled ring gets space.
+  HANDLE space_event() const { return space_event_; }
+#endif
+
+ private:
+  TitanSharedMemory() {}
+
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#if defined(WEBRTC_WIN)
+  HANDLE mapping_ = nullptr;
+  HANDLE data_event_ = nullptr;
+  HANDLE space_event_ = nullptr;
+#elif defined(WEBRTC_POSIX)
+  std::string unlink_name_;
+#endif
+};
+
+#if defined(WEBRTC_WIN)
+
+// static
+std::unique_ptr<TitanSharedMemory> TitanSharedMemory::Create(
+    const std::string& name,
+    size_t size) {
+  std::unique_ptr<TitanSharedMemory> memory(new TitanSharedMemory());
+  std::string mapping_name = "Local\\titan-" + name;
+  memory->mapping_ = ::CreateFileMappingA(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+      static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+      static_cast<DWORD>(size), mapping_name.c_str());
+  if (!memory->mapping_)
+    return nullptr;
+  // Unlike on POSIX the old mapping can't be replaced while readers still
+  // have it open, and reusing it would leave them with stale indices.
+  if (::GetLastError() == ERROR_ALREADY_EXISTS) {
+    RTC_LOG(LS_ERROR) << "Shared ring " << name << " is still in use";
+    return nullptr;
+  }
+  memory->data_ = static_cast<uint8_t*>(
+      ::MapViewOfFile(memory->mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size));
+  memory->data_event_ = ::CreateEventA(nullptr, /*bManualReset=*/TRUE, FALSE,
+                                       (mapping_name + "-event").c_str());
+  memory->space_event_ = ::CreateEventA(nullptr, /*bManualReset=*/FALSE,
+                                        FALSE,
+                                        (mapping_name + "-space").c_str());
+  if (!memory->data_ || !memory->data_event_ || !memory->space_event_)
+    return nullptr;
+  memory->size_ = size;
+  return memory;
+}
+
+// static
+std::unique_ptr<TitanSharedMemory> TitanSharedMemory::Open(
+    const std::string& name) {
+  std::unique_ptr<TitanSharedMemory> memory(new TitanSharedMemory());
+  std::string mapping_name = "Local\\titan-" + name;
+  memory->mapping_ =
+      ::OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mapping_name.c_str());
+  if (!memory->mapping_)
+    return nullptr;
+  memory->data_ = static_cast<uint8_t*>(
+      ::MapViewOfFile(memory->mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+  memory->data_event_ = ::OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE,
+                                     (mapping_name + "-event").c_str());
+  memory->space_event_ = ::OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE,
+                                      (mapping_name + "-space").c_str());
+  if (!memory->data_ || !memory->data_event_ || !memory->space_event_)
+    return nullptr;
+  MEMORY_BASIC_INFORMATION info;
+  if (!::VirtualQuery(memory->data_, &info, sizeof(info)))
+    return nullptr;
+  memory->size_ = info.RegionSize;
+  return memory;
+}
+
+TitanSharedMemory::~TitanSharedMemory() {
+  if (data_)
+    ::UnmapViewOfFile(data_);
+  if (mapping_)
+    ::CloseHandle(mapping_);
+  if (data_event_)
+    ::CloseHandle(data_event_);
+  if (space_event_)
+    ::CloseHandle(space_event_);
+}
+
+#elif defined(WEBRTC_POSIX)
+
+// static
+std::unique_ptr<TitanSharedMemory> TitanSharedMemory::Create(
+    const std::string& name,
+    size_t size) {
+  std::unique_ptr<TitanSharedMemory> memory(new TitanSharedMemory());
+  std::string shm_name = "/titan-" + name;
+  // A ring left behind by a crashed writer would have stale contents.
+  shm_unlink(shm_name.c_str());
+  int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return nullptr;
+  memory->unlink_name_ = shm_name;
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+  memory->data_ = static_cast<uint8_t*>(data);
+  memory->size_ = size;
+  return memory;
+}
+
+// static
+std::unique_ptr<TitanSharedMemory> TitanSharedMemory::Open(
+    const std::string& name) {
+  std::unique_ptr<TitanSharedMemory> memory(new TitanSharedMemory());
+  std::string shm_name = "/titan-" + name;
+  int fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+    return nullptr;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+  memory->data_ = static_cast<uint8_t*>(data);
+  memory->size_ = size;
+  return memory;
+}
+
+TitanSharedMemory::~TitanSharedMemory() {
+  if (data_)
+    munmap(data_, size_);
+  if (!unlink_name_.empty())
+    shm_unlink(unlink_name_.c_str());
+}
+
+#endif
+
+namespace {
+
+#if defined(WEBRTC_WIN)
+typedef HANDLE WakeEvent;
+#else
+typedef void* WakeEvent;
+#endif
+
+// Sleeps until |word| no longer holds |seen|, |event| is signaled or
+// |timeout_ms| have passed, whichever comes first. Spurious returns are fine.
+void WaitOnWord(std::atomic<uint32_t>* word,
+                uint32_t seen,
+                WakeEvent event,
+                int timeout_ms) {
+#if defined(WEBRTC_WIN)
+  ::WaitForSingleObject(event, timeout_ms);
+#elif defined(WEBRTC_LINUX)
+  timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, nullptr, 0);
+#else
+  usleep(1000 * (timeout_ms < 1 ? 1 : timeout_ms > 5 ? 5 : timeout_ms));
+#endif
+}
+
+// Wakes everybody in WaitOnWord() on |word|. The caller changes |word|
+// first.
+void WakeWord(std::atomic<uint32_t>* word, WakeEvent event) {
+#if defined(WEBRTC_WIN)
+  ::SetEvent(event);
+#elif defined(WEBRTC_LINUX)
+  syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+WakeEvent DataEvent(const TitanSharedMemory& memory) {
+#if defined(WEBRTC_WIN)
+  return memory.data_event();
+#else
+  return nullptr;
+#endif
+}
+
+WakeEvent SpaceEvent(const TitanSharedMemory& memory) {
+#if defined(WEBRTC_WIN)
+  return memory.space_event();
+#else
+  return nullptr;
+#endif
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<TitanSharedRingWriter> TitanSharedRingWriter::Create(
+    const std::string& name,
+    uint32_t slot_count,
+    uint32_t slot_size,
+    bool flow_controlled) {
+  RTC_DCHECK_GT(slot_count, 0);
+  size_t slots_offset = AlignUp(sizeof(TitanSharedRingHeader), kCacheLine);
+  size_t slot_stride =
+      AlignUp(sizeof(TitanSharedRingSlot) + slot_size, kCacheLine);
+  std::unique_ptr<TitanSharedMemory> memory = TitanSharedMemory::Create(
+      name, slots_offset + slot_stride * slot_count);
+  if (!memory) {
+    RTC_LOG(LS_ERROR) << "Failed to create shared ring " << name;
+    return nullptr;
+  }
+
+  // Fresh mappings are zero filled, which is a valid state for the atomics.
+  TitanSharedRingHeader* header =
+      reinterpret_cast<TitanSharedRingHeader*>(memory->data());
+  header->version = kRingVersion;
+  header->slot_count = slot_count;
+  header->slot_size = slot_size;
+  header->slot_stride = static_cast<uint32_t>(slot_stride);
+  header->slots_offset = static_cast<uint32_t>(slots_offset);
+  header->flags = flow_controlled ? kFlowControlled : 0;
+  // Readers only look at the rest once they see the magic.
+  header->magic.store(kRingMagic, std::memory_order_release);
+
+  RTC_LOG(INFO) << "Shared ring " << name << " with " << slot_count
+                << " slots of " << slot_size << " bytes"
+                << (flow_controlled ? ", flow controlled" : "");
+  return std::unique_ptr<TitanSharedRingWriter>(
+      new TitanSharedRingWriter(std::move(memory)));
+}
+
+TitanSharedRingWriter::TitanSharedRingWriter(
+    std::unique_ptr<TitanSharedMemory> memory)
+    : memory_(std::move(memory)),
+      header_(reinterpret_cast<TitanSharedRingHeader*>(memory_->data())),
+      pending_slot_(nullptr),
+      pending_size_(0) {}
+
+TitanSharedRingWriter::~TitanSharedRingWriter() {
+  header_->closed.store(1);
+  Wake();
+}
+
+size_t TitanSharedRingWriter::slot_size() const {
+  return header_->slot_size;
+}
+
+bool TitanSharedRingWriter::HasSpace() const {
+  if (!(header_->flags & kFlowControlled))
+    return true;
+  return header_->write_index.load(std::memory_order_relaxed) -
+             header_->read_index.load() <
+         header_->slot_count;
+}
+
+bool TitanSharedRingWriter::WaitForSpace(int timeout_ms) {
+  if (HasSpace())
+    return true;
+  // Same handshake as TitanSharedRingReader::Wait(), with a single waiter.
+  header_->writer_waiting.store(1);
+  uint32_t space_sequence = header_->space_sequence.load();
+  if (!HasSpace()) {
+    WaitOnWord(&header_->space_sequence, space_sequence,
+               SpaceEvent(*memory_), timeout_ms);
+  }
+  header_->writer_waiting.store(0);
+  return HasSpace();
+}
+
+uint8_t* TitanSharedRingWriter::BeginWrite(size_t size) {
+  RTC_DCHECK(!pending_slot_);
+  if (size > header_->slot_size || !HasSpace())
+    return nullptr;
+  // Only this process writes |write_index|.
+  uint64_t index = header_->write_index.load(std::memory_order_relaxed);
+  pending_slot_ = SlotAt(header_, index);
+  pending_size_ = size;
+  pending_slot_->sequence.store(RecordSequence(index) - 1,
+                                std::memory_order_relaxed);
+  // Readers that see any of the new data must also see the odd sequence.
+  std::atomic_thread_fence(std::memory_order_release);
+  return pending_slot_->data();
+}
+
+void TitanSharedRingWriter::Commit(TitanSharedRingRecordType type,
+                                   int width,
+                                   int height,
+                                   int64_t timestamp_us) {
+  RTC_DCHECK(pending_slot_);
+  uint64_t index = header_->write_index.load(std::memory_order_relaxed);
+  pending_slot_->type = type;
+  pending_slot_->size = static_cast<uint32_t>(pending_size_);
+  pending_slot_->width = width;
+  pending_slot_->height = height;
+  pending_slot_->timestamp_us = timestamp_us;
+  pending_slot_->sequence.store(RecordSequence(index),
+                                std::memory_order_release);
+  header_->write_index.store(index + 1);
+  pending_slot_ = nullptr;
+  Wake();
+}
+
+bool TitanSharedRingWriter::Write(TitanSharedRingRecordType type,
+                                  const uint8_t* data,
+                                  size_t size,
+                                  int64_t timestamp_us) {
+  uint8_t* slot = BeginWrite(size);
+  if (!slot)
+    return false;
+  memcpy(slot, data, size);
+  Commit(type, 0, 0, timestamp_us);
+  return true;
+}
+
+void TitanSharedRingWriter::Wake() {
+  header_->wake_sequence.fetch_add(1);
+  // Skip the syscall when nobody sleeps, which is the common case for a busy
+  // reader.
+  if (header_->waiters.load() == 0)
+    return;
+  WakeWord(&header_->wake_sequence, DataEvent(*memory_));
+}
+
+// static
+std::unique_ptr<TitanSharedRingReader> TitanSharedRingReader::Open(
+    const std::string& name) {
+  std::unique_ptr<TitanSharedMemory> memory = TitanSharedMemory::Open(name);
+  if (!memory || memory->size() < sizeof(TitanSharedRingHeader))
+    return nullptr;
+  TitanSharedRingHeader* header =
+      reinterpret_cast<TitanSharedRingHeader*>(memory->data());
+  if (header->magic.load(std::memory_order_acquire) != kRingMagic ||
+      header->version != kRingVersion ||
+      memory->size() < header->slots_offset +
+                           static_cast<size_t>(header->slot_stride) *
+                               header->slot_count) {
+    RTC_LOG(LS_ERROR) << "Shared ring " << name << " is not compatible";
+    return nullptr;
+  }
+  return std::unique_ptr<TitanSharedRingReader>(
+      new TitanSharedRingReader(std::move(memory)));
+}
+
+TitanSharedRingReader::TitanSharedRingReader(
+    std::unique_ptr<TitanSharedMemory> memory)
+    : memory_(std::move(memory)),
+      header_(reinterpret_cast<TitanSharedRingHeader*>(memory_->data())),
+      next_index_(flow_controlled() ? header_->read_index.load()
+                                    : header_->write_index.load()),
+      lost_(0) {}
+
+TitanSharedRingReader::~TitanSharedRingReader() {}
+
+bool TitanSharedRingReader::flow_controlled() const {
+  return (header_->flags & kFlowControlled) != 0;
+}
+
+bool TitanSharedRingReader::closed() const {
+  return header_->closed.load() != 0;
+}
+
+bool TitanSharedRingReader::Available() const {
+  return header_->write_index.load() > next_index_;
+}
+
+bool TitanSharedRingReader::Wait(int timeout_ms) {
+  if (Available())
+    return true;
+
+  // The writer only wakes us if it sees the count, and it bumps the wake
+  // sequence after publishing, so a record written between our check and
+  // the wait makes the wait return right away.
+  header_->waiters.fetch_add(1);
+  uint32_t wake_sequence = header_->wake_sequence.load();
+  if (!Available() && !closed()) {
+    WaitOnWord(&header_->wake_sequence, wake_sequence, DataEvent(*memory_),
+               timeout_ms);
+  }
+#if defined(WEBRTC_WIN)
+  // The last one out rearms the event for the next round of waits.
+  if (header_->waiters.fetch_sub(1) == 1)
+    ::ResetEvent(memory_->data_event());
+#else
+  header_->waiters.fetch_sub(1);
+#endif
+  return Available();
+}
+
+bool TitanSharedRingReader::Read(TitanSharedRingView* view) {
+  for (;;) {
+    uint64_t write_index = header_->write_index.load();
+    if (next_index_ >= write_index)
+      return false;
+    // Everything older than a full ring has been overwritten already.
+    if (write_index - next_index_ > header_->slot_count) {
+      uint64_t oldest = write_index - header_->slot_count;
+      lost_ += oldest - next_index_;
+      next_index_ = oldest;
+    }
+
+    TitanSharedRingSlot* slot = SlotAt(header_, next_index_);
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != RecordSequence(next_index_)) {
+      // The writer has lapped us on this slot since we looked.
+      ++lost_;
+      ++next_index_;
+      continue;
+    }
+
+    view->index = next_index_;
+    view->type = slot->type;
+    view->width = slot->width;
+    view->height = slot->height;
+    view->timestamp_us = slot->timestamp_us;
+    view->data = slot->data();
+    // A torn size is caught by Validate(), but must not point past the slot.
+    view->size = slot->size <= header_->slot_size ? slot->size : 0;
+    ++next_index_;
+    return true;
+  }
+}
+
+bool TitanSharedRingReader::Validate(const TitanSharedRingView& view) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  TitanSharedRingSlot* slot = SlotAt(header_, view.index);
+  return slot->sequence.load(std::memory_order_relaxed) ==
+         RecordSequence(view.index);
+}
+
+void TitanSharedRingReader::Release(const TitanSharedRingView& view) {
+  if (!flow_controlled())
+    return;
+  // Our reads of the slot happen before the writer may reuse it.
+  header_->read_index.store(view.index + 1);
+  header_->space_sequence.fetch_add(1);
+  if (header_->writer_waiting.load() != 0)
+    WakeWord(&header_->space_sequence, SpaceEvent(*memory_));
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Ring of fixed size slots in shared memory, written by one process and read
+// in place by any number of others.
+//
+// Each slot is guarded by a sequence lock. The writer marks the slot odd,
+// fills it, then stores the even value that identifies the record. Readers
+// check the value before and after touching the data and drop the record if
+// the writer lapped them in between. The writer never waits for readers: a
+// reader that falls more than a ring behind loses records, and counts them.
+//
+// A ring created flow controlled is meant for a single reader instead: the
+// reader releases each record once it is done with it, and the writer has to
+// wait for space rather than overwrite unread records. This is how a
+// producer process gets backpressure from a slow consumer.
+//
+// Wakeups use a futex on Linux and a named event on Windows. They are only a
+// hint, both sides always wait with a timeout. Other platforms poll.
+
+enum TitanSharedRingRecordType : uint32_t {
+  // A message received over the Titan transport.
+  kTitanSharedRingPayload = 1,
+  // A decoded frame as tightly packed I420 planes.
+  kTitanSharedRingI420 = 2,
+};
+
+// Describes a record in place. |data| points into shared memory and may be
+// overwritten at any time, see TitanSharedRingReader::Validate().
+struct TitanSharedRingView {
+  uint64_t index = 0;
+  uint32_t type = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  int64_t timestamp_us = 0;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+class TitanSharedMemory;
+struct TitanSharedRingHeader;
+struct TitanSharedRingSlot;
+
+class TitanSharedRingWriter {
+ public:
+  // Creates the ring |name|, replacing an existing one of that name.
+  static std::unique_ptr<TitanSharedRingWriter> Create(
+      const std::string& name,
+      uint32_t slot_count,
+      uint32_t slot_size,
+      bool flow_controlled = false);
+  // Tells readers that no more records will follow.
+  ~TitanSharedRingWriter();
+
+  size_t slot_size() const;
+
+  // Always true unless the ring is flow controlled and the reader hasn't
+  // released the record in the next slot yet.
+  bool HasSpace() const;
+  // Waits up to |timeout_ms| for HasSpace().
+  bool WaitForSpace(int timeout_ms);
+
+  // Returns room for a record of |size| bytes inside the next slot, or null
+  // if it doesn't fit or there is no space. Must be followed by Commit().
+  uint8_t* BeginWrite(size_t size);
+  // Publishes the record started by BeginWrite() and wakes readers.
+  void Commit(TitanSharedRingRecordType type,
+              int width,
+              int height,
+              int64_t timestamp_us);
+
+  // Copies |data| into a new record.
+  bool Write(TitanSharedRingRecordType type,
+             const uint8_t* data,
+             size_t size,
+             int64_t timestamp_us);
+
+ private:
+  explicit TitanSharedRingWriter(std::unique_ptr<TitanSharedMemory> memory);
+
+  void Wake();
+
+  std::unique_ptr<TitanSharedMemory> memory_;
+  TitanSharedRingHeader* header_;
+  TitanSharedRingSlot* pending_slot_;
+  size_t pending_size_;
+};
+
+class TitanSharedRingReader {
+ public:
+  // Opens an existing ring. Reading starts with the next record written, or
+  // with the oldest unreleased one if the ring is flow controlled.
+  static std::unique_ptr<TitanSharedRingReader> Open(const std::string& name);
+  ~TitanSharedRingReader();
+
+  bool flow_controlled() const;
+  // True once the writer has gone away. Records already written can still
+  // be read.
+  bool closed() const;
+
+  // Waits up to |timeout_ms| until there is something to read.
+  bool Wait(int timeout_ms);
+
+  // Points |view| at the next record. Returns false if there is none yet.
+  bool Read(TitanSharedRingView* view);
+
+  // True if the record |view| points at was not overwritten while it was
+  // being used. Call it after reading the data and discard the results if
+  // it returns false.
+  bool Validate(const TitanSharedRingView& view) const;
+
+  // Hands the slot of |view| and everything before it back to the writer of
+  // a flow controlled ring. Does nothing for other rings.
+  void Release(const TitanSharedRingView& view);
+
+  // Records the writer overwrote before they could be read.
+  uint64_t lost() const { return lost_; }
+
+ private:
+  explicit TitanSharedRingReader(std::unique_ptr<TitanSharedMemory> memory);
+
+  bool Available() const;
+
+  std::unique_ptr<TitanSharedMemory> memory_;
+  TitanSharedRingHeader* header_;
+  uint64_t next_index_;
+  uint64_t lost_;
+};
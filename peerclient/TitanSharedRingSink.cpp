@@ -0,0 +1,71 @@
+#include "pch.h"
+
+#include "TitanSharedRingSink.h"
+
+#include <string.h>
+#include <utility>
+
+#include <api/video/i420_buffer.h>
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/timeutils.h>
+
+namespace {
+
+// Copies |height| rows of |width| bytes, dropping the stride padding.
+uint8_t* CopyPlane(const uint8_t* source, int stride, int width, int height,
+                   uint8_t* destination) {
+  for (int row = 0; row < height; ++row) {
+    memcpy(destination, source + row * stride, width);
+    destination += width;
+  }
+  return destination;
+}
+
+}  // namespace
+
+TitanSharedRingSink::TitanSharedRingSink(
+    Mode mode,
+    std::unique_ptr<TitanSharedRingWriter> ring)
+    : mode_(mode), ring_(std::move(ring)) {
+  RTC_DCHECK(ring_);
+}
+
+TitanSharedRingSink::~TitanSharedRingSink() {}
+
+void TitanSharedRingSink::OnTransportMessage(const uint8_t* data,
+                                             size_t size) {
+  if (mode_ != kPayload)
+    return;
+  if (!ring_->Write(kTitanSharedRingPayload, data, size, rtc::TimeMicros())) {
+    RTC_LOG(LS_WARNING) << "Dropping " << size
+                        << " byte message, larger than a shared ring slot";
+  }
+}
+
+void TitanSharedRingSink::OnFrame(const webrtc::VideoFrame& frame) {
+  if (mode_ != kI420)
+    return;
+  rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
+      frame.video_frame_buffer()->ToI420());
+  int width = buffer->width();
+  int height = buffer->height();
+  int chroma_width = buffer->ChromaWidth();
+  int chroma_height = buffer->ChromaHeight();
+  size_t size = static_cast<size_t>(width) * height +
+                2 * static_cast<size_t>(chroma_width) * chroma_height;
+
+  // Written straight into the slot, the frame is only copied once.
+  uint8_t* slot = ring_->BeginWrite(size);
+  if (!slot) {
+    RTC_LOG(LS_WARNING) << "Dropping " << width << "x" << height
+                        << " frame, larger than a shared ring slot";
+    return;
+  }
+  slot = CopyPlane(buffer->DataY(), buffer->StrideY(), width, height, slot);
+  slot = CopyPlane(buffer->DataU(), buffer->StrideU(), chroma_width,
+                   chroma_height, slot);
+  CopyPlane(buffer->DataV(), buffer->StrideV(), chroma_width, chroma_height,
+            slot);
+  ring_->Commit(kTitanSharedRingI420, width, height, frame.timestamp_us());
+}
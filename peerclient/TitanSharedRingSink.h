@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+
+#include "TitanSharedRing.h"
+#include "TitanTransport.h"
+
+// Exports what this peer receives to other processes through a
+// TitanSharedRing. In payload mode it observes the Titan transport and writes
+// one record per message; in I420 mode it is a sink on the remote Titan track
+// and writes every decoded frame as packed planes.
+class TitanSharedRingSink : public TitanTransportObserver,
+                            public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  enum Mode {
+    kPayload,
+    kI420,
+  };
+
+  TitanSharedRingSink(Mode mode, std::unique_ptr<TitanSharedRingWriter> ring);
+  ~TitanSharedRingSink() override;
+
+  Mode mode() const { return mode_; }
+
+  // TitanTransportObserver implementation.
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+
+  // VideoSinkInterface implementation, called on the decoder thread.
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+ private:
+  const Mode mode_;
+  const std::unique_ptr<TitanSharedRingWriter> ring_;
+};
@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "TitanSimulcastTransport.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include <rtc_base/checks.h>
+
+namespace {
+
+// More layers than this don't make sense next to the bandwidth they cost.
+const size_t kMaxLayers = 4;
+
+// Reads a non-negative number followed by |separator|, or by the end of a
+// layer if |separator| is 0.
+bool ParseField(const char** pos, char separator, int* value) {
+  char* end = nullptr;
+  long number = strtol(*pos, &end, 10);
+  if (end == *pos || number < 0 || number > 0xFFFF)
+    return false;
+  if (separator != 0) {
+    if (*end != separator)
+      return false;
+    ++end;
+  } else if (*end != ',' && *end != '\0') {
+    return false;
+  }
+  *value = static_cast<int>(number);
+  *pos = end;
+  return true;
+}
+
+}  // namespace
+
+bool ParseTitanSimulcastLayers(const char* spec,
+                               const TitanFrameLayout& base,
+                               std::vector<TitanSimulcastLayer>* layers) {
+  layers->clear();
+  const char* pos = spec;
+  while (*pos != '\0') {
+    TitanSimulcastLayer layer;
+    layer.layout = base;
+    if (!ParseField(&pos, ':', &layer.layout.block_size) ||
+        !ParseField(&pos, ':', &layer.layout.bits_per_symbol) ||
+        !ParseField(&pos, 0, &layer.fec_group) ||
+        !TitanTrackTransport::Supports(layer.layout, layer.fec_group)) {
+      return false;
+    }
+    layers->push_back(layer);
+    if (*pos == ',')
+      ++pos;
+  }
+  return !layers->empty() && layers->size() <= kMaxLayers;
+}
+
+TitanSimulcastTransport::TitanSimulcastTransport(
+    const std::vector<TitanSimulcastLayer>& layers,
+    size_t max_buffered_bytes)
+    : observer_(nullptr),
+      raw_observer_(nullptr),
+      next_message_id_(0),
+      has_message_id_(false),
+      newest_message_id_(0) {
+  RTC_DCHECK(!layers.empty());
+  for (const TitanSimulcastLayer& layer : layers) {
+    layers_.emplace_back(new TitanTrackTransport(
+        layer.layout, max_buffered_bytes, layer.fec_group));
+    layers_.back()->SetObserver(this);
+    layers_.back()->SetMessageObserver(this);
+  }
+}
+
+TitanSimulcastTransport::~TitanSimulcastTransport() {}
+
+void TitanSimulcastTransport::Suspend() {
+  for (const auto& layer : layers_)
+    layer->Suspend();
+}
+
+void TitanSimulcastTransport::Resume() {
+  for (const auto& layer : layers_)
+    layer->Resume();
+}
+
+bool TitanSimulcastTransport::ready() const {
+  for (const auto& layer : layers_) {
+    if (layer->ready())
+      return true;
+  }
+  return false;
+}
+
+size_t TitanSimulcastTransport::buffered_amount() const {
+  size_t buffered = layers_.front()->buffered_amount();
+  for (const auto& layer : layers_)
+    buffered = std::min(buffered, layer->buffered_amount());
+  return buffered;
+}
+
+void TitanSimulcastTransport::SetObserver(TitanTransportObserver* observer) {
+  observer_.store(observer, std::memory_order_release);
+}
+
+void TitanSimulcastTransport::SetRawObserver(
+    TitanTransportObserver* observer) {
+  raw_observer_.store(observer, std::memory_order_release);
+}
+
+bool TitanSimulcastTransport::Send(const uint8_t* data, size_t size) {
+  rtc::CritScope lock(&send_lock_);
+  // Every layer sends the message under the same id, which is what lets
+  // the receiver recognize the copies.
+  bool accepted = false;
+  for (const auto& layer : layers_)
+    accepted |= layer->SendWithId(next_message_id_, data, size);
+  if (accepted)
+    ++next_message_id_;
+  return accepted;
+}
+
+void TitanSimulcastTransport::OnTransportMessage(const uint8_t* data,
+                                                 size_t size) {
+  rtc::CritScope lock(&receive_lock_);
+  TitanTransportObserver* observer =
+      raw_observer_.load(std::memory_order_acquire);
+  if (!observer)
+    observer = observer_.load(std::memory_order_acquire);
+  if (observer)
+    observer->OnTransportMessage(data, size);
+}
+
+void TitanSimulcastTransport::OnTrackMessage(uint32_t id,
+                                             const uint8_t* data,
+                                             size_t size) {
+  rtc::CritScope lock(&receive_lock_);
+  if (!has_message_id_) {
+    has_message_id_ = true;
+    newest_message_id_ = id;
+  }
+  uint32_t ahead = id - newest_message_id_;
+  if (ahead != 0 && ahead < 0x80000000u) {
+    // The ids sliding out of the window make room for the new ones.
+    if (ahead >= kDuplicateWindow) {
+      delivered_.reset();
+    } else {
+      for (uint32_t i = 1; i <= ahead; ++i)
+        delivered_.reset((newest_message_id_ + i) % kDuplicateWindow);
+    }
+    newest_message_id_ = id;
+  } else if (newest_message_id_ - id >= kDuplicateWindow) {
+    return;
+  }
+
+  size_t bit = id % kDuplicateWindow;
+  if (delivered_.test(bit))
+    return;
+  delivered_.set(bit);
+  TitanTransportObserver* observer = observer_.load(std::memory_order_acquire);
+  if (observer)
+    observer->OnTransportMessage(data, size);
+}
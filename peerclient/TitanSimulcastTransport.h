@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+#include "TitanFrameCodec.h"
+#include "TitanTrackTransport.h"
+#include "TitanTransport.h"
+
+// One layer of a TitanSimulcastTransport.
+struct TitanSimulcastLayer {
+  TitanFrameLayout layout;
+  // Data frames per parity frame, 0 for none.
+  int fec_group = 0;
+};
+
+// Parses a comma separated list of <block_size>:<bits_per_symbol>:<fec_group>
+// triples, e.g. "16:1:2,8:2:0", into layers with the frame size of |base|.
+bool ParseTitanSimulcastLayers(const char* spec,
+                               const TitanFrameLayout& base,
+                               std::vector<TitanSimulcastLayer>* layers);
+
+// Sends every message on several Titan tracks at once, one per layer, each
+// packing the payload at its own density and with its own FEC: from a sparse
+// robust layer for constrained paths to a dense one for good links.
+//
+// The receiver takes each message from whichever layer delivers it first
+// and drops the copies, so it gets the best its path carries without
+// choosing. A receiver, or an SFU on its behalf, may also drop layers
+// altogether; which layers arrive only depends on the tracks the layer sinks
+// are attached to, so switching needs no renegotiation. Messages that only
+// make it through a slower layer arrive out of order.
+class TitanSimulcastTransport : public TitanTransport,
+                                private TitanTransportObserver,
+                                private TitanTrackMessageObserver {
+ public:
+  TitanSimulcastTransport(const std::vector<TitanSimulcastLayer>& layers,
+                          size_t max_buffered_bytes);
+  ~TitanSimulcastTransport() override;
+
+  size_t layer_count() const { return layers_.size(); }
+  // Payload provider of the track sending layer |index|, and sink of the
+  // track receiving it.
+  TitanTrackTransport* layer(size_t index) const {
+    return layers_[index].get();
+  }
+
+  // Suspends and resumes every layer, see TitanTrackTransport::Suspend().
+  void Suspend();
+  void Resume();
+
+  // See TitanTrackTransport::SetRawObserver().
+  void SetRawObserver(TitanTransportObserver* observer);
+
+  // TitanTransport implementation.
+  Mode mode() const override { return kTitanTrack; }
+  const char* name() const override { return "titan-simulcast"; }
+  bool reliable() const override { return false; }
+  bool ready() const override;
+  // What the layer furthest ahead still has to send.
+  size_t buffered_amount() const override;
+  void SetObserver(TitanTransportObserver* observer) override;
+  // Accepted while at least one layer has room, a full layer goes without
+  // the message.
+  bool Send(const uint8_t* data, size_t size) override;
+
+ private:
+  // Ids this far behind the newest one are taken for copies.
+  static const size_t kDuplicateWindow = 1024;
+
+  // Called on the decoder threads of the layers. Raw stream messages have no
+  // id and go through as they are.
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+  void OnTrackMessage(uint32_t id, const uint8_t* data, size_t size) override;
+
+  std::vector<std::unique_ptr<TitanTrackTransport>> layers_;
+  std::atomic<TitanTransportObserver*> observer_;
+  std::atomic<TitanTransportObserver*> raw_observer_;
+
+  rtc::CriticalSection send_lock_;
+  uint32_t next_message_id_ RTC_GUARDED_BY(send_lock_);
+
+  // Also serializes what the layers deliver.
+  rtc::CriticalSection receive_lock_;
+  bool has_message_id_ RTC_GUARDED_BY(receive_lock_);
+  uint32_t newest_message_id_ RTC_GUARDED_BY(receive_lock_);
+  // Indexed by message id modulo the window.
+  std::bitset<kDuplicateWindow> delivered_ RTC_GUARDED_BY(receive_lock_);
+};
@@ -0,0 +1,105 @@
+#include "pch.h"
+
+#include "TitanSinkRegistry.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <rtc_base/checks.h>
+
+// All atomics below use sequentially consistent ordering on purpose: the
+// reader publishing its epoch and then loading |current_| has to be ordered
+// against the writer replacing |current_| and then checking the reader, which
+// acquire/release alone doesn't guarantee.
+
+const uint64_t TitanSinkRegistry::kReaderIdle;
+
+TitanSinkRegistry::ReadScope::ReadScope(TitanSinkRegistry* registry)
+    : registry_(registry) {
+  RTC_DCHECK_EQ(registry_->reader_epoch_.load(), kReaderIdle);
+  registry_->reader_epoch_.store(registry_->epoch_.load());
+  snapshot_ = registry_->current_.load();
+}
+
+TitanSinkRegistry::ReadScope::~ReadScope() {
+  registry_->reader_epoch_.store(kReaderIdle);
+}
+
+TitanSinkRegistry::TitanSinkRegistry()
+    : current_(new Snapshot()),
+      size_(0),
+      epoch_(0),
+      reader_epoch_(kReaderIdle) {}
+
+TitanSinkRegistry::~TitanSinkRegistry() {
+  RTC_DCHECK_EQ(reader_epoch_.load(), kReaderIdle);
+  rtc::CritScope lock(&write_lock_);
+  for (const auto& retired : retired_)
+    delete retired.first;
+  delete current_.load();
+}
+
+void TitanSinkRegistry::AddOrUpdateSink(Sink* sink,
+                                        const rtc::VideoSinkWants& wants) {
+  RTC_DCHECK(sink);
+  rtc::CritScope lock(&write_lock_);
+  Snapshot* snapshot = new Snapshot(*current_.load());
+  auto it = std::find_if(snapshot->begin(), snapshot->end(),
+                         [sink](const Entry& entry) {
+                           return entry.sink == sink;
+                         });
+  if (it != snapshot->end()) {
+    it->wants = wants;
+  } else {
+    snapshot->push_back({sink, wants});
+  }
+  Publish(snapshot);
+}
+
+void TitanSinkRegistry::RemoveSink(Sink* sink) {
+  rtc::CritScope lock(&write_lock_);
+  Snapshot* snapshot = new Snapshot(*current_.load());
+  snapshot->erase(std::remove_if(snapshot->begin(), snapshot->end(),
+                                 [sink](const Entry& entry) {
+                                   return entry.sink == sink;
+                                 }),
+                  snapshot->end());
+  Publish(snapshot);
+
+  // The caller may destroy |sink| right after this, so wait out a frame that
+  // is still being delivered from an older snapshot. That takes at most one
+  // delivery, and the frame thread never waits for us.
+  uint64_t epoch = epoch_.load();
+  while (!IsQuiescent(epoch))
+    std::this_thread::yield();
+  Reclaim();
+}
+
+bool TitanSinkRegistry::empty() const {
+  return size_.load() == 0;
+}
+
+void TitanSinkRegistry::Publish(Snapshot* snapshot) {
+  size_.store(snapshot->size());
+  const Snapshot* previous = current_.exchange(snapshot);
+  uint64_t epoch = epoch_.fetch_add(1) + 1;
+  retired_.push_back(std::make_pair(previous, epoch));
+  Reclaim();
+}
+
+bool TitanSinkRegistry::IsQuiescent(uint64_t epoch) const {
+  uint64_t reader_epoch = reader_epoch_.load();
+  return reader_epoch == kReaderIdle || reader_epoch >= epoch;
+}
+
+void TitanSinkRegistry::Reclaim() {
+  auto it = std::remove_if(
+      retired_.begin(), retired_.end(),
+      [this](const std::pair<const Snapshot*, uint64_t>& retired) {
+        if (!IsQuiescent(retired.second))
+          return false;
+        delete retired.first;
+        return true;
+      });
+  retired_.erase(it, retired_.end());
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <media/base/videosourceinterface.h>
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+// Sink list shared between the threads that add and remove sinks and the one
+// frame thread that delivers to them. Every change publishes a new immutable
+// snapshot, so the frame thread walks the list without taking a lock and
+// changes never wait for a frame to be delivered, except for RemoveSink, see
+// below.
+//
+// Retired snapshots are freed once the frame thread has been seen outside
+// of a ReadScope, or inside one that started after the snapshot was
+// replaced (quiescent state based reclamation with a single reader).
+class TitanSinkRegistry {
+ public:
+  typedef rtc::VideoSinkInterface<webrtc::VideoFrame> Sink;
+
+  struct Entry {
+    Sink* sink;
+    rtc::VideoSinkWants wants;
+  };
+  typedef std::vector<Entry> Snapshot;
+
+  // Pins the current snapshot for the duration of the scope. Only the frame
+  // thread may open one, and scopes must not nest.
+  class ReadScope {
+   public:
+    explicit ReadScope(TitanSinkRegistry* registry);
+    ~ReadScope();
+
+    const Snapshot& sinks() const { return *snapshot_; }
+
+   private:
+    TitanSinkRegistry* const registry_;
+    const Snapshot* snapshot_;
+  };
+
+  TitanSinkRegistry();
+  // The frame thread must have stopped by now.
+  ~TitanSinkRegistry();
+
+  void AddOrUpdateSink(Sink* sink, const rtc::VideoSinkWants& wants);
+
+  // Once this returns the frame thread is done with |sink|: it waits for a
+  // frame being delivered from an older snapshot. Sinks must therefore not
+  // block on the caller's thread from OnFrame.
+  void RemoveSink(Sink* sink);
+
+  // Lock free, for a quick check from any thread.
+  bool empty() const;
+
+ private:
+  // |reader_epoch_| while the frame thread is outside of a ReadScope.
+  static const uint64_t kReaderIdle = ~0ull;
+
+  void Publish(Snapshot* snapshot) RTC_EXCLUSIVE_LOCKS_REQUIRED(write_lock_);
+  bool IsQuiescent(uint64_t epoch) const;
+  void Reclaim() RTC_EXCLUSIVE_LOCKS_REQUIRED(write_lock_);
+
+  std::atomic<const Snapshot*> current_;
+  // Size of |current_|, readable without pinning it.
+  std::atomic<size_t> size_;
+  std::atomic<uint64_t> epoch_;
+  std::atomic<uint64_t> reader_epoch_;
+
+  rtc::CriticalSection write_lock_;
+  // Replaced snapshots with the epoch that must be reached to free them.
+  std::vector<std::pair<const Snapshot*, uint64_t>> retired_
+      RTC_GUARDED_BY(write_lock_);
+};
@@ -0,0 +1,300 @@
+#include "pch.h"
+
+#include "TitanStatsCollector.h"
+
+#include <fstream>
+
+#include <api/stats/rtcstats_objects.h>
+#include <api/stats/rtcstatsreport.h>
+#include <api/statstypes.h>
+#include <rtc_base/checks.h>
+#include <rtc_base/json.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/refcountedobject.h>
+#include <rtc_base/timeutils.h>
+
+namespace {
+
+enum {
+  MSG_COLLECT_STATS,
+};
+
+const char kVideoMediaType[] = "video";
+
+}  // namespace
+
+// Forwards the RTCStats report to the collector. The collector may be gone by
+// the time the report arrives, so it detaches itself on Stop().
+class TitanStatsCollector::RtcStatsCallback
+    : public webrtc::RTCStatsCollectorCallback {
+ public:
+  explicit RtcStatsCallback(TitanStatsCollector* collector)
+      : collector_(collector) {}
+
+  void Detach() { collector_ = nullptr; }
+
+  void OnStatsDelivered(
+      const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) override {
+    if (collector_)
+      collector_->OnRtcStats(report);
+  }
+
+ private:
+  TitanStatsCollector* collector_;
+};
+
+class TitanStatsCollector::LegacyStatsObserver : public webrtc::StatsObserver {
+ public:
+  explicit LegacyStatsObserver(TitanStatsCollector* collector)
+      : collector_(collector) {}
+
+  void Detach() { collector_ = nullptr; }
+
+  void OnComplete(const webrtc::StatsReports& reports) override {
+    if (collector_)
+      collector_->OnLegacyStats(reports);
+  }
+
+ private:
+  TitanStatsCollector* collector_;
+};
+
+TitanStatsCollector::TitanStatsCollector(rtc::Thread* signaling_thread,
+                                         int interval_ms,
+                                         size_t capacity,
+                                         const std::string& dump_path)
+    : signaling_thread_(signaling_thread),
+      interval_ms_(interval_ms),
+      capacity_(capacity),
+      dump_path_(dump_path) {
+  RTC_DCHECK(signaling_thread_);
+  RTC_DCHECK_GT(interval_ms_, 0);
+  RTC_DCHECK_GT(capacity_, 0);
+}
+
+TitanStatsCollector::~TitanStatsCollector() {
+  Stop();
+}
+
+void TitanStatsCollector::Start(
+    webrtc::PeerConnectionInterface* peer_connection,
+    TitanTrackSource* source) {
+  RTC_DCHECK(signaling_thread_->IsCurrent());
+  Stop();
+  peer_connection_ = peer_connection;
+  source_ = source;
+  last_timestamp_us_ = 0;
+  signaling_thread_->PostDelayed(RTC_FROM_HERE, interval_ms_, this,
+                                 MSG_COLLECT_STATS);
+}
+
+void TitanStatsCollector::Stop() {
+  signaling_thread_->Clear(this);
+  if (pending_rtc_) {
+    pending_rtc_->Detach();
+    pending_rtc_ = nullptr;
+  }
+  if (pending_legacy_) {
+    pending_legacy_->Detach();
+    pending_legacy_ = nullptr;
+  }
+  if (peer_connection_ && !dump_path_.empty())
+    DumpJson();
+  peer_connection_ = nullptr;
+  source_ = nullptr;
+}
+
+void TitanStatsCollector::OnMessage(rtc::Message* msg) {
+  RTC_DCHECK_EQ(msg->message_id, MSG_COLLECT_STATS);
+  if (!peer_connection_)
+    return;
+
+  // Don't pile up requests if the previous report is still being assembled.
+  if (!pending_legacy_) {
+    pending_legacy_ = new rtc::RefCountedObject<LegacyStatsObserver>(this);
+    peer_connection_->GetStats(
+        pending_legacy_, nullptr,
+        webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
+  }
+  if (!pending_rtc_) {
+    pending_rtc_ = new rtc::RefCountedObject<RtcStatsCallback>(this);
+    peer_connection_->GetStats(pending_rtc_.get());
+  }
+
+  signaling_thread_->PostDelayed(RTC_FROM_HERE, interval_ms_, this,
+                                 MSG_COLLECT_STATS);
+}
+
+void TitanStatsCollector::OnLegacyStats(const webrtc::StatsReports& reports) {
+  pending_legacy_ = nullptr;
+  for (const webrtc::StatsReport* report : reports) {
+    if (report->type() != webrtc::StatsReport::kStatsReportTypeSsrc)
+      continue;
+    const webrtc::StatsReport::Value* value =
+        report->FindValue(webrtc::StatsReport::kStatsValueNameAvgEncodeMs);
+    if (value)
+      encode_ms_ = value->int_val();
+    value = report->FindValue(webrtc::StatsReport::kStatsValueNameDecodeMs);
+    if (value)
+      decode_ms_ = value->int_val();
+  }
+}
+
+void TitanStatsCollector::OnRtcStats(
+    const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+  pending_rtc_ = nullptr;
+
+  TitanStatsSample sample;
+  sample.timestamp_us = report->timestamp_us();
+  sample.encode_ms = encode_ms_;
+  sample.decode_ms = decode_ms_;
+  if (source_)
+    sample.source = source_->GetTitanStats();
+
+  for (const auto* pair :
+       report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+    if (pair->nominated.is_defined() && *pair->nominated &&
+        pair->current_round_trip_time.is_defined()) {
+      sample.rtt_ms = *pair->current_round_trip_time * 1000.0;
+    }
+  }
+
+  uint64_t bytes_sent = 0;
+  uint32_t frames_encoded = 0;
+  uint64_t qp_sum_sent = 0;
+  for (const auto* outbound :
+       report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+    if (outbound->bytes_sent.is_defined())
+      bytes_sent += *outbound->bytes_sent;
+    if (!outbound->media_type.is_defined() ||
+        *outbound->media_type != kVideoMediaType) {
+      continue;
+    }
+    if (outbound->frames_encoded.is_defined())
+      frames_encoded += *outbound->frames_encoded;
+    if (outbound->qp_sum.is_defined())
+      qp_sum_sent += *outbound->qp_sum;
+  }
+
+  uint64_t bytes_received = 0;
+  uint32_t frames_decoded = 0;
+  uint64_t qp_sum_received = 0;
+  uint32_t packets_received = 0;
+  int32_t packets_lost = 0;
+  for (const auto* inbound :
+       report->GetStatsOfType<webrtc::RTCInboundRTPStreamStats>()) {
+    if (inbound->bytes_received.is_defined())
+      bytes_received += *inbound->bytes_received;
+    if (inbound->packets_received.is_defined())
+      packets_received += *inbound->packets_received;
+    if (inbound->packets_lost.is_defined())
+      packets_lost += *inbound->packets_lost;
+    if (!inbound->media_type.is_defined() ||
+        *inbound->media_type != kVideoMediaType) {
+      continue;
+    }
+    if (inbound->jitter.is_defined())
+      sample.jitter_ms = *inbound->jitter * 1000.0;
+    if (inbound->frames_decoded.is_defined())
+      frames_decoded += *inbound->frames_decoded;
+    if (inbound->qp_sum.is_defined())
+      qp_sum_received += *inbound->qp_sum;
+  }
+  sample.packets_lost = packets_lost;
+
+  if (last_timestamp_us_ != 0 && sample.timestamp_us > last_timestamp_us_) {
+    double seconds =
+        static_cast<double>(sample.timestamp_us - last_timestamp_us_) /
+        rtc::kNumMicrosecsPerSec;
+    sample.send_bps = (bytes_sent - last_bytes_sent_) * 8 / seconds;
+    sample.receive_bps = (bytes_received - last_bytes_received_) * 8 / seconds;
+
+    uint32_t encoded = frames_encoded - last_frames_encoded_;
+    uint32_t decoded = frames_decoded - last_frames_decoded_;
+    sample.send_fps = encoded / seconds;
+    sample.receive_fps = decoded / seconds;
+    if (encoded > 0)
+      sample.encode_qp =
+          static_cast<double>(qp_sum_sent - last_qp_sum_sent_) / encoded;
+    if (decoded > 0)
+      sample.decode_qp =
+          static_cast<double>(qp_sum_received - last_qp_sum_received_) /
+          decoded;
+
+    int64_t received = packets_received - last_packets_received_;
+    int64_t lost = packets_lost - last_packets_lost_;
+    if (received + lost > 0)
+      sample.loss_fraction = static_cast<double>(lost) / (received + lost);
+  }
+
+  last_timestamp_us_ = sample.timestamp_us;
+  last_bytes_sent_ = bytes_sent;
+  last_bytes_received_ = bytes_received;
+  last_frames_encoded_ = frames_encoded;
+  last_frames_decoded_ = frames_decoded;
+  last_qp_sum_sent_ = qp_sum_sent;
+  last_qp_sum_received_ = qp_sum_received;
+  last_packets_received_ = packets_received;
+  last_packets_lost_ = packets_lost;
+
+  if (samples_.size() == capacity_)
+    samples_.pop_front();
+  samples_.push_back(sample);
+}
+
+std::string TitanStatsCollector::ToJson() const {
+  Json::Value jsamples(Json::arrayValue);
+  for (const TitanStatsSample& sample : samples_) {
+    Json::Value jsample;
+    jsample["timestamp_us"] = static_cast<double>(sample.timestamp_us);
+    jsample["send_bps"] = sample.send_bps;
+    jsample["receive_bps"] = sample.receive_bps;
+    jsample["send_fps"] = sample.send_fps;
+    jsample["receive_fps"] = sample.receive_fps;
+    jsample["rtt_ms"] = sample.rtt_ms;
+    jsample["jitter_ms"] = sample.jitter_ms;
+    jsample["packets_lost"] = static_cast<double>(sample.packets_lost);
+    jsample["loss_fraction"] = sample.loss_fraction;
+    jsample["encode_ms"] = sample.encode_ms;
+    jsample["decode_ms"] = sample.decode_ms;
+    jsample["encode_qp"] = sample.encode_qp;
+    jsample["decode_qp"] = sample.decode_qp;
+
+    Json::Value jsource;
+    jsource["input_width"] = sample.source.input_width;
+    jsource["input_height"] = sample.source.input_height;
+    jsource["produced_fps"] = sample.source.produced_fps;
+    jsource["frames_produced"] =
+        static_cast<double>(sample.source.frames_produced);
+    jsource["payload_bytes"] = static_cast<double>(sample.source.payload_bytes);
+    jsource["frames_dropped"] =
+        static_cast<double>(sample.source.frames_dropped);
+    jsource["encoder_pending"] =
+        static_cast<double>(sample.source.encoder_pending);
+    jsource["frames_superseded"] =
+        static_cast<double>(sample.source.frames_superseded);
+    jsource["frames_deferred"] =
+        static_cast<double>(sample.source.frames_deferred);
+    jsource["frames_overflowed"] =
+        static_cast<double>(sample.source.frames_overflowed);
+    jsample["source"] = jsource;
+
+    jsamples.append(jsample);
+  }
+
+  Json::Value jroot;
+  jroot["interval_ms"] = interval_ms_;
+  jroot["samples"] = jsamples;
+  Json::StyledWriter writer;
+  return writer.write(jroot);
+}
+
+bool TitanStatsCollector::DumpJson() const {
+  std::ofstream file(dump_path_, std::ios::out | std::ios::trunc);
+  if (!file) {
+    RTC_LOG(LS_ERROR) << "Failed to open stats dump " << dump_path_;
+    return false;
+  }
+  file << ToJson();
+  return file.good();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <deque>
+#include <string>
+
+#include <api/peerconnectioninterface.h>
+#include <api/stats/rtcstatscollectorcallback.h>
+#include <rtc_base/messagehandler.h>
+#include <rtc_base/thread.h>
+
+#include "TitanMediaSourceInterface.h"
+
+// One sample of the transport as seen through RTCStats, plus the counters of
+// the local Titan source at the same moment.
+struct TitanStatsSample {
+  int64_t timestamp_us = 0;
+
+  // Derived from the difference to the previous sample.
+  double send_bps = 0.0;
+  double receive_bps = 0.0;
+  double send_fps = 0.0;
+  double receive_fps = 0.0;
+
+  double rtt_ms = 0.0;
+  double jitter_ms = 0.0;
+  int64_t packets_lost = 0;
+  double loss_fraction = 0.0;
+
+  double encode_ms = 0.0;
+  double decode_ms = 0.0;
+  double encode_qp = 0.0;
+  double decode_qp = 0.0;
+
+  TitanSourceStats source;
+};
+
+// Periodically samples PeerConnection::GetStats on the signaling thread and
+// keeps the derived samples in a fixed size ring buffer. The buffer can be
+// dumped as JSON so the numbers can be inspected without a debugger; with a
+// dump path that happens on Stop(), keeping file I/O off the sampling path.
+class TitanStatsCollector : public rtc::MessageHandler {
+ public:
+  TitanStatsCollector(rtc::Thread* signaling_thread,
+                      int interval_ms,
+                      size_t capacity,
+                      const std::string& dump_path);
+  ~TitanStatsCollector();
+
+  void Start(webrtc::PeerConnectionInterface* peer_connection,
+             TitanTrackSource* source);
+  void Stop();
+
+  const std::deque<TitanStatsSample>& samples() const { return samples_; }
+
+  std::string ToJson() const;
+  bool DumpJson() const;
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  class RtcStatsCallback;
+  class LegacyStatsObserver;
+
+  void OnRtcStats(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report);
+  void OnLegacyStats(const webrtc::StatsReports& reports);
+
+  rtc::Thread* const signaling_thread_;
+  const int interval_ms_;
+  const size_t capacity_;
+  const std::string dump_path_;
+
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
+  rtc::scoped_refptr<TitanTrackSource> source_;
+  rtc::scoped_refptr<RtcStatsCallback> pending_rtc_;
+  rtc::scoped_refptr<LegacyStatsObserver> pending_legacy_;
+
+  std::deque<TitanStatsSample> samples_;
+
+  // Running totals from the previous report, used to derive rates.
+  int64_t last_timestamp_us_ = 0;
+  uint64_t last_bytes_sent_ = 0;
+  uint64_t last_bytes_received_ = 0;
+  uint32_t last_frames_encoded_ = 0;
+  uint32_t last_frames_decoded_ = 0;
+  uint64_t last_qp_sum_sent_ = 0;
+  uint64_t last_qp_sum_received_ = 0;
+  uint32_t last_packets_received_ = 0;
+  int32_t last_packets_lost_ = 0;
+
+  // Encode and decode times are only reported by the legacy stats.
+  double encode_ms_ = 0.0;
+  double decode_ms_ = 0.0;
+};
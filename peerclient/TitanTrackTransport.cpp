@@ -0,0 +1,352 @@
+#include "pch.h"
+
+#include "TitanTrackTransport.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/timeutils.h>
+
+#include "TitanMetrics.h"
+
+namespace {
+
+// Every chunk starts with: message id (4), chunk length (4), flags (1).
+const size_t kChunkHeaderSize = 9;
+
+enum ChunkFlags : uint8_t {
+  kChunkBegin = 1 << 0,
+  kChunkEnd = 1 << 1,
+  // The message went out before, see TitanTrackTransport::Resume().
+  kChunkResent = 1 << 2,
+};
+
+// How long a path may be gone before ICE reports it disconnected. Messages
+// sent within this time before Suspend() are sent again.
+const int64_t kResendWindowUs = 5 * rtc::kNumMicrosecsPerSec;
+
+void WriteUint32(uint8_t* data, uint32_t value) {
+  data[0] = static_cast<uint8_t>(value >> 24);
+  data[1] = static_cast<uint8_t>(value >> 16);
+  data[2] = static_cast<uint8_t>(value >> 8);
+  data[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t ReadUint32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+}  // namespace
+
+TitanTrackTransport::TitanTrackTransport(const TitanFrameLayout& layout,
+                                         size_t max_buffered_bytes,
+                                         int fec_group)
+    : layout_(layout),
+      max_buffered_bytes_(max_buffered_bytes),
+      observer_(nullptr),
+      message_observer_(nullptr),
+      raw_observer_(nullptr),
+      frames_pulled_(false),
+      buffered_bytes_(0),
+      next_message_id_(0),
+      suspended_(false),
+      suspended_us_(0),
+      history_bytes_(0),
+      fec_encoder_(fec_group),
+      parity_frame_(false),
+      fec_decoder_(this),
+      reassembling_(false),
+      reassembly_id_(0),
+      reassembly_resent_(false),
+      has_delivered_id_(false),
+      last_delivered_id_(0),
+      has_raw_sequence_(false),
+      next_raw_sequence_(0) {
+  RTC_DCHECK(Supports(layout_, fec_group));
+}
+
+// static
+bool TitanTrackTransport::Supports(const TitanFrameLayout& layout,
+                                   int fec_group) {
+  if (!layout.IsValid() || fec_group < 0 || fec_group > kTitanMaxFecGroup)
+    return false;
+  size_t overhead = fec_group > 0 ? kTitanParityHeaderSize : 0;
+  return layout.payload_capacity() > overhead + kChunkHeaderSize;
+}
+
+TitanTrackTransport::~TitanTrackTransport() {}
+
+bool TitanTrackTransport::ready() const {
+  return frames_pulled_.load(std::memory_order_relaxed);
+}
+
+size_t TitanTrackTransport::buffered_amount() const {
+  rtc::CritScope lock(&send_lock_);
+  return buffered_bytes_;
+}
+
+void TitanTrackTransport::SetObserver(TitanTransportObserver* observer) {
+  observer_.store(observer, std::memory_order_release);
+}
+
+void TitanTrackTransport::SetMessageObserver(
+    TitanTrackMessageObserver* observer) {
+  message_observer_.store(observer, std::memory_order_release);
+}
+
+void TitanTrackTransport::SetRawObserver(TitanTransportObserver* observer) {
+  raw_observer_.store(observer, std::memory_order_release);
+}
+
+bool TitanTrackTransport::Send(const uint8_t* data, size_t size) {
+  rtc::CritScope lock(&send_lock_);
+  if (!Enqueue(next_message_id_, data, size))
+    return false;
+  ++next_message_id_;
+  return true;
+}
+
+bool TitanTrackTransport::SendWithId(uint32_t id,
+                                     const uint8_t* data,
+                                     size_t size) {
+  rtc::CritScope lock(&send_lock_);
+  return Enqueue(id, data, size);
+}
+
+bool TitanTrackTransport::Enqueue(uint32_t id,
+                                  const uint8_t* data,
+                                  size_t size) {
+  if (size == 0 || buffered_bytes_ + size > max_buffered_bytes_)
+    return false;
+  OutgoingMessage message;
+  message.id = id;
+  message.data.assign(data, data + size);
+  message.offset = 0;
+  message.resent = false;
+  message.sent_us = 0;
+  send_queue_.push_back(std::move(message));
+  buffered_bytes_ += size;
+  return true;
+}
+
+void TitanTrackTransport::Suspend() {
+  rtc::CritScope lock(&send_lock_);
+  if (suspended_)
+    return;
+  suspended_ = true;
+  suspended_us_ = rtc::TimeMicros();
+}
+
+void TitanTrackTransport::Resume() {
+  rtc::CritScope lock(&send_lock_);
+  if (!suspended_)
+    return;
+  suspended_ = false;
+  // The chunks of a message that was cut short went nowhere either.
+  if (!send_queue_.empty() && send_queue_.front().offset != 0) {
+    buffered_bytes_ += send_queue_.front().offset;
+    send_queue_.front().offset = 0;
+    send_queue_.front().resent = true;
+  }
+  // Newest first, for as much as fits the buffer; whatever is older than
+  // that is the least useful by now and is given up on.
+  size_t resent = 0;
+  while (!sent_history_.empty() &&
+         buffered_bytes_ + sent_history_.back().data.size() <=
+             max_buffered_bytes_) {
+    OutgoingMessage& message = sent_history_.back();
+    message.offset = 0;
+    message.resent = true;
+    buffered_bytes_ += message.data.size();
+    send_queue_.push_front(std::move(message));
+    sent_history_.pop_back();
+    ++resent;
+  }
+  sent_history_.clear();
+  history_bytes_ = 0;
+  TitanMetrics::Get().messages_resent.fetch_add(resent,
+                                                std::memory_order_relaxed);
+}
+
+size_t TitanTrackTransport::FillPayload(uint8_t* data, size_t capacity) {
+  frames_pulled_.store(true, std::memory_order_relaxed);
+
+  parity_frame_ = fec_encoder_.parity_due();
+  if (parity_frame_)
+    return fec_encoder_.TakeParity(data, capacity);
+  capacity -= fec_encoder_.overhead();
+
+  size_t written = 0;
+  int64_t now_us = rtc::TimeMicros();
+  rtc::CritScope lock(&send_lock_);
+  // While suspended the window stays where it was at Suspend(), however
+  // long the path is down.
+  int64_t window_end_us = suspended_ ? suspended_us_ : now_us;
+  while (!sent_history_.empty() &&
+         (sent_history_.front().sent_us < window_end_us - kResendWindowUs ||
+          history_bytes_ > max_buffered_bytes_)) {
+    history_bytes_ -= sent_history_.front().data.size();
+    sent_history_.pop_front();
+  }
+  // Frames keep going out while suspended, empty, so that the FEC groups
+  // stay in step with the sequence numbers.
+  while (!suspended_ && !send_queue_.empty() &&
+         capacity - written > kChunkHeaderSize) {
+    OutgoingMessage& message = send_queue_.front();
+    size_t remaining = message.data.size() - message.offset;
+    size_t length = std::min(remaining, capacity - written - kChunkHeaderSize);
+
+    uint8_t flags = 0;
+    if (message.offset == 0)
+      flags |= kChunkBegin;
+    if (length == remaining)
+      flags |= kChunkEnd;
+    if (message.resent)
+      flags |= kChunkResent;
+
+    uint8_t* chunk = data + written;
+    WriteUint32(chunk, message.id);
+    WriteUint32(chunk + 4, static_cast<uint32_t>(length));
+    chunk[8] = flags;
+    memcpy(chunk + kChunkHeaderSize, message.data.data() + message.offset,
+           length);
+    written += kChunkHeaderSize + length;
+
+    message.offset += length;
+    buffered_bytes_ -= length;
+    if (message.offset == message.data.size()) {
+      message.sent_us = now_us;
+      history_bytes_ += message.data.size();
+      sent_history_.push_back(std::move(message));
+      send_queue_.pop_front();
+    }
+  }
+  fec_encoder_.AddFrame(data, written);
+  return written;
+}
+
+uint8_t TitanTrackTransport::stream_id() const {
+  return parity_frame_ ? kTitanParityStream : kTitanMessageStream;
+}
+
+void TitanTrackTransport::OnFrame(const webrtc::VideoFrame& frame) {
+  rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
+      frame.video_frame_buffer()->ToI420());
+  rtc::CritScope lock(&receive_lock_);
+  if (!UnpackTitanFrame(layout_, *buffer, &frame_header_, &frame_payload_))
+    return;
+  switch (frame_header_.stream_id) {
+    case kTitanMessageStream:
+      fec_decoder_.OnDataFrame(frame_header_.sequence, frame_payload_.data(),
+                               frame_payload_.size());
+      break;
+    case kTitanParityStream:
+      fec_decoder_.OnParityFrame(frame_header_.sequence,
+                                 frame_payload_.data(),
+                                 frame_payload_.size());
+      break;
+    case kTitanRawStream: {
+      // Nothing to reassemble, every frame is a message of its own. Frames
+      // the track dropped are gone for good, but at least counted.
+      uint32_t missing = frame_header_.sequence - next_raw_sequence_;
+      if (has_raw_sequence_ && missing != 0 && missing < 0x80000000u) {
+        RTC_LOG(LS_WARNING) << "Lost " << missing << " raw frames before "
+                            << frame_header_.sequence;
+        TitanMetrics::Get().raw_frames_lost.fetch_add(
+            missing, std::memory_order_relaxed);
+      }
+      has_raw_sequence_ = true;
+      next_raw_sequence_ = frame_header_.sequence + 1;
+      TitanTransportObserver* observer =
+          raw_observer_.load(std::memory_order_acquire);
+      if (!observer)
+        observer = observer_.load(std::memory_order_acquire);
+      if (observer && !frame_payload_.empty()) {
+        observer->OnTransportMessage(frame_payload_.data(),
+                                     frame_payload_.size());
+      }
+      break;
+    }
+  }
+}
+
+void TitanTrackTransport::OnFecFrame(const uint8_t* data,
+                                     size_t size,
+                                     bool lost_before) {
+  if (lost_before)
+    ResetReassembly();  // Maybe mid message.
+
+  size_t pos = 0;
+  while (size - pos >= kChunkHeaderSize) {
+    const uint8_t* chunk = data + pos;
+    uint32_t id = ReadUint32(chunk);
+    uint32_t length = ReadUint32(chunk + 4);
+    uint8_t flags = chunk[8];
+    if (length > size - pos - kChunkHeaderSize) {
+      RTC_LOG(LS_WARNING) << "Truncated Titan chunk";
+      ResetReassembly();
+      return;
+    }
+    const uint8_t* body = chunk + kChunkHeaderSize;
+    pos += kChunkHeaderSize + length;
+
+    if (flags & kChunkBegin) {
+      reassembly_.clear();
+      reassembly_id_ = id;
+      reassembly_resent_ = (flags & kChunkResent) != 0;
+      reassembling_ = true;
+    } else if (!reassembling_ || id != reassembly_id_) {
+      // We never saw the start of this message.
+      continue;
+    }
+
+    if ((flags & kChunkBegin) && (flags & kChunkEnd)) {
+      // Whole message in one chunk, no need to copy it.
+      reassembling_ = false;
+      TitanMetrics::Get().payload_bytes_received.fetch_add(
+          length, std::memory_order_relaxed);
+      Deliver(id, body, length, (flags & kChunkResent) != 0);
+      continue;
+    }
+
+    reassembly_.insert(reassembly_.end(), body, body + length);
+    if (flags & kChunkEnd) {
+      reassembling_ = false;
+      TitanMetrics::Get().payload_bytes_received.fetch_add(
+          reassembly_.size(), std::memory_order_relaxed);
+      Deliver(id, reassembly_.data(), reassembly_.size(), reassembly_resent_);
+    }
+  }
+}
+
+void TitanTrackTransport::Deliver(uint32_t id,
+                                  const uint8_t* data,
+                                  size_t size,
+                                  bool resent) {
+  // Ids only go backwards for a resent message that made it the first time,
+  // or for a sender that started over, whose messages aren't resent ones.
+  if (resent && has_delivered_id_ &&
+      static_cast<int32_t>(id - last_delivered_id_) <= 0) {
+    return;
+  }
+  has_delivered_id_ = true;
+  last_delivered_id_ = id;
+  TitanTrackMessageObserver* message_observer =
+      message_observer_.load(std::memory_order_acquire);
+  if (message_observer) {
+    message_observer->OnTrackMessage(id, data, size);
+    return;
+  }
+  TitanTransportObserver* observer = observer_.load(std::memory_order_acquire);
+  if (observer)
+    observer->OnTransportMessage(data, size);
+}
+
+void TitanTrackTransport::ResetReassembly() {
+  reassembling_ = false;
+  reassembly_.clear();
+}
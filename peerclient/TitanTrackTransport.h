@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/thread_annotations.h>
+
+#include "TitanFec.h"
+#include "TitanFrameCodec.h"
+#include "TitanMediaSourceInterface.h"
+#include "TitanTransport.h"
+
+// Receives messages along with the id their sender gave them, for whoever
+// combines several transports carrying the same messages.
+class TitanTrackMessageObserver {
+ public:
+  virtual void OnTrackMessage(uint32_t id, const uint8_t* data,
+                              size_t size) = 0;
+
+ protected:
+  virtual ~TitanTrackMessageObserver() {}
+};
+
+// Carries messages in the pixels of the Titan video track. On the sending
+// side it feeds the TitanTrackSource as its payload provider, on the receiving
+// side it is attached as a sink to every remote Titan track. Messages are
+// split into chunks so that a message may span several frames and a frame may
+// carry several messages. A lost frame loses every message that had a chunk
+// in it, unless |fec_group| is set and FEC rebuilds the frame, see
+// TitanFec.h.
+class TitanTrackTransport : public TitanTransport,
+                            public TitanPayloadProvider,
+                            public rtc::VideoSinkInterface<webrtc::VideoFrame>,
+                            private TitanFecDecoder::Output {
+ public:
+  TitanTrackTransport(const TitanFrameLayout& layout,
+                      size_t max_buffered_bytes,
+                      int fec_group = 0);
+  ~TitanTrackTransport() override;
+
+  // Whether frames of |layout| leave room for chunks next to the FEC
+  // overhead of |fec_group|.
+  static bool Supports(const TitanFrameLayout& layout, int fec_group);
+
+  const TitanFrameLayout& layout() const { return layout_; }
+
+  // TitanTransport implementation.
+  Mode mode() const override { return kTitanTrack; }
+  const char* name() const override { return "titan-track"; }
+  bool reliable() const override { return false; }
+  bool ready() const override;
+  size_t buffered_amount() const override;
+  void SetObserver(TitanTransportObserver* observer) override;
+  bool Send(const uint8_t* data, size_t size) override;
+
+  // Like Send(), but with the message id chosen by the caller. Ids have to
+  // increase with every message.
+  bool SendWithId(uint32_t id, const uint8_t* data, size_t size);
+  // Takes precedence over the TitanTransportObserver for messages that have
+  // an id, which all but those of kTitanRawStream frames do.
+  void SetMessageObserver(TitanTrackMessageObserver* observer);
+  // Takes the messages of kTitanRawStream frames instead of the
+  // TitanTransportObserver, for when that one only understands what went
+  // through Send(), e.g. a TitanCompressedTransport.
+  void SetRawObserver(TitanTransportObserver* observer);
+
+  // While the path to the remote side is down, e.g. during an ICE restart,
+  // frames go out without messages and Send() pushes back once the buffer is
+  // full. Resume() sends the messages of the last moments before Suspend()
+  // once more, since the path may have been gone for a while before anyone
+  // noticed, as many of the newest as still fit the buffer; the receiver
+  // drops those it already has.
+  void Suspend();
+  void Resume();
+
+  // TitanPayloadProvider implementation, called on the frame thread.
+  size_t FillPayload(uint8_t* data, size_t capacity) override;
+  uint8_t stream_id() const override;
+
+  // VideoSinkInterface implementation, called on the decoder thread of each
+  // track the transport is attached to. Frames of all of them are handled
+  // one at a time, so the observer sees a single stream of messages.
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+ private:
+  struct OutgoingMessage {
+    uint32_t id;
+    std::vector<uint8_t> data;
+    size_t offset;
+    // Went out before, see Resume().
+    bool resent;
+    // When the last chunk went out.
+    int64_t sent_us;
+  };
+
+  bool Enqueue(uint32_t id, const uint8_t* data, size_t size)
+      RTC_EXCLUSIVE_LOCKS_REQUIRED(send_lock_);
+
+  // TitanFecDecoder::Output implementation, called with |receive_lock_|
+  // held.
+  void OnFecFrame(const uint8_t* data, size_t size, bool lost_before) override;
+  void Deliver(uint32_t id, const uint8_t* data, size_t size, bool resent)
+      RTC_EXCLUSIVE_LOCKS_REQUIRED(receive_lock_);
+  void ResetReassembly() RTC_EXCLUSIVE_LOCKS_REQUIRED(receive_lock_);
+
+  const TitanFrameLayout layout_;
+  const size_t max_buffered_bytes_;
+  std::atomic<TitanTransportObserver*> observer_;
+  std::atomic<TitanTrackMessageObserver*> message_observer_;
+  std::atomic<TitanTransportObserver*> raw_observer_;
+  std::atomic<bool> frames_pulled_;
+
+  mutable rtc::CriticalSection send_lock_;
+  std::deque<OutgoingMessage> send_queue_ RTC_GUARDED_BY(send_lock_);
+  size_t buffered_bytes_ RTC_GUARDED_BY(send_lock_);
+  uint32_t next_message_id_ RTC_GUARDED_BY(send_lock_);
+  bool suspended_ RTC_GUARDED_BY(send_lock_);
+  int64_t suspended_us_ RTC_GUARDED_BY(send_lock_);
+  // Messages sent completely, oldest first, kept for Resume().
+  std::deque<OutgoingMessage> sent_history_ RTC_GUARDED_BY(send_lock_);
+  size_t history_bytes_ RTC_GUARDED_BY(send_lock_);
+
+  // Only touched on the frame thread.
+  TitanFecEncoder fec_encoder_;
+  bool parity_frame_;
+
+  // Receive side.
+  rtc::CriticalSection receive_lock_;
+  TitanFecDecoder fec_decoder_ RTC_GUARDED_BY(receive_lock_);
+  bool reassembling_ RTC_GUARDED_BY(receive_lock_);
+  uint32_t reassembly_id_ RTC_GUARDED_BY(receive_lock_);
+  bool reassembly_resent_ RTC_GUARDED_BY(receive_lock_);
+  bool has_delivered_id_ RTC_GUARDED_BY(receive_lock_);
+  uint32_t last_delivered_id_ RTC_GUARDED_BY(receive_lock_);
+  // Raw frames carry no message ids, their sequence numbers tell what the
+  // track dropped.
+  bool has_raw_sequence_ RTC_GUARDED_BY(receive_lock_);
+  uint32_t next_raw_sequence_ RTC_GUARDED_BY(receive_lock_);
+  std::vector<uint8_t> reassembly_ RTC_GUARDED_BY(receive_lock_);
+  TitanFrameHeader frame_header_ RTC_GUARDED_BY(receive_lock_);
+  std::vector<uint8_t> frame_payload_ RTC_GUARDED_BY(receive_lock_);
+};
@@ -0,0 +1,28 @@
+#include "pch.h"
+
+#include "TitanTransport.h"
+
+#include <string.h>
+
+void TitanTransportFanout::Add(TitanTransportObserver* observer) {
+  observers_.push_back(observer);
+}
+
+void TitanTransportFanout::OnTransportMessage(const uint8_t* data,
+                                              size_t size) {
+  for (TitanTransportObserver* observer : observers_)
+    observer->OnTransportMessage(data, size);
+}
+
+bool ParseTitanTransportMode(const char* name, TitanTransport::Mode* mode) {
+  if (strcmp(name, "titan") == 0) {
+    *mode = TitanTransport::kTitanTrack;
+  } else if (strcmp(name, "datachannel") == 0) {
+    *mode = TitanTransport::kDataChannelReliable;
+  } else if (strcmp(name, "datachannel-unreliable") == 0) {
+    *mode = TitanTransport::kDataChannelUnreliable;
+  } else {
+    return false;
+  }
+  return true;
+}
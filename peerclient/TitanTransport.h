@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class TitanTransportObserver {
+ public:
+  // Called once per complete message, on whichever thread the backend
+  // receives on. Implementations must not block.
+  virtual void OnTransportMessage(const uint8_t* data, size_t size) = 0;
+
+ protected:
+  virtual ~TitanTransportObserver() {}
+};
+
+// Hands every message to several observers. The list is fixed once the
+// fan-out is set on a transport.
+class TitanTransportFanout : public TitanTransportObserver {
+ public:
+  void Add(TitanTransportObserver* observer);
+  bool empty() const { return observers_.empty(); }
+
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+
+ private:
+  std::vector<TitanTransportObserver*> observers_;
+};
+
+// Message oriented transport between two peers. Messages are delivered whole
+// or not at all; whether lost messages are retransmitted depends on the
+// backend, see reliable().
+class TitanTransport {
+ public:
+  enum Mode {
+    // Messages are packed into the pixels of the Titan video track.
+    kTitanTrack,
+    // Ordered, fully reliable SCTP data channel.
+    kDataChannelReliable,
+    // Unordered SCTP data channel without retransmissions.
+    kDataChannelUnreliable,
+    // Messages are modulated into the audio track. Only used as a side lane
+    // for small messages next to one of the transports above.
+    kTitanAudio,
+  };
+
+  virtual ~TitanTransport() {}
+
+  virtual Mode mode() const = 0;
+  virtual const char* name() const = 0;
+  virtual bool reliable() const = 0;
+
+  // True once messages passed to Send() can make it to the remote side.
+  virtual bool ready() const = 0;
+
+  // Bytes accepted by Send() that haven't been handed to the network yet.
+  virtual size_t buffered_amount() const = 0;
+
+  virtual void SetObserver(TitanTransportObserver* observer) = 0;
+
+  // Queues one message. Returns false if the message can't be accepted right
+  // now, e.g. because the send buffer is full.
+  virtual bool Send(const uint8_t* data, size_t size) = 0;
+};
+
+bool ParseTitanTransportMode(const char* name, TitanTransport::Mode* mode);
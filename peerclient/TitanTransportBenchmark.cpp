@@ -0,0 +1,176 @@
+#include "pch.h"
+
+#include "TitanTransportBenchmark.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <rtc_base/checks.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/timeutils.h>
+
+namespace {
+
+// Every message starts with its sequence number (4) and send time (8).
+const size_t kMessageHeaderSize = 12;
+const int kTickIntervalMs = 5;
+// Time given to messages still in flight before the results are reported.
+const int kDrainMs = 2000;
+// Upper bound on the latency samples kept, a long run shouldn't eat memory.
+const size_t kMaxLatencySamples = 100000;
+
+int64_t Percentile(const std::vector<int64_t>& sorted, int percent) {
+  if (sorted.empty())
+    return 0;
+  size_t index = (sorted.size() - 1) * percent / 100;
+  return sorted[index];
+}
+
+}  // namespace
+
+TitanTransportBenchmark::TitanTransportBenchmark(rtc::Thread* thread,
+                                                 TitanTransport* transport,
+                                                 size_t message_size,
+                                                 int duration_ms)
+    : thread_(thread),
+      transport_(transport),
+      message_size_(std::max(message_size, kMessageHeaderSize)),
+      duration_ms_(duration_ms),
+      running_(false),
+      sending_(false),
+      start_us_(0),
+      stop_us_(0),
+      next_sequence_(0),
+      messages_sent_(0),
+      send_rejected_(0),
+      message_(message_size_, 0x5a),
+      messages_received_(0),
+      bytes_received_(0),
+      first_receive_us_(0),
+      last_receive_us_(0) {
+  RTC_DCHECK(thread_);
+  RTC_DCHECK(transport_);
+}
+
+TitanTransportBenchmark::~TitanTransportBenchmark() {
+  Stop();
+}
+
+void TitanTransportBenchmark::Start() {
+  RTC_DCHECK(thread_->IsCurrent());
+  if (running_)
+    return;
+  running_ = true;
+  sending_ = true;
+  transport_->SetObserver(this);
+  RTC_LOG(INFO) << "Benchmarking " << transport_->name() << " with "
+                << message_size_ << " byte messages for " << duration_ms_
+                << " ms";
+  thread_->PostDelayed(RTC_FROM_HERE, kTickIntervalMs, this, MSG_TICK);
+}
+
+void TitanTransportBenchmark::Stop() {
+  if (!running_)
+    return;
+  running_ = false;
+  sending_ = false;
+  thread_->Clear(this);
+  transport_->SetObserver(nullptr);
+}
+
+void TitanTransportBenchmark::OnTransportMessage(const uint8_t* data,
+                                                 size_t size) {
+  int64_t now_us = rtc::TimeMicros();
+  if (size < kMessageHeaderSize)
+    return;
+  int64_t sent_us;
+  memcpy(&sent_us, data + 4, sizeof(sent_us));
+
+  rtc::CritScope lock(&lock_);
+  if (messages_received_ == 0)
+    first_receive_us_ = now_us;
+  last_receive_us_ = now_us;
+  ++messages_received_;
+  bytes_received_ += size;
+  if (latencies_us_.size() < kMaxLatencySamples)
+    latencies_us_.push_back(now_us - sent_us);
+}
+
+void TitanTransportBenchmark::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+    case MSG_TICK:
+      SendBurst();
+      break;
+    case MSG_STOP_SENDING:
+      sending_ = false;
+      stop_us_ = rtc::TimeMicros();
+      thread_->PostDelayed(RTC_FROM_HERE, kDrainMs, this, MSG_FINISH);
+      break;
+    case MSG_FINISH:
+      Finish();
+      break;
+    default:
+      RTC_NOTREACHED();
+      break;
+  }
+}
+
+void TitanTransportBenchmark::SendBurst() {
+  if (!sending_)
+    return;
+  thread_->PostDelayed(RTC_FROM_HERE, kTickIntervalMs, this, MSG_TICK);
+  if (!transport_->ready())
+    return;  // The clock starts once the transport can carry messages.
+
+  int64_t now_us = rtc::TimeMicros();
+  if (start_us_ == 0) {
+    start_us_ = now_us;
+    thread_->PostDelayed(RTC_FROM_HERE, duration_ms_, this, MSG_STOP_SENDING);
+  }
+
+  // Keep the transport's buffer full, it knows best how much it can take.
+  for (;;) {
+    memcpy(message_.data(), &next_sequence_, 4);
+    memcpy(message_.data() + 4, &now_us, sizeof(now_us));
+    if (!transport_->Send(message_.data(), message_.size())) {
+      ++send_rejected_;
+      break;
+    }
+    ++next_sequence_;
+    ++messages_sent_;
+  }
+}
+
+void TitanTransportBenchmark::Finish() {
+  int64_t elapsed_us = stop_us_ - start_us_;
+  Stop();
+
+  uint64_t messages_received;
+  uint64_t bytes_received;
+  int64_t receive_span_us;
+  std::vector<int64_t> latencies;
+  {
+    rtc::CritScope lock(&lock_);
+    messages_received = messages_received_;
+    bytes_received = bytes_received_;
+    receive_span_us = last_receive_us_ - first_receive_us_;
+    latencies.swap(latencies_us_);
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  int64_t span_us = receive_span_us > 0 ? receive_span_us : elapsed_us;
+  double goodput_kbps = span_us > 0 ? bytes_received * 8000.0 / span_us : 0;
+  double loss = messages_sent_ > 0
+                    ? 1.0 - static_cast<double>(messages_received) /
+                                messages_sent_
+                    : 0;
+
+  RTC_LOG(INFO) << "Benchmark " << transport_->name() << ": sent "
+                << messages_sent_ << " messages, received "
+                << messages_received << " (" << loss * 100 << "% lost), "
+                << goodput_kbps << " kbps, latency p50 "
+                << Percentile(latencies, 50) / 1000.0 << " ms, p99 "
+                << Percentile(latencies, 99) / 1000.0 << " ms, max "
+                << Percentile(latencies, 100) / 1000.0 << " ms, "
+                << send_rejected_ << " sends pushed back";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <rtc_base/criticalsection.h>
+#include <rtc_base/messagehandler.h>
+#include <rtc_base/thread.h>
+#include <rtc_base/thread_annotations.h>
+
+#include "TitanTransport.h"
+
+// Pushes timestamped messages through a transport for a fixed time and logs
+// the goodput and one way latency it got. Latency is only meaningful when
+// both ends share a clock, i.e. in a loopback call, where a single instance
+// is both the sender and the observer of the remote end.
+class TitanTransportBenchmark : public rtc::MessageHandler,
+                                public TitanTransportObserver {
+ public:
+  TitanTransportBenchmark(rtc::Thread* thread,
+                          TitanTransport* transport,
+                          size_t message_size,
+                          int duration_ms);
+  ~TitanTransportBenchmark() override;
+
+  void Start();
+  void Stop();
+
+  // TitanTransportObserver implementation, called on the receive thread.
+  void OnTransportMessage(const uint8_t* data, size_t size) override;
+
+ private:
+  enum { MSG_TICK, MSG_STOP_SENDING, MSG_FINISH };
+
+  void OnMessage(rtc::Message* msg) override;
+  void SendBurst();
+  void Finish();
+
+  rtc::Thread* const thread_;
+  TitanTransport* const transport_;
+  const size_t message_size_;
+  const int duration_ms_;
+
+  bool running_;
+  bool sending_;
+  int64_t start_us_;
+  int64_t stop_us_;
+  uint32_t next_sequence_;
+  uint64_t messages_sent_;
+  uint64_t send_rejected_;
+  std::vector<uint8_t> message_;
+
+  rtc::CriticalSection lock_;
+  uint64_t messages_received_ RTC_GUARDED_BY(lock_);
+  uint64_t bytes_received_ RTC_GUARDED_BY(lock_);
+  int64_t first_receive_us_ RTC_GUARDED_BY(lock_);
+  int64_t last_receive_us_ RTC_GUARDED_BY(lock_);
+  std::vector<int64_t> latencies_us_ RTC_GUARDED_BY(lock_);
+};
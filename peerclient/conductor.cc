@@ -10,6 +10,10 @@
 #include "pch.h"
 #include "conductor.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -24,14 +28,26 @@
 #include "modules/audio_device/include/audio_device.h"
 #include "modules/audio_processing/include/audio_processing.h"
 #include "modules/video_capture/video_capture_factory.h"
+#include "rtc_base/arraysize.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/json.h"
 #include "rtc_base/logging.h"
+#include "rtc_base/rtccertificategenerator.h"
+#include "rtc_base/stringencode.h"
+#include "rtc_base/timeutils.h"
 
 #include "TitanMediaSourceInterface.h"
 #include "TitanMediaTrackInterface.h"
+#include "TitanMetrics.h"
 
 class TitanMediaTrackInterface;
+
+// Ids of the Titan tracks, which the remote peer gets to see.
+const char kTitanTrackId[] = "titan";
+const char kReplayTrackId[] = "titan-replay";
+// Followed by the index of the simulcast layer.
+const char kLayerTrackPrefix[] = "titan-layer-";
+
 // Names used for a IceCandidate JSON object.
 const char kCandidateSdpMidName[] = "sdpMid";
 const char kCandidateSdpMlineIndexName[] = "sdpMLineIndex";
@@ -41,6 +57,61 @@ const char kCandidateSdpName[] = "candidate";
 const char kSessionDescriptionTypeName[] = "type";
 const char kSessionDescriptionSdpName[] = "sdp";
 
+// The callee asking the caller for an offer, see Conductor::MaybeNegotiate().
+const char kNegotiateType[] = "negotiate";
+const char kNegotiateVideoTracksName[] = "videoTracks";
+
+// Range ChangeTrackPriority() moves the transport tracks in, from very-low
+// to four times high.
+const double kMinBitratePriority = 0.5;
+const double kMaxBitratePriority = 16.0;
+
+// Connectivity checks on a LAN answer within milliseconds, no need to wait
+// as long between them as over the Internet.
+const int kLanIceCheckIntervalMs = 10;
+const int kLanIceReceivingTimeoutMs = 1000;
+
+// How long an ICE restart may go without the connection coming back before
+// the next attempt.
+const int kIceRestartTimeoutMs = 10000;
+
+// Messages posted to ourselves.
+enum {
+  MSG_ICE_RESTART_TIMEOUT,
+};
+
+const struct {
+  const char* name;
+  rtc::AdapterType type;
+} kAdapterTypes[] = {
+    {"ethernet", rtc::ADAPTER_TYPE_ETHERNET},
+    {"wifi", rtc::ADAPTER_TYPE_WIFI},
+    {"cellular", rtc::ADAPTER_TYPE_CELLULAR},
+    {"vpn", rtc::ADAPTER_TYPE_VPN},
+    {"loopback", rtc::ADAPTER_TYPE_LOOPBACK},
+};
+
+bool ParseNetworkIgnoreMask(const char* types, int* mask) {
+  int ignored = 0;
+  for (const auto& adapter : kAdapterTypes)
+    ignored |= adapter.type;
+  std::vector<std::string> names;
+  rtc::split(types, ',', &names);
+  for (const std::string& name : names) {
+    bool found = false;
+    for (const auto& adapter : kAdapterTypes) {
+      if (name == adapter.name) {
+        ignored &= ~adapter.type;
+        found = true;
+      }
+    }
+    if (!found)
+      return false;
+  }
+  *mask = ignored;
+  return !names.empty();
+}
+
 class DummySetSessionDescriptionObserver
     : public webrtc::SetSessionDescriptionObserver {
  public:
@@ -54,13 +125,45 @@ class DummySetSessionDescriptionObserver
   }
 };
 
-Conductor::Conductor(PeerConnectionClient* client, MainWindow* main_wnd)
+Conductor::Conductor(SignalingClient* client, MainWindow* main_wnd,
+                     const ConductorConfig& config)
   : peer_id_(-1),
     loopback_(false),
     client_(client),
-    main_wnd_(main_wnd) {
+    main_wnd_(main_wnd),
+    config_(config),
+    message_send_start_us_(0) {
   client_->RegisterObserver(this);
   main_wnd->RegisterObserver(this);
+  received_layer_ = config_.simulcast_receive_layer;
+  if (config_.stats_interval_ms > 0) {
+    stats_collector_.reset(new TitanStatsCollector(
+        rtc::Thread::Current(), config_.stats_interval_ms,
+        config_.stats_capacity, config_.stats_dump_path));
+  }
+  if (config_.metrics_port > 0) {
+    metrics_server_.reset(new MetricsServer(this));
+    if (!metrics_server_->Start(config_.metrics_port))
+      metrics_server_.reset();
+  }
+  if (!config_.shm_name.empty()) {
+    std::unique_ptr<TitanSharedRingWriter> ring = TitanSharedRingWriter::Create(
+        config_.shm_name, config_.shm_slots, config_.shm_slot_size);
+    if (ring)
+      shm_sink_.reset(
+          new TitanSharedRingSink(config_.shm_mode, std::move(ring)));
+  }
+  if (!config_.record_path.empty()) {
+    recorder_ = TitanRecordingSink::Create(config_.record_path,
+                                           config_.record_format);
+  }
+  if (!config_.ingest.empty()) {
+    ingest_input_ = CreateTitanIngestInput(
+        config_.ingest, config_.transport_max_buffered_bytes);
+  }
+  // Failing here is not fatal, the first call tries again and reports it.
+  if (CreatePeerConnectionFactory())
+    FillConnectionPool();
 }
 
 Conductor::~Conductor() {
@@ -72,30 +175,53 @@ bool Conductor::connection_active() const {
 }
 
 void Conductor::Close() {
+  rtc::Thread::Current()->Clear(this);
   client_->SignOut();
   DeletePeerConnection();
+  idle_connections_.clear();
+  peer_connection_factory_ = nullptr;
 }
 
-bool Conductor::InitializePeerConnection() {
+bool Conductor::CreatePeerConnectionFactory() {
   RTC_DCHECK(!peer_connection_factory_);
-  RTC_DCHECK(!peer_connection_);
-
   peer_connection_factory_ = webrtc::CreatePeerConnectionFactory(
       nullptr /* network_thread */, nullptr /* worker_thread */,
       nullptr /* signaling_thread */, nullptr /* default_adm */,
       webrtc::CreateBuiltinAudioEncoderFactory(),
       webrtc::CreateBuiltinAudioDecoderFactory(),
-      webrtc::CreateBuiltinVideoEncoderFactory(),
+      std::unique_ptr<webrtc::VideoEncoderFactory>(new TitanEncoderFactory(
+          webrtc::CreateBuiltinVideoEncoderFactory(), &encoder_feedback_)),
       webrtc::CreateBuiltinVideoDecoderFactory(), nullptr /* audio_mixer */,
       nullptr /* audio_processing */);
+  if (!peer_connection_factory_)
+    return false;
+
+  webrtc::PeerConnectionFactoryInterface::Options options;
+  options.network_ignore_mask = config_.network_ignore_mask;
+  peer_connection_factory_->SetOptions(options);
+
+  // Every connection would otherwise generate its own DTLS identity.
+  certificate_ = rtc::RTCCertificateGenerator::GenerateCertificate(
+      rtc::KeyParams(rtc::KT_ECDSA), rtc::nullopt);
+  if (!certificate_)
+    RTC_LOG(LS_WARNING) << "Failed to generate the DTLS certificate";
+  return true;
+}
+
+bool Conductor::InitializePeerConnection() {
+  RTC_DCHECK(!peer_connection_);
 
-  if (!peer_connection_factory_) {
+  // The factory, with its threads and codecs, is kept from call to call.
+  if (!peer_connection_factory_ && !CreatePeerConnectionFactory()) {
     main_wnd_->MessageBox("Error",
         "Failed to initialize PeerConnectionFactory", true);
     DeletePeerConnection();
     return false;
   }
 
+  call_start_us_ = rtc::TimeMicros();
+  CreateTransport();
+
   if (!CreatePeerConnection(/*dtls=*/true)) {
     main_wnd_->MessageBox("Error",
         "CreatePeerConnection failed", true);
@@ -107,18 +233,153 @@ bool Conductor::InitializePeerConnection() {
     AddTracks();
   }
 
+  if (stats_collector_ && peer_connection_)
+    stats_collector_->Start(peer_connection_,
+                            master ? main_source() : nullptr);
+
   return peer_connection_ != nullptr;
 }
 
+void Conductor::CreateTransport() {
+  switch (config_.transport_mode) {
+    case TitanTransport::kTitanTrack:
+      if (!config_.simulcast_layers.empty()) {
+        simulcast_transport_.reset(new TitanSimulcastTransport(
+            config_.simulcast_layers, config_.transport_max_buffered_bytes));
+        break;
+      }
+      track_transport_.reset(new TitanTrackTransport(
+          config_.frame_layout, config_.transport_max_buffered_bytes,
+          config_.fec_group));
+      break;
+    case TitanTransport::kDataChannelReliable:
+    case TitanTransport::kDataChannelUnreliable:
+      data_channel_transport_.reset(new TitanDataChannelTransport(
+          config_.transport_mode, config_.transport_max_buffered_bytes));
+      break;
+    case TitanTransport::kTitanAudio:
+      RTC_NOTREACHED();
+      break;
+  }
+  if (config_.compress)
+    compressed_transport_.reset(new TitanCompressedTransport(main_transport()));
+  if (config_.audio_mode == ConductorConfig::kAudioTitan) {
+    audio_transport_.reset(
+        new TitanAudioTransport(config_.transport_max_buffered_bytes));
+  }
+  transport_observers_.reset(new TitanTransportFanout());
+  if (shm_sink_ && shm_sink_->mode() == TitanSharedRingSink::kPayload)
+    transport_observers_->Add(shm_sink_.get());
+  if (recorder_ && recorder_->format() == TitanRecordingSink::kRaw)
+    transport_observers_->Add(recorder_.get());
+  if (!transport_observers_->empty()) {
+    main_transport()->SetObserver(transport_observers_.get());
+    // Raw replay frames never went through the compressor.
+    if (compressed_transport_ && simulcast_transport_)
+      simulcast_transport_->SetRawObserver(transport_observers_.get());
+    else if (compressed_transport_ && track_transport_)
+      track_transport_->SetRawObserver(transport_observers_.get());
+  }
+  if (ingest_input_) {
+    ingest_.reset(new TitanIngest(rtc::Thread::Current(), ingest_input_.get(),
+                                  main_transport()));
+    ingest_->Start();
+  }
+}
+
+TitanTransport* Conductor::main_transport() const {
+  if (compressed_transport_)
+    return compressed_transport_.get();
+  if (simulcast_transport_)
+    return simulcast_transport_.get();
+  if (track_transport_)
+    return track_transport_.get();
+  return data_channel_transport_.get();
+}
+
+void Conductor::DeleteTransport() {
+  benchmark_.reset();
+  ingest_.reset();
+  for (const TitanSendTrack& titan : titan_tracks_) {
+    if (titan.carries_transport)
+      titan.source->ClearPayloadProvider();
+  }
+  for (const auto& track : remote_titan_tracks_) {
+    TitanTrackTransport* transport = transport_for_track(track->id());
+    if (transport)
+      track->RemoveSink(transport);
+  }
+  remote_titan_tracks_.clear();
+  if (remote_frame_track_) {
+    DetachFrameSinks(remote_frame_track_);
+    remote_frame_track_ = nullptr;
+  }
+  compressed_transport_.reset();
+  if (data_channel_transport_)
+    data_channel_transport_->Close();
+  data_channel_transport_.reset();
+  track_transport_.reset();
+  simulcast_transport_.reset();
+  transport_observers_.reset();
+  if (remote_audio_track_) {
+    remote_audio_track_->RemoveSink(audio_transport_.get());
+    remote_audio_track_ = nullptr;
+  }
+  if (audio_source_) {
+    audio_source_->Stop();
+    audio_source_ = nullptr;
+  }
+  audio_transport_.reset();
+}
+
+void Conductor::CreateDataChannel() {
+  webrtc::DataChannelInit init =
+      TitanDataChannelTransport::CreateInit(config_.transport_mode);
+  rtc::scoped_refptr<webrtc::DataChannelInterface> channel =
+      peer_connection_->CreateDataChannel(TitanDataChannelTransport::kLabel,
+                                          &init);
+  if (!channel) {
+    RTC_LOG(LS_ERROR) << "Failed to create the Titan data channel";
+    return;
+  }
+  data_channel_transport_->AddChannel(channel);
+}
+
+void Conductor::MaybeStartBenchmark() {
+  // Latency can only be measured when both ends share a clock.
+  if (!loopback_ || benchmark_ || config_.benchmark_duration_ms <= 0)
+    return;
+  TitanTransport* transport = main_transport();
+  size_t message_size = config_.benchmark_message_size;
+  if (config_.benchmark_audio) {
+    transport = audio_transport_.get();
+    message_size = std::min(message_size, kTitanAudioMaxMessageSize);
+  }
+  if (!transport)
+    return;
+  // The benchmark needs the transport to itself.
+  ingest_.reset();
+  benchmark_.reset(new TitanTransportBenchmark(
+      rtc::Thread::Current(), transport, message_size,
+      config_.benchmark_duration_ms));
+  benchmark_->Start();
+}
+
 bool Conductor::ReinitializePeerConnectionForLoopback() {
   loopback_ = true;
   std::vector<rtc::scoped_refptr<webrtc::RtpSenderInterface>> senders =
       peer_connection_->GetSenders();
+  if (data_channel_transport_)
+    data_channel_transport_->Close();
   peer_connection_ = nullptr;
-  if (CreatePeerConnection(/*dtls=*/false)) {
+  // SCTP runs on top of DTLS, so data channels need it even in loopback.
+  if (CreatePeerConnection(/*dtls=*/data_channel_transport_ != nullptr)) {
     for (const auto& sender : senders) {
       peer_connection_->AddTrack(sender->track(), sender->stream_ids());
     }
+    if (data_channel_transport_)
+      CreateDataChannel();
+    MaybeStartBenchmark();
     peer_connection_->CreateOffer(
         this, webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
   }
@@ -129,25 +390,101 @@ bool Conductor::CreatePeerConnection(bool dtls) {
   RTC_DCHECK(peer_connection_factory_);
   RTC_DCHECK(!peer_connection_);
 
+  TitanMetrics& metrics = TitanMetrics::Get();
+  if (dtls && !idle_connections_.empty()) {
+    peer_connection_ = idle_connections_.front();
+    idle_connections_.pop_front();
+    metrics.peer_connections_pooled.fetch_add(1, std::memory_order_relaxed);
+    // Topped up once the call got going.
+    main_wnd_->QueueUIThreadCallback(FILL_CONNECTION_POOL, nullptr);
+    return true;
+  }
+
+  int64_t start_us = rtc::TimeMicros();
+  peer_connection_ = NewPeerConnection(dtls);
+  if (peer_connection_) {
+    RTC_LOG(INFO) << "Created a PeerConnection in "
+                  << (rtc::TimeMicros() - start_us) /
+                         rtc::kNumMicrosecsPerMillisec
+                  << " ms";
+  }
+  return peer_connection_ != nullptr;
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionInterface>
+Conductor::NewPeerConnection(bool dtls) {
   webrtc::PeerConnectionInterface::RTCConfiguration config;
   config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
   config.enable_dtls_srtp = dtls;
-  webrtc::PeerConnectionInterface::IceServer server;
-  server.uri = GetPeerConnectionString();
-  config.servers.push_back(server);
+  config.ice_candidate_pool_size = config_.ice_candidate_pool_size;
+  if (config_.lan_mode) {
+    // A STUN server that can't be reached only holds gathering up, and
+    // there is nothing to learn from one that can.
+    config.tcp_candidate_policy =
+        webrtc::PeerConnectionInterface::kTcpCandidatePolicyDisabled;
+    config.ice_check_min_interval = kLanIceCheckIntervalMs;
+    config.ice_connection_receiving_timeout = kLanIceReceivingTimeoutMs;
+    // Host candidates are ready at once, so have them ready up front.
+    config.ice_candidate_pool_size =
+        std::max(config.ice_candidate_pool_size, 1);
+  } else {
+    webrtc::PeerConnectionInterface::IceServer server;
+    server.uri = GetPeerConnectionString();
+    config.servers.push_back(server);
+  }
+  if (dtls && certificate_)
+    config.certificates.push_back(certificate_);
+
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection =
+      peer_connection_factory_->CreatePeerConnection(config, nullptr, nullptr,
+                                                     this);
+  if (!peer_connection)
+    return nullptr;
+  TitanMetrics::Get().peer_connections_created.fetch_add(
+      1, std::memory_order_relaxed);
+  // The audio lane feeds the send stream itself, keep the microphone from
+  // being mixed into it.
+  if (config_.audio_mode != ConductorConfig::kAudioDevice)
+    peer_connection->SetAudioRecording(false);
+  return peer_connection;
+}
 
-  peer_connection_ = peer_connection_factory_->CreatePeerConnection(
-      config, nullptr, nullptr, this);
-  return peer_connection_ != nullptr;
+void Conductor::FillConnectionPool() {
+  if (!peer_connection_factory_)
+    return;
+  while (idle_connections_.size() < config_.connection_pool_size) {
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection =
+        NewPeerConnection(/*dtls=*/true);
+    if (!peer_connection)
+      break;
+    idle_connections_.push_back(peer_connection);
+  }
 }
 
 void Conductor::DeletePeerConnection() {
+  if (stats_collector_)
+    stats_collector_->Stop();
   main_wnd_->StopLocalRenderer();
   main_wnd_->StopRemoteRenderer();
+  for (const TitanSendTrack& titan : titan_tracks_)
+    titan.source->Stop();
+  DeleteTransport();
+  // The source has stopped pulling from it.
+  replay_.reset();
+  titan_tracks_.clear();
   peer_connection_ = nullptr;
-  peer_connection_factory_ = nullptr;
   peer_id_ = -1;
   loopback_ = false;
+  connection_lost_us_ = 0;
+  call_start_us_ = 0;
+  ice_restarts_ = 0;
+  ice_restart_pending_ = false;
+  rtc::Thread::Current()->Clear(this, MSG_ICE_RESTART_TIMEOUT);
+  // An offer still in flight goes with the connection.
+  renegotiations_needed_ = 0;
+  renegotiations_offered_ = 0;
+  making_offer_ = false;
+  tracks_removed_ = false;
 }
 
 void Conductor::EnsureStreamingUI() {
@@ -162,6 +499,29 @@ void Conductor::EnsureStreamingUI() {
 // PeerConnectionObserver implementation.
 //
 
+void Conductor::OnSignalingChange(
+    webrtc::PeerConnectionInterface::SignalingState new_state) {
+  // The senders are negotiated now. Their tracks are the UI thread's.
+  if (new_state == webrtc::PeerConnectionInterface::kStable)
+    main_wnd_->QueueUIThreadCallback(SIGNALING_STABLE, nullptr);
+}
+
+void Conductor::OnIceConnectionChange(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  RTC_LOG(INFO) << __FUNCTION__ << " " << new_state;
+  main_wnd_->QueueUIThreadCallback(
+      ICE_CONNECTION_CHANGE,
+      reinterpret_cast<void*>(static_cast<intptr_t>(new_state)));
+}
+
+void Conductor::OnRenegotiationNeeded() {
+  RTC_LOG(INFO) << __FUNCTION__;
+  // Counted right away, an offer created before the message is handled
+  // already covers the change.
+  ++renegotiations_needed_;
+  main_wnd_->QueueUIThreadCallback(RENEGOTIATION_NEEDED, nullptr);
+}
+
 void Conductor::OnAddTrack(
     rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver,
     const std::vector<rtc::scoped_refptr<webrtc::MediaStreamInterface>>&
@@ -171,6 +531,16 @@ void Conductor::OnAddTrack(
                                    receiver->track().release());
 }
 
+void Conductor::OnDataChannel(
+    rtc::scoped_refptr<webrtc::DataChannelInterface> channel) {
+  RTC_LOG(INFO) << __FUNCTION__ << " " << channel->label();
+  if (!data_channel_transport_ ||
+      channel->label() != TitanDataChannelTransport::kLabel) {
+    return;
+  }
+  data_channel_transport_->AddChannel(channel);
+}
+
 void Conductor::OnRemoveTrack(
     rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver) {
   RTC_LOG(INFO) << __FUNCTION__ << " " << receiver->id();
@@ -219,11 +589,16 @@ void Conductor::OnDisconnected() {
     main_wnd_->SwitchToConnectUI();
 }
 
-void Conductor::OnPeerConnected(int id, const std::string& name) {
-  RTC_LOG(INFO) << __FUNCTION__;
-  // Refresh the list if we're showing it.
+void Conductor::OnRosterChanged(const RosterDelta& delta) {
+  RTC_LOG(INFO) << __FUNCTION__ << " +" << delta.added.size() << " -"
+                << delta.removed.size() << " ~" << delta.changed.size();
+  if (peer_id_ != -1 && std::find(delta.removed.begin(), delta.removed.end(),
+                                  peer_id_) != delta.removed.end()) {
+    OnPeerDisconnected(peer_id_);
+  }
+  // Update the list if we're showing it.
   if (main_wnd_->current_ui() == MainWindow::LIST_PEERS)
-    main_wnd_->SwitchToPeerList(client_->peers());
+    main_wnd_->UpdatePeerList(delta);
 }
 
 void Conductor::OnPeerDisconnected(int id) {
@@ -231,10 +606,6 @@ void Conductor::OnPeerDisconnected(int id) {
   if (id == peer_id_) {
     RTC_LOG(INFO) << "Our peer disconnected";
     main_wnd_->QueueUIThreadCallback(PEER_CONNECTION_CLOSED, NULL);
-  } else {
-    // Refresh the list if we're showing it.
-    if (main_wnd_->current_ui() == MainWindow::LIST_PEERS)
-      main_wnd_->SwitchToPeerList(client_->peers());
   }
 }
 
@@ -281,6 +652,13 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
       }
       return;
     }
+    if (type_str == kNegotiateType) {
+      int video_tracks = 0;
+      rtc::GetIntFromJsonObject(jmessage, kNegotiateVideoTracksName,
+                                &video_tracks);
+      OnNegotiationRequest(video_tracks);
+      return;
+    }
     rtc::Optional<webrtc::SdpType> type_maybe =
         webrtc::SdpTypeFromString(type_str);
     if (!type_maybe) {
@@ -307,6 +685,8 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
         DummySetSessionDescriptionObserver::Create(),
         session_description.release());
     if (type == webrtc::SdpType::kOffer) {
+      // The answer takes up whatever of our tracks the offer has room for.
+      renegotiations_offered_ = renegotiations_needed_;
       peer_connection_->CreateAnswer(
           this, webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
     }
@@ -339,6 +719,14 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
 }
 
 void Conductor::OnMessageSent(int err) {
+  if (message_send_start_us_ != 0) {
+    TitanMetrics& metrics = TitanMetrics::Get();
+    metrics.signaling_messages_sent.fetch_add(1, std::memory_order_relaxed);
+    metrics.signaling_send_ms.Observe(
+        (rtc::TimeMicros() - message_send_start_us_) /
+        static_cast<double>(rtc::kNumMicrosecsPerMillisec));
+    message_send_start_us_ = 0;
+  }
   // Process the next pending message if any.
   main_wnd_->QueueUIThreadCallback(SEND_MESSAGE_TO_PEER, NULL);
 }
@@ -378,13 +766,43 @@ void Conductor::ConnectToPeer(int peer_id) {
 
   if (InitializePeerConnection()) {
     peer_id_ = peer_id;
-    peer_connection_->CreateOffer(
-        this, webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
+    CreateOffer(webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
   } else {
     main_wnd_->MessageBox("Error", "Failed to initialize PeerConnection", true);
   }
 }
 
+void Conductor::ToggleReplay() {
+  if (!peer_connection_)
+    return;
+  bool replaying = std::any_of(titan_tracks_.begin(), titan_tracks_.end(),
+                               [](const TitanSendTrack& titan) {
+                                 return titan.track->id() == kReplayTrackId;
+                               });
+  // Either way the other tracks go on, the change is negotiated in place.
+  if (replaying) {
+    RemoveTitanTrack(kReplayTrackId);
+    // The source has stopped pulling from it.
+    replay_.reset();
+  } else {
+    AddReplayTrack();
+  }
+}
+
+void Conductor::ChangeTrackPriority(bool raise) {
+  for (TitanSendTrack& titan : titan_tracks_) {
+    if (!titan.carries_transport)
+      continue;
+    double& priority = titan.priority.bitrate_priority;
+    priority = raise ? std::min(priority * 2, kMaxBitratePriority)
+                     : std::max(priority / 2, kMinBitratePriority);
+    RTC_LOG(INFO) << "Priority of " << titan.track->id() << " now "
+                  << priority;
+  }
+  // Encoding parameters change without renegotiation.
+  ApplyTrackPriorities();
+}
+
 std::unique_ptr<cricket::VideoCapturer> Conductor::OpenVideoCaptureDevice() {
   std::vector<std::string> device_names;
   {
@@ -415,21 +833,32 @@ std::unique_ptr<cricket::VideoCapturer> Conductor::OpenVideoCaptureDevice() {
   return capturer;
 }
 
-TitanTrackSource *titanSource;
-TitanTrack* titanTrack;
-
 void Conductor::AddTracks() {
   if (!peer_connection_->GetSenders().empty()) {
     return;  // Already added tracks.
   }
 
-  rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(
-      peer_connection_factory_->CreateAudioTrack(
-          kAudioLabel, peer_connection_factory_->CreateAudioSource(nullptr)));
-  auto result_or_error = peer_connection_->AddTrack(audio_track, {kStreamId});
-  if (!result_or_error.ok()) {
-    RTC_LOG(LS_ERROR) << "Failed to add audio track to PeerConnection: "
-                      << result_or_error.error().message();
+  rtc::scoped_refptr<webrtc::AudioSourceInterface> audio_source;
+  switch (config_.audio_mode) {
+    case ConductorConfig::kAudioDevice:
+      audio_source = peer_connection_factory_->CreateAudioSource(nullptr);
+      break;
+    case ConductorConfig::kAudioTitan:
+      audio_source_ = new TitanAudioSource(audio_transport_.get());
+      audio_source = audio_source_;
+      break;
+    case ConductorConfig::kAudioNone:
+      break;
+  }
+  if (audio_source) {
+    rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(
+        peer_connection_factory_->CreateAudioTrack(kAudioLabel, audio_source));
+    auto result_or_error =
+        peer_connection_->AddTrack(audio_track, {kStreamId});
+    if (!result_or_error.ok()) {
+      RTC_LOG(LS_ERROR) << "Failed to add audio track to PeerConnection: "
+                        << result_or_error.error().message();
+    }
   }
 
   // std::unique_ptr<cricket::VideoCapturer> video_device =
@@ -450,18 +879,407 @@ void Conductor::AddTracks() {
   //   RTC_LOG(LS_ERROR) << "OpenVideoCaptureDevice failed";
   // }
 
-  std::string id = "id";
+  // The transport is latency critical, the replay is bulk traffic. Each
+  // gets a track of its own so that their priorities can tell the
+  // bandwidth estimate apart.
+  if (simulcast_transport_) {
+    for (size_t i = 0; i < simulcast_transport_->layer_count(); ++i) {
+      TitanTrackTransport* layer = simulcast_transport_->layer(i);
+      rtc::scoped_refptr<TitanTrackSource> source(
+          new TitanTrackSource(true, false, config_.frame_interval_ms));
+      // The encoder feedback can only follow one source.
+      if (i == 0)
+        source->SetBackpressure(&encoder_feedback_, config_.backpressure);
+      source->SetPayloadProvider(layer, layer->layout());
+      AddTitanTrack(kLayerTrackPrefix + std::to_string(i), source,
+                    config_.track_priority, true);
+    }
+  } else {
+    rtc::scoped_refptr<TitanTrackSource> source(
+        new TitanTrackSource(true, false, config_.frame_interval_ms));
+    source->SetBackpressure(&encoder_feedback_, config_.backpressure);
+    if (track_transport_) {
+      source->SetPayloadProvider(track_transport_.get(),
+                                 track_transport_->layout());
+    }
+    AddTitanTrack(kTitanTrackId, source, config_.track_priority,
+                  track_transport_ != nullptr);
+  }
 
-  titanSource = new TitanTrackSource(true, false);
-  titanTrack = new TitanTrack(id, titanSource);
+  AddReplayTrack();
 
-  result_or_error = peer_connection_->AddTrack(titanTrack, {kStreamId});
+  // The data channel has to exist before the offer for it to be negotiated.
+  if (data_channel_transport_)
+    CreateDataChannel();
+
+  main_wnd_->SwitchToStreamingUI();
+}
+
+void Conductor::AddReplayTrack() {
+  if (config_.replay_path.empty())
+    return;
+  replay_ = TitanFileReplay::Open(config_.replay_path, config_.replay_loop);
+  if (!replay_)
+    return;
+  int frame_interval_ms = config_.frame_interval_ms;
+  double fps = config_.replay_fps > 0 ? config_.replay_fps : replay_->fps();
+  if (fps > 0)
+    frame_interval_ms = std::max(1, static_cast<int>(1000 / fps + 0.5));
+  rtc::scoped_refptr<TitanTrackSource> replay_source(
+      new TitanTrackSource(true, false, frame_interval_ms));
+  // With simulcast the receiver unpacks the replay like the first layer.
+  const TitanFrameLayout& layout =
+      simulcast_transport_ ? simulcast_transport_->layer(0)->layout()
+                           : config_.frame_layout;
+  if (replay_->format() == TitanFileReplay::kY4m)
+    replay_source->SetFrameProvider(replay_.get());
+  else
+    replay_source->SetPayloadProvider(replay_.get(), layout);
+  AddTitanTrack(kReplayTrackId, replay_source, config_.replay_priority,
+                false);
+}
+
+void Conductor::AddTitanTrack(const std::string& id,
+                              rtc::scoped_refptr<TitanTrackSource> source,
+                              const TitanTrackPriority& priority,
+                              bool carries_transport) {
+  rtc::scoped_refptr<TitanTrack> track(new TitanTrack(id, source));
+  // Kept even if adding fails, the source has to be stopped either way.
+  titan_tracks_.push_back({source, track, priority, carries_transport});
+
+  auto result_or_error = peer_connection_->AddTrack(track, {kStreamId});
   if (!result_or_error.ok()) {
-    RTC_LOG(LS_ERROR) << "Failed to add titan track to PeerConnection: "
+    RTC_LOG(LS_ERROR) << "Failed to add titan track " << id
+                      << " to PeerConnection: "
                       << result_or_error.error().message();
   }
+}
 
-  main_wnd_->SwitchToStreamingUI();
+void Conductor::RemoveTitanTrack(const std::string& id) {
+  auto titan = std::find_if(titan_tracks_.begin(), titan_tracks_.end(),
+                            [&id](const TitanSendTrack& titan) {
+                              return titan.track->id() == id;
+                            });
+  if (titan == titan_tracks_.end() || titan->carries_transport)
+    return;
+  titan->source->Stop();
+  for (const auto& sender : peer_connection_->GetSenders()) {
+    if (sender->track() && sender->track()->id() == id) {
+      if (!peer_connection_->RemoveTrack(sender))
+        RTC_LOG(LS_ERROR) << "Failed to remove titan track " << id;
+      else
+        tracks_removed_ = true;
+      break;
+    }
+  }
+  titan_tracks_.erase(titan);
+}
+
+void Conductor::ApplyTrackPriorities() {
+  if (!peer_connection_)
+    return;
+  for (const auto& sender : peer_connection_->GetSenders()) {
+    rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> track =
+        sender->track();
+    if (!track)
+      continue;
+    for (const TitanSendTrack& titan : titan_tracks_) {
+      if (titan.track->id() != track->id())
+        continue;
+      webrtc::RtpParameters parameters = sender->GetParameters();
+      for (webrtc::RtpEncodingParameters& encoding : parameters.encodings) {
+        encoding.bitrate_priority = titan.priority.bitrate_priority;
+        if (titan.priority.max_bitrate_kbps > 0)
+          encoding.max_bitrate_bps = titan.priority.max_bitrate_kbps * 1000;
+      }
+      if (parameters.encodings.empty())
+        break;
+      webrtc::RTCError error = sender->SetParameters(parameters);
+      if (!error.ok()) {
+        RTC_LOG(LS_WARNING) << "Failed to set the priority of titan track "
+                            << track->id() << ": " << error.message();
+      }
+      break;
+    }
+  }
+}
+
+TitanTrackSource* Conductor::main_source() const {
+  if (titan_tracks_.empty())
+    return nullptr;
+  return titan_tracks_.front().source.get();
+}
+
+bool Conductor::layer_of_track(const std::string& id, size_t* layer) const {
+  size_t prefix_length = strlen(kLayerTrackPrefix);
+  if (id.compare(0, prefix_length, kLayerTrackPrefix) != 0)
+    return false;
+  *layer = strtoul(id.c_str() + prefix_length, nullptr, 10);
+  return true;
+}
+
+TitanTrackTransport* Conductor::transport_for_track(
+    const std::string& id) const {
+  if (!simulcast_transport_)
+    return track_transport_.get();
+  // The replay is packed like the first layer.
+  size_t layer = 0;
+  layer_of_track(id, &layer);
+  if (layer >= simulcast_transport_->layer_count())
+    return nullptr;
+  return simulcast_transport_->layer(layer);
+}
+
+bool Conductor::receives_track(const std::string& id) const {
+  size_t layer = 0;
+  if (!simulcast_transport_ || received_layer_ < 0 ||
+      !layer_of_track(id, &layer)) {
+    return true;
+  }
+  return layer == static_cast<size_t>(received_layer_);
+}
+
+void Conductor::CycleReceivedLayer() {
+  if (!simulcast_transport_)
+    return;
+  // All of them, then each on its own.
+  ++received_layer_;
+  if (received_layer_ >=
+      static_cast<int>(simulcast_transport_->layer_count())) {
+    received_layer_ = -1;
+  }
+  if (received_layer_ < 0)
+    RTC_LOG(INFO) << "Receiving the transport from all layers";
+  else
+    RTC_LOG(INFO) << "Receiving the transport from layer " << received_layer_;
+  // Only the sinks move, the layers keep arriving, so switching back is
+  // instant.
+  for (const auto& track : remote_titan_tracks_) {
+    TitanTrackTransport* transport = transport_for_track(track->id());
+    if (!transport)
+      continue;
+    if (receives_track(track->id()))
+      track->AddOrUpdateSink(transport, rtc::VideoSinkWants());
+    else
+      track->RemoveSink(transport);
+  }
+}
+
+void Conductor::AttachFrameSinks(webrtc::VideoTrackInterface* track) {
+  if (shm_sink_ && shm_sink_->mode() == TitanSharedRingSink::kI420)
+    track->AddOrUpdateSink(shm_sink_.get(), rtc::VideoSinkWants());
+  if (recorder_ && recorder_->format() == TitanRecordingSink::kY4m)
+    track->AddOrUpdateSink(recorder_.get(), rtc::VideoSinkWants());
+}
+
+void Conductor::DetachFrameSinks(webrtc::VideoTrackInterface* track) {
+  if (shm_sink_)
+    track->RemoveSink(shm_sink_.get());
+  if (recorder_)
+    track->RemoveSink(recorder_.get());
+}
+
+void Conductor::OnIceConnectionState(
+    webrtc::PeerConnectionInterface::IceConnectionState state) {
+  if (!peer_connection_)
+    return;
+  switch (state) {
+    case webrtc::PeerConnectionInterface::kIceConnectionConnected:
+    case webrtc::PeerConnectionInterface::kIceConnectionCompleted:
+      if (call_start_us_ != 0) {
+        int64_t connect_us = rtc::TimeMicros() - call_start_us_;
+        RTC_LOG(INFO) << "Connected in "
+                      << connect_us / rtc::kNumMicrosecsPerMillisec << " ms";
+        TitanMetrics::Get().ice_connect_ms.Observe(
+            connect_us / static_cast<double>(rtc::kNumMicrosecsPerMillisec));
+        call_start_us_ = 0;
+      }
+      if (connection_lost_us_ != 0) {
+        RTC_LOG(INFO) << "Connection back after "
+                      << (rtc::TimeMicros() - connection_lost_us_) /
+                             rtc::kNumMicrosecsPerMillisec
+                      << " ms";
+        connection_lost_us_ = 0;
+        SetTransportSuspended(false);
+      }
+      ice_restarts_ = 0;
+      ice_restart_pending_ = false;
+      rtc::Thread::Current()->Clear(this, MSG_ICE_RESTART_TIMEOUT);
+      break;
+
+    case webrtc::PeerConnectionInterface::kIceConnectionDisconnected:
+    case webrtc::PeerConnectionInterface::kIceConnectionFailed:
+      if (connection_lost_us_ == 0) {
+        connection_lost_us_ = rtc::TimeMicros();
+        SetTransportSuspended(true);
+      }
+      // The candidates of a restart under way may still get through.
+      if (state == webrtc::PeerConnectionInterface::kIceConnectionFailed ||
+          !ice_restart_pending_) {
+        RestartIce();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void Conductor::RestartIce() {
+  // Only the caller offers, so that the two sides don't restart at once.
+  // The callee waits for its offer, or for it to hang up.
+  if (!master || loopback_ || config_.ice_restart_attempts == 0)
+    return;
+  if (ice_restarts_ == config_.ice_restart_attempts) {
+    RTC_LOG(LS_WARNING) << "Connection lost for good after " << ice_restarts_
+                        << " ICE restarts";
+    DisconnectFromCurrentPeer();
+    return;
+  }
+  // Whichever way this attempt goes, it gets another look if the connection
+  // isn't back in time; ICE may not change state again by itself.
+  rtc::Thread::Current()->Clear(this, MSG_ICE_RESTART_TIMEOUT);
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kIceRestartTimeoutMs,
+                                      this, MSG_ICE_RESTART_TIMEOUT);
+  if (peer_connection_->signaling_state() !=
+      webrtc::PeerConnectionInterface::kStable) {
+    // Still negotiating, the new description will bring new candidates.
+    return;
+  }
+  ++ice_restarts_;
+  ice_restart_pending_ = true;
+  TitanMetrics::Get().ice_restarts.fetch_add(1, std::memory_order_relaxed);
+  RTC_LOG(INFO) << "Restarting ICE, attempt " << ice_restarts_;
+  webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+  options.ice_restart = true;
+  CreateOffer(options);
+}
+
+void Conductor::OnMessage(rtc::Message* msg) {
+  RTC_DCHECK_EQ(msg->message_id, MSG_ICE_RESTART_TIMEOUT);
+  if (!peer_connection_ || connection_lost_us_ == 0)
+    return;
+  RTC_LOG(LS_WARNING) << "ICE restart made no progress in "
+                      << kIceRestartTimeoutMs << " ms";
+  ice_restart_pending_ = false;
+  RestartIce();
+}
+
+void Conductor::SetTransportSuspended(bool suspended) {
+  // The data channels ride on SCTP, which retransmits whatever the
+  // connection lost by itself.
+  if (simulcast_transport_) {
+    if (suspended)
+      simulcast_transport_->Suspend();
+    else
+      simulcast_transport_->Resume();
+  }
+  if (track_transport_) {
+    if (suspended)
+      track_transport_->Suspend();
+    else
+      track_transport_->Resume();
+  }
+}
+
+void Conductor::MaybeNegotiate() {
+  if (!peer_connection_ || loopback_ || peer_id_ == -1)
+    return;
+  int needed = renegotiations_needed_;
+  if (needed == renegotiations_offered_)
+    return;
+
+  if (!master) {
+    renegotiations_offered_ = needed;
+    // Tracks of our own only get m-lines once the caller offers them.
+    int video_tracks = 0;
+    for (const auto& transceiver : peer_connection_->GetTransceivers()) {
+      if (transceiver->media_type() == cricket::MEDIA_TYPE_VIDEO &&
+          !transceiver->mid() && transceiver->sender()->track()) {
+        ++video_tracks;
+      }
+    }
+    // Everything already has its m-line, nothing to ask for.
+    if (video_tracks == 0 && !tracks_removed_)
+      return;
+    tracks_removed_ = false;
+    Json::StyledWriter writer;
+    Json::Value jmessage;
+    jmessage[kSessionDescriptionTypeName] = kNegotiateType;
+    jmessage[kNegotiateVideoTracksName] = video_tracks;
+    SendMessage(writer.write(jmessage));
+    return;
+  }
+
+  // Whatever changes meanwhile goes into the next offer, once this
+  // negotiation is through.
+  if (making_offer_ || peer_connection_->signaling_state() !=
+                           webrtc::PeerConnectionInterface::kStable) {
+    return;
+  }
+  RTC_LOG(INFO) << "Renegotiating the tracks";
+  CreateOffer(webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
+}
+
+void Conductor::CreateOffer(
+    const webrtc::PeerConnectionInterface::RTCOfferAnswerOptions& options) {
+  making_offer_ = true;
+  renegotiations_offered_ = renegotiations_needed_;
+  peer_connection_->CreateOffer(this, options);
+}
+
+void Conductor::OnNegotiationRequest(int video_tracks) {
+  if (!master) {
+    RTC_LOG(WARNING) << "Negotiation request from the caller";
+    return;
+  }
+  // Receive-only m-lines, which the callee's tracks are matched with.
+  int receiving = 0;
+  for (const auto& transceiver : peer_connection_->GetTransceivers()) {
+    if (transceiver->media_type() == cricket::MEDIA_TYPE_VIDEO &&
+        !transceiver->mid() && !transceiver->sender()->track()) {
+      ++receiving;
+    }
+  }
+  // New transceivers ask for the offer by themselves.
+  if (receiving >= video_tracks) {
+    // Removed tracks of the callee need an offer just as well.
+    ++renegotiations_needed_;
+  }
+  webrtc::RtpTransceiverInit init;
+  init.direction = webrtc::RtpTransceiverDirection::kRecvOnly;
+  for (; receiving < video_tracks; ++receiving)
+    peer_connection_->AddTransceiver(cricket::MEDIA_TYPE_VIDEO, init);
+  MaybeNegotiate();
+}
+
+void Conductor::OnRemoteTrackRemoved(
+    webrtc::MediaStreamTrackInterface* track) {
+  auto remote = std::find_if(
+      remote_titan_tracks_.begin(), remote_titan_tracks_.end(),
+      [track](const rtc::scoped_refptr<webrtc::VideoTrackInterface>& remote) {
+        return remote.get() == track;
+      });
+  if (remote == remote_titan_tracks_.end())
+    return;
+  rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track = *remote;
+  remote_titan_tracks_.erase(remote);
+  TitanTrackTransport* transport = transport_for_track(video_track->id());
+  if (transport)
+    video_track->RemoveSink(transport);
+  if (remote_frame_track_ != video_track)
+    return;
+
+  // The frames come from one of the remaining tracks from now on.
+  DetachFrameSinks(remote_frame_track_);
+  main_wnd_->StopRemoteRenderer();
+  remote_frame_track_ = nullptr;
+  if (!remote_titan_tracks_.empty()) {
+    remote_frame_track_ = remote_titan_tracks_.front();
+    AttachFrameSinks(remote_frame_track_);
+    main_wnd_->StartRemoteRenderer(
+        static_cast<TitanTrackInterface*>(remote_frame_track_.get()));
+  }
 }
 
 void Conductor::DisconnectFromCurrentPeer() {
@@ -506,8 +1324,10 @@ void Conductor::UIThreadCallback(int msg_id, void* data) {
         msg = pending_messages_.front();
         pending_messages_.pop_front();
 
+        message_send_start_us_ = rtc::TimeMicros();
         if (!client_->SendToPeer(peer_id_, *msg) && peer_id_ != -1) {
           RTC_LOG(LS_ERROR) << "SendToPeer failed";
+          message_send_start_us_ = 0;
           DisconnectFromServer();
         }
         delete msg;
@@ -523,15 +1343,51 @@ void Conductor::UIThreadCallback(int msg_id, void* data) {
       auto* track = reinterpret_cast<webrtc::MediaStreamTrackInterface*>(data);
       if (track->kind() == webrtc::MediaStreamTrackInterface::kVideoKind) {
         auto* video_track = static_cast<TitanTrackInterface*>(track);
-        main_wnd_->StartRemoteRenderer(video_track);
+        remote_titan_tracks_.push_back(video_track);
+        TitanTrackTransport* transport =
+            transport_for_track(video_track->id());
+        if (transport && receives_track(video_track->id()))
+          video_track->AddOrUpdateSink(transport, rtc::VideoSinkWants());
+        if (!remote_frame_track_ || video_track->id() == kReplayTrackId) {
+          if (remote_frame_track_)
+            DetachFrameSinks(remote_frame_track_);
+          remote_frame_track_ = video_track;
+          AttachFrameSinks(remote_frame_track_);
+          main_wnd_->StartRemoteRenderer(video_track);
+        }
+      } else if (track->kind() ==
+                     webrtc::MediaStreamTrackInterface::kAudioKind &&
+                 audio_transport_ && !remote_audio_track_) {
+        remote_audio_track_ = static_cast<webrtc::AudioTrackInterface*>(track);
+        remote_audio_track_->AddSink(audio_transport_.get());
       }
       track->Release();
       break;
     }
 
+    case SIGNALING_STABLE:
+      ApplyTrackPriorities();
+      MaybeNegotiate();
+      break;
+
+    case RENEGOTIATION_NEEDED:
+      MaybeNegotiate();
+      break;
+
+    case FILL_CONNECTION_POOL:
+      FillConnectionPool();
+      break;
+
+    case ICE_CONNECTION_CHANGE:
+      OnIceConnectionState(
+          static_cast<webrtc::PeerConnectionInterface::IceConnectionState>(
+              reinterpret_cast<intptr_t>(data)));
+      break;
+
     case TRACK_REMOVED: {
       // Remote peer stopped sending a track.
       auto* track = reinterpret_cast<webrtc::MediaStreamTrackInterface*>(data);
+      OnRemoteTrackRemoved(track);
       track->Release();
       break;
     }
@@ -542,12 +1398,60 @@ void Conductor::UIThreadCallback(int msg_id, void* data) {
   }
 }
 
-void Conductor::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
-  peer_connection_->SetLocalDescription(
-      DummySetSessionDescriptionObserver::Create(), desc);
+void Conductor::OnCollectMetrics(std::string* out) {
+  static const char* const kStateNames[] = {
+      "NOT_CONNECTED", "RESOLVING",           "SIGNING_IN",
+      "CONNECTED",     "SIGNING_OUT_WAITING", "SIGNING_OUT",
+  };
+  AppendMetricHeader(out, "titan_signaling_state",
+                     "Current state of the signaling client.", "gauge");
+  for (size_t i = 0; i < arraysize(kStateNames); ++i) {
+    std::string labels = std::string("state=\"") + kStateNames[i] + "\"";
+    AppendMetricValue(out, "titan_signaling_state",
+                      client_->state() == static_cast<int>(i) ? 1 : 0,
+                      labels.c_str());
+  }
 
+  AppendMetricHeader(out, "titan_signaling_pending_messages",
+                     "Messages waiting to be sent to the signaling server.",
+                     "gauge");
+  AppendMetricValue(out, "titan_signaling_pending_messages",
+                    static_cast<double>(pending_messages_.size()));
+
+  AppendMetricHeader(out, "titan_signaling_peers",
+                     "Peers currently known to the signaling server.",
+                     "gauge");
+  AppendMetricValue(out, "titan_signaling_peers",
+                    static_cast<double>(client_->peers().size()));
+
+  AppendMetricHeader(out, "titan_peer_connection_active",
+                     "Whether a PeerConnection is currently open.", "gauge");
+  AppendMetricValue(out, "titan_peer_connection_active",
+                    connection_active() ? 1 : 0);
+}
+
+void Conductor::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
+  making_offer_ = false;
   std::string sdp;
   desc->ToString(&sdp);
+  if (config_.minimize_sdp) {
+    std::string minimized = MinimizeTitanSdp(sdp, config_.sdp_profile);
+    webrtc::SdpParseError error;
+    std::unique_ptr<webrtc::SessionDescriptionInterface> session_description =
+        webrtc::CreateSessionDescription(desc->GetType(), minimized, &error);
+    if (session_description) {
+      RTC_LOG(INFO) << "Minimized the SDP from " << sdp.size() << " to "
+                    << minimized.size() << " bytes";
+      delete desc;
+      desc = session_description.release();
+      sdp.swap(minimized);
+    } else {
+      RTC_LOG(WARNING) << "Can't parse the minimized SDP, sending it whole. "
+                       << "SdpParseError was: " << error.description;
+    }
+  }
+  peer_connection_->SetLocalDescription(
+      DummySetSessionDescriptionObserver::Create(), desc);
 
   // For loopback test. To save some connecting delay.
   if (loopback_) {
@@ -570,6 +1474,7 @@ void Conductor::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
 
 void Conductor::OnFailure(const std::string& error) {
   RTC_LOG(LERROR) << error;
+  making_offer_ = false;
 }
 
 void Conductor::SendMessage(const std::string& json_object) {
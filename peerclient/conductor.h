@@ -11,6 +11,7 @@
 #ifndef EXAMPLES_PEERCONNECTION_CLIENT_CONDUCTOR_H_
 #define EXAMPLES_PEERCONNECTION_CLIENT_CONDUCTOR_H_
 
+#include <atomic>
 #include <deque>
 #include <map>
 #include <memory>
@@ -19,8 +20,28 @@
 
 #include "api/mediastreaminterface.h"
 #include "api/peerconnectioninterface.h"
+#include "rtc_base/messagehandler.h"
+#include "rtc_base/network_constants.h"
+#include "rtc_base/rtccertificate.h"
 #include "main_wnd.h"
+#include "metrics_server.h"
 #include "peer_connection_client.h"
+#include "TitanAudioSource.h"
+#include "TitanAudioTransport.h"
+#include "TitanCompression.h"
+#include "TitanDataChannelTransport.h"
+#include "TitanEncoderFeedback.h"
+#include "TitanFrameCodec.h"
+#include "TitanFileReplay.h"
+#include "TitanIngest.h"
+#include "TitanMediaTrackInterface.h"
+#include "TitanRecordingSink.h"
+#include "TitanSdp.h"
+#include "TitanSharedRingSink.h"
+#include "TitanSimulcastTransport.h"
+#include "TitanStatsCollector.h"
+#include "TitanTrackTransport.h"
+#include "TitanTransportBenchmark.h"
 
 namespace webrtc {
 class VideoCaptureModule;
@@ -30,11 +51,108 @@ namespace cricket {
 class VideoRenderer;
 }  // namespace cricket
 
+// Runtime settings of the conductor, filled from the command line flags.
+struct ConductorConfig {
+  enum AudioMode {
+    // Microphone audio, as in a regular call.
+    kAudioDevice,
+    // Audio track carrying small messages, see TitanAudioTransport.
+    kAudioTitan,
+    // No audio track at all, for data-only calls.
+    kAudioNone,
+  };
+
+  // Interval between RTCStats samples in milliseconds; 0 disables sampling.
+  int stats_interval_ms = 0;
+  // Number of samples kept in the stats ring buffer.
+  size_t stats_capacity = 600;
+  // File the stats ring buffer is dumped to as JSON; empty disables it.
+  std::string stats_dump_path;
+  // Local port serving Prometheus metrics; 0 disables the endpoint.
+  int metrics_port = 0;
+  // Backend carrying Titan messages between the peers.
+  TitanTransport::Mode transport_mode = TitanTransport::kTitanTrack;
+  // How messages are packed into frames in kTitanTrack mode.
+  TitanFrameLayout frame_layout;
+  // Data frames per parity frame of the Titan track, 0 disables FEC.
+  int fec_group = 0;
+  // Layers the kTitanTrack transport is sent on instead of a single track
+  // with the settings above; empty disables simulcast.
+  std::vector<TitanSimulcastLayer> simulcast_layers;
+  // The one layer the transport is received from, -1 for whichever
+  // delivers first.
+  int simulcast_receive_layer = -1;
+  // Interval between frames of the Titan track in milliseconds.
+  int frame_interval_ms = 1000;
+  // What the audio track, if any, carries.
+  AudioMode audio_mode = kAudioDevice;
+  // Connections created ahead of time, so that a call doesn't wait for one.
+  size_t connection_pool_size = 0;
+  // Candidates every connection gathers before it is used, see
+  // RTCConfiguration::ice_candidate_pool_size.
+  int ice_candidate_pool_size = 0;
+  // ICE restarts the caller tries once the connection is lost before it
+  // hangs up, each given a few seconds to bring it back; 0 leaves a lost
+  // connection alone.
+  int ice_restart_attempts = 3;
+  // For peers on the same network or host: no STUN server, host candidates
+  // only, and connectivity checks paced for LAN round trips.
+  bool lan_mode = false;
+  // rtc::AdapterType bits of the interfaces that gather no candidates.
+  int network_ignore_mask = rtc::ADAPTER_TYPE_LOOPBACK;
+  // Strip offers and answers down to |sdp_profile|, see MinimizeTitanSdp().
+  bool minimize_sdp = false;
+  TitanSdpProfile sdp_profile;
+  // Bytes a transport accepts before Send() starts pushing back.
+  size_t transport_max_buffered_bytes = 1024 * 1024;
+  // Compress messages ahead of the transport, see TitanCompressedTransport.
+  bool compress = false;
+  // Length of the loopback transport benchmark; 0 disables it.
+  int benchmark_duration_ms = 0;
+  // Size of the messages the benchmark sends.
+  size_t benchmark_message_size = 1024;
+  // Benchmark the audio lane instead of the main transport.
+  bool benchmark_audio = false;
+  // Name of the shared memory ring received data is exported to; empty
+  // disables the export.
+  std::string shm_name;
+  // Whether the ring gets transport messages or decoded frames.
+  TitanSharedRingSink::Mode shm_mode = TitanSharedRingSink::kPayload;
+  uint32_t shm_slots = 32;
+  uint32_t shm_slot_size = 512 * 1024;
+  // Input other processes send messages through, see
+  // CreateTitanIngestInput(); empty disables ingestion.
+  std::string ingest;
+  // File replayed on a Titan track of its own, next to the one carrying the
+  // transport, see TitanFileReplay; empty disables the replay.
+  std::string replay_path;
+  bool replay_loop = false;
+  // Frames per second of the replay. 0 uses the rate stored in a Y4M file,
+  // or |frame_interval_ms| if there is none.
+  double replay_fps = 0.0;
+  // File received data is recorded to; empty disables recording.
+  std::string record_path;
+  TitanRecordingSink::Format record_format = TitanRecordingSink::kY4m;
+  // How the Titan source reacts to the encoder falling behind.
+  TitanBackpressure backpressure;
+  // Bandwidth shares of the Titan track carrying the transport and of the
+  // one carrying the replay.
+  TitanTrackPriority track_priority;
+  TitanTrackPriority replay_priority;
+};
+
+// Parses a comma separated list of interface types candidates are gathered
+// on (ethernet, wifi, cellular, vpn, loopback) into the mask of those that
+// are ignored.
+bool ParseNetworkIgnoreMask(const char* types, int* mask);
+
 class Conductor
   : public webrtc::PeerConnectionObserver,
     public webrtc::CreateSessionDescriptionObserver,
     public PeerConnectionClientObserver,
-    public MainWndCallback {
+    public MainWndCallback,
+    public MetricsServerObserver,
+    public rtc::MessageHandler {
  public:
   enum CallbackID {
     MEDIA_CHANNELS_INITIALIZED = 1,
@@ -42,9 +160,14 @@ class Conductor
     SEND_MESSAGE_TO_PEER,
     NEW_TRACK_ADDED,
     TRACK_REMOVED,
+    SIGNALING_STABLE,
+    FILL_CONNECTION_POOL,
+    ICE_CONNECTION_CHANGE,
+    RENEGOTIATION_NEEDED,
   };
 
-  Conductor(PeerConnectionClient* client, MainWindow* main_wnd);
+  Conductor(SignalingClient* client, MainWindow* main_wnd,
+            const ConductorConfig& config = ConductorConfig());
 
   bool connection_active() const;
 
@@ -52,12 +175,64 @@ class Conductor
 
  protected:
   ~Conductor();
+  bool CreatePeerConnectionFactory();
   bool InitializePeerConnection();
   bool ReinitializePeerConnectionForLoopback();
+  // Sets |peer_connection_|, taken from the pool if there is one left.
   bool CreatePeerConnection(bool dtls);
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> NewPeerConnection(
+      bool dtls);
+  // Creates connections until ConductorConfig::connection_pool_size are
+  // idle.
+  void FillConnectionPool();
   void DeletePeerConnection();
   void EnsureStreamingUI();
   void AddTracks();
+  void AddReplayTrack();
+  void AddTitanTrack(const std::string& id,
+                     rtc::scoped_refptr<TitanTrackSource> source,
+                     const TitanTrackPriority& priority,
+                     bool carries_transport);
+  // Stops and removes a Titan track that doesn't carry the transport.
+  void RemoveTitanTrack(const std::string& id);
+  // Sets the encoding parameters of the Titan senders. They only take once
+  // the senders have been negotiated.
+  void ApplyTrackPriorities();
+  // Holds the transport back while the connection is lost, and restarts ICE
+  // instead of tearing the call down.
+  void OnIceConnectionState(
+      webrtc::PeerConnectionInterface::IceConnectionState state);
+  void RestartIce();
+  // See TitanTrackTransport::Suspend().
+  void SetTransportSuspended(bool suspended);
+  // Negotiates the changes to the tracks made since the last offer, once
+  // the previous negotiation is through. Only the caller makes offers; the
+  // callee, lacking a way to roll an offer of its own back, asks it for one
+  // instead, so that offers never cross.
+  void MaybeNegotiate();
+  void CreateOffer(
+      const webrtc::PeerConnectionInterface::RTCOfferAnswerOptions& options);
+  // The callee asked for an offer, with m-lines for |video_tracks| new
+  // tracks of its own.
+  void OnNegotiationRequest(int video_tracks);
+  void OnRemoteTrackRemoved(webrtc::MediaStreamTrackInterface* track);
+  // The source of the (first) track carrying the transport, if any.
+  TitanTrackSource* main_source() const;
+  // The simulcast layer the remote Titan track |id| carries; false for
+  // tracks that aren't layers.
+  bool layer_of_track(const std::string& id, size_t* layer) const;
+  // The track transport the frames of the remote Titan track |id| go to.
+  TitanTrackTransport* transport_for_track(const std::string& id) const;
+  // Whether they go there, see ConductorConfig::simulcast_receive_layer.
+  bool receives_track(const std::string& id) const;
+  void AttachFrameSinks(webrtc::VideoTrackInterface* track);
+  void DetachFrameSinks(webrtc::VideoTrackInterface* track);
+  void CreateTransport();
+  // The transport selected by ConductorConfig::transport_mode, if any.
+  TitanTransport* main_transport() const;
+  void DeleteTransport();
+  void CreateDataChannel();
+  void MaybeStartBenchmark();
   std::unique_ptr<cricket::VideoCapturer> OpenVideoCaptureDevice();
 
   //
@@ -65,7 +240,7 @@ class Conductor
   //
 
   void OnSignalingChange(
-      webrtc::PeerConnectionInterface::SignalingState new_state) override{};
+      webrtc::PeerConnectionInterface::SignalingState new_state) override;
   void OnAddTrack(
       rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver,
       const std::vector<rtc::scoped_refptr<webrtc::MediaStreamInterface>>&
@@ -73,10 +248,10 @@ class Conductor
   void OnRemoveTrack(
       rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver) override;
   void OnDataChannel(
-      rtc::scoped_refptr<webrtc::DataChannelInterface> channel) override {}
-  void OnRenegotiationNeeded() override {}
+      rtc::scoped_refptr<webrtc::DataChannelInterface> channel) override;
+  void OnRenegotiationNeeded() override;
   void OnIceConnectionChange(
-      webrtc::PeerConnectionInterface::IceConnectionState new_state) override{};
+      webrtc::PeerConnectionInterface::IceConnectionState new_state) override;
   void OnIceGatheringChange(
       webrtc::PeerConnectionInterface::IceGatheringState new_state) override{};
   void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
@@ -90,7 +265,7 @@ class Conductor
 
   void OnDisconnected() override;
 
-  void OnPeerConnected(int id, const std::string& name) override;
+  void OnRosterChanged(const RosterDelta& delta) override;
 
   void OnPeerDisconnected(int id) override;
 
@@ -114,26 +289,111 @@ class Conductor
 
   void UIThreadCallback(int msg_id, void* data) override;
 
+  void ToggleReplay() override;
+
+  void ChangeTrackPriority(bool raise) override;
+
+  void CycleReceivedLayer() override;
+
+  // MetricsServerObserver implementation.
+  void OnCollectMetrics(std::string* out) override;
+
   // CreateSessionDescriptionObserver implementation.
   void OnSuccess(webrtc::SessionDescriptionInterface* desc) override;
   void OnFailure(const std::string& error) override;
 
+  // MessageHandler implementation, gives a stalled ICE restart another go.
+  void OnMessage(rtc::Message* msg) override;
+
  protected:
   // Send a message to the remote peer.
   void SendMessage(const std::string& json_object);
 
   int peer_id_;
   bool loopback_;
+  // Shared by the encoders of every connection, so declared first to outlive
+  // them.
+  TitanEncoderFeedback encoder_feedback_;
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
+  // Created once and kept until Close().
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
       peer_connection_factory_;
-  PeerConnectionClient* client_;
+  rtc::scoped_refptr<rtc::RTCCertificate> certificate_;
+  // Connections created ahead of the calls that will use them. An idle
+  // connection has no tracks nor descriptions, so it raises no events that
+  // could be mistaken for those of |peer_connection_|.
+  std::deque<rtc::scoped_refptr<webrtc::PeerConnectionInterface>>
+      idle_connections_;
+  SignalingClient* client_;
   MainWindow* main_wnd_;
   std::deque<std::string*> pending_messages_;
   std::string server_;
-
+  const ConductorConfig config_;
+  std::unique_ptr<TitanStatsCollector> stats_collector_;
+  std::unique_ptr<MetricsServer> metrics_server_;
+  // When the message currently being sent was handed to the client.
+  int64_t message_send_start_us_;
+  // Only one of the transports exists, depending on the configured mode.
+  std::unique_ptr<TitanTrackTransport> track_transport_;
+  std::unique_ptr<TitanSimulcastTransport> simulcast_transport_;
+  std::unique_ptr<TitanDataChannelTransport> data_channel_transport_;
+  // In front of whichever of the above is in use, if enabled.
+  std::unique_ptr<TitanCompressedTransport> compressed_transport_;
+  // A Titan track this side sends.
+  struct TitanSendTrack {
+    rtc::scoped_refptr<TitanTrackSource> source;
+    rtc::scoped_refptr<TitanTrack> track;
+    TitanTrackPriority priority;
+    bool carries_transport;
+  };
+  // The tracks carrying the transport, one per simulcast layer, come first,
+  // then the replay, if any.
+  std::vector<TitanSendTrack> titan_tracks_;
+  // Remote Titan tracks, each attached to transport_for_track() as a sink
+  // unless receives_track() says otherwise.
+  std::vector<rtc::scoped_refptr<webrtc::VideoTrackInterface>>
+      remote_titan_tracks_;
+  // See ConductorConfig::simulcast_receive_layer, changed by
+  // CycleReceivedLayer().
+  int received_layer_ = -1;
+  // The one the shared ring and the recording get frames from: the replay
+  // if the peer sends one, else the first track.
+  rtc::scoped_refptr<webrtc::VideoTrackInterface> remote_frame_track_;
+  // Audio lane, only with ConductorConfig::kAudioTitan.
+  std::unique_ptr<TitanAudioTransport> audio_transport_;
+  rtc::scoped_refptr<TitanAudioSource> audio_source_;
+  rtc::scoped_refptr<webrtc::AudioTrackInterface> remote_audio_track_;
+  std::unique_ptr<TitanTransportBenchmark> benchmark_;
+  // Outlives single connections so that readers can stay attached.
+  std::unique_ptr<TitanSharedRingSink> shm_sink_;
+  // Like |shm_sink_| the input stays open between connections, a producer
+  // simply waits while there is no call.
+  std::unique_ptr<TitanIngestInput> ingest_input_;
+  std::unique_ptr<TitanIngest> ingest_;
+  // Opened anew for every connection, so each call replays from the start.
+  std::unique_ptr<TitanFileReplay> replay_;
+  // Spans all calls, like |shm_sink_|.
+  std::unique_ptr<TitanRecordingSink> recorder_;
+  // Whoever wants the messages of the main transport.
+  std::unique_ptr<TitanTransportFanout> transport_observers_;
 
   bool master = false;
+  // When the connection was lost, 0 while it is up.
+  int64_t connection_lost_us_ = 0;
+  // ICE restarts since the connection was last up.
+  int ice_restarts_ = 0;
+  // Set from the restart offer until the connection is back.
+  bool ice_restart_pending_ = false;
+  // Bumped whenever the tracks changed; compared with the count at the last
+  // offer to know whether another one is due.
+  std::atomic<int> renegotiations_needed_{0};
+  int renegotiations_offered_ = 0;
+  // From CreateOffer() until the offer is the local description.
+  bool making_offer_ = false;
+  // The callee removed a track since it last asked for an offer.
+  bool tracks_removed_ = false;
+  // When the current call started, 0 once it connected.
+  int64_t call_start_us_ = 0;
 };
 
 #endif  // EXAMPLES_PEERCONNECTION_CLIENT_CONDUCTOR_H_
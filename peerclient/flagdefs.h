@@ -25,8 +25,102 @@ DEFINE_bool(autoconnect, false, "Connect to the server without user "
 DEFINE_string(server, "localhost", "The server to connect to.");
 DEFINE_int(port, kDefaultServerPort,
            "The port on which the server is listening.");
+DEFINE_string(shards, "", "Comma separated <host>[:<port>] of further "
+  "signaling servers to sign in to along with --server, whose peers are "
+  "listed with those of --server. A missing port is the default one.");
 DEFINE_bool(autocall, false, "Call the first available other client on "
   "the server without user intervention.  Note: this flag should only be set "
   "to true on one of the two clients.");
+DEFINE_int(stats_interval, 0, "Interval in milliseconds at which RTCStats are "
+  "sampled. 0 disables the stats collector.");
+DEFINE_string(stats_dump, "", "File the collected stats are written to as "
+  "JSON when the call ends.");
+DEFINE_int(metrics_port, 0, "Local port on which Prometheus metrics are "
+  "served. 0 disables the metrics endpoint.");
+DEFINE_string(transport, "titan", "Transport carrying Titan messages: titan, "
+  "datachannel or datachannel-unreliable.");
+DEFINE_string(audio, "device", "Audio track to send: device (microphone), "
+  "titan (lane for small messages) or none for a data-only call.");
+DEFINE_int(frame_interval, 1000, "Interval in milliseconds between frames of "
+  "the Titan track.");
+DEFINE_int(block_size, 8, "Side in pixels of the blocks a Titan frame packs "
+  "one symbol into.");
+DEFINE_int(bits_per_symbol, 1, "Bits packed into every block of a Titan "
+  "frame: 1, 2 or 4.");
+DEFINE_int(fec_group, 0, "Data frames of the Titan track followed by a "
+  "parity frame that can rebuild any one of them, 0 disables FEC.");
+DEFINE_string(simulcast, "", "Send the Titan transport on several tracks at "
+  "once, one per layer given as <block_size>:<bits_per_symbol>:<fec_group>, "
+  "comma separated from robust to dense, e.g. 16:1:2,8:2:0. The receiver "
+  "needs the same layers.");
+DEFINE_int(simulcast_receive, -1, "The one simulcast layer the transport is "
+  "received from, counted from 0; -1 takes whichever layer delivers first. "
+  "L switches layers during a call.");
+DEFINE_int(benchmark_duration, 0, "Length in milliseconds of the transport "
+  "benchmark run in loopback calls. 0 disables the benchmark.");
+DEFINE_int(benchmark_message_size, 1024, "Size in bytes of the messages the "
+  "transport benchmark sends.");
+DEFINE_bool(benchmark_audio, false, "Benchmark the titan audio lane instead "
+  "of the main transport.");
+DEFINE_bool(microbenchmark, false, "Time signaling parsing, the JSON "
+  "messages and Titan frame building and receiving in isolation, print the "
+  "results and exit.");
+DEFINE_string(microbenchmark_filter, "", "Runs only the microbenchmark cases "
+  "whose name contains this, e.g. frame/ or 1280x720.");
+DEFINE_int(microbenchmark_time, 500, "Minimum time in milliseconds each "
+  "microbenchmark case runs.");
+DEFINE_string(shm_name, "", "Name of a shared memory ring that received data "
+  "is exported to for other processes. Empty disables the export.");
+DEFINE_string(shm_mode, "payload", "What the shared memory ring carries: "
+  "payload (transport messages) or i420 (decoded frames).");
+DEFINE_int(shm_slots, 32, "Number of slots in the shared memory ring.");
+DEFINE_int(shm_slot_size, 512 * 1024, "Size in bytes of each slot of the "
+  "shared memory ring.");
+DEFINE_string(ingest, "", "Input other processes send messages through: "
+  "shm:<name> for a flow controlled shared memory ring, or pipe:<name> for "
+  "length prefixed messages over a named pipe (a Unix socket on POSIX).");
+DEFINE_string(replay, "", "File replayed on a Titan track of its own, next "
+  "to the transport: a Y4M file is sent as video, anything else as raw "
+  "bytes.");
+DEFINE_bool(replay_loop, false, "Start the replay over at the end of the "
+  "file.");
+DEFINE_float(replay_fps, 0, "Frames per second of the replay. 0 uses the "
+  "rate of a Y4M file, or --frame_interval.");
+DEFINE_string(backpressure, "latest", "What the Titan source does when the "
+  "encoder falls behind: latest (let it skip stale frames), block (hold the "
+  "payload back) or queue (queue frames, dropping the oldest).");
+DEFINE_int(max_encoder_pending, 2, "Frames waiting for the encoder at which "
+  "it counts as behind.");
+DEFINE_int(backpressure_queue, 4, "Frames the queue backpressure policy "
+  "holds.");
+DEFINE_string(track_priority, "high", "Bandwidth share of the Titan track "
+  "carrying the transport: very-low, low, medium, high or a number.");
+DEFINE_int(track_max_bitrate, 0, "Cap on the bitrate of the Titan track "
+  "carrying the transport in kbps, 0 for none.");
+DEFINE_string(replay_priority, "very-low", "Bandwidth share of the replay "
+  "track, like --track_priority.");
+DEFINE_int(replay_max_bitrate, 0, "Cap on the bitrate of the replay track in "
+  "kbps, 0 for none.");
+DEFINE_int(connection_pool_size, 0, "PeerConnections created ahead of the "
+  "calls that will use them, so that a call doesn't wait for one.");
+DEFINE_int(ice_candidate_pool_size, 0, "ICE candidates every PeerConnection "
+  "gathers before it is used.");
+DEFINE_int(ice_restart_attempts, 3, "ICE restarts the caller tries after the "
+  "connection was lost before it hangs up. 0 leaves a lost connection "
+  "alone.");
+DEFINE_bool(lan, false, "Connect peers on the same network or host without "
+  "a STUN server, using host candidates and fast connectivity checks.");
+DEFINE_string(ice_interfaces, "", "Comma separated interface types "
+  "candidates are gathered on: ethernet, wifi, cellular, vpn, loopback. "
+  "Empty uses all but loopback.");
+DEFINE_bool(minimal_sdp, false, "Offer and answer only what the Titan session "
+  "uses: one video and one audio codec with its RTX, and the header "
+  "extensions for bundling and bandwidth estimation.");
+DEFINE_string(sdp_video_codec, "VP8", "Video codec --minimal_sdp keeps.");
+DEFINE_bool(compress, false, "Compress Titan messages before they are sent "
+  "and decompress them on arrival. Both peers need to set it.");
+DEFINE_string(record, "", "File everything received is recorded to.");
+DEFINE_string(record_format, "y4m", "What --record writes: y4m (decoded "
+  "remote video) or raw (transport messages, appended as they are).");
 
 #endif  // EXAMPLES_PEERCONNECTION_CLIENT_FLAGDEFS_H_
@@ -8,10 +8,14 @@
  *  be found in the AUTHORS file in the root of the source tree.
  */
 #include "pch.h"
+#include <string.h>
+
+#include "TitanMicrobenchmark.h"
 #include "conductor.h"
 #include "flagdefs.h"
 #include "main_wnd.h"
 #include "peer_connection_client.h"
+#include "sharded_signaling_client.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/ssladapter.h"
 #include "rtc_base/win32socketinit.h"
@@ -38,16 +42,173 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  if (FLAG_microbenchmark) {
+    if (FLAG_microbenchmark_time < 1) {
+      printf("Error: %i is not a valid microbenchmark time.\n",
+             FLAG_microbenchmark_time);
+      return -1;
+    }
+    int ran = RunTitanMicrobenchmarks(FLAG_microbenchmark_filter,
+                                      FLAG_microbenchmark_time);
+    return ran > 0 ? 0 : -1;
+  }
+
+  TitanTransport::Mode transport_mode;
+  if (!ParseTitanTransportMode(FLAG_transport, &transport_mode)) {
+    printf("Error: %s is not a valid transport.\n", FLAG_transport);
+    return -1;
+  }
+
+  ConductorConfig::AudioMode audio_mode;
+  if (strcmp(FLAG_audio, "device") == 0) {
+    audio_mode = ConductorConfig::kAudioDevice;
+  } else if (strcmp(FLAG_audio, "titan") == 0) {
+    audio_mode = ConductorConfig::kAudioTitan;
+  } else if (strcmp(FLAG_audio, "none") == 0) {
+    audio_mode = ConductorConfig::kAudioNone;
+  } else {
+    printf("Error: %s is not a valid audio mode.\n", FLAG_audio);
+    return -1;
+  }
+
+  TitanSharedRingSink::Mode shm_mode;
+  if (strcmp(FLAG_shm_mode, "payload") == 0) {
+    shm_mode = TitanSharedRingSink::kPayload;
+  } else if (strcmp(FLAG_shm_mode, "i420") == 0) {
+    shm_mode = TitanSharedRingSink::kI420;
+  } else {
+    printf("Error: %s is not a valid shared memory mode.\n", FLAG_shm_mode);
+    return -1;
+  }
+  if (FLAG_shm_slots < 1 || FLAG_shm_slot_size < 1) {
+    printf("Error: invalid shared memory ring settings.\n");
+    return -1;
+  }
+
+  TitanRecordingSink::Format record_format;
+  if (strcmp(FLAG_record_format, "y4m") == 0) {
+    record_format = TitanRecordingSink::kY4m;
+  } else if (strcmp(FLAG_record_format, "raw") == 0) {
+    record_format = TitanRecordingSink::kRaw;
+  } else {
+    printf("Error: %s is not a valid recording format.\n", FLAG_record_format);
+    return -1;
+  }
+
+  TitanBackpressure backpressure;
+  if (!ParseTitanBackpressurePolicy(FLAG_backpressure, &backpressure.policy) ||
+      FLAG_max_encoder_pending < 1 || FLAG_backpressure_queue < 1) {
+    printf("Error: invalid backpressure settings.\n");
+    return -1;
+  }
+  backpressure.max_pending = FLAG_max_encoder_pending;
+  backpressure.queue_size = FLAG_backpressure_queue;
+
+  TitanTrackPriority track_priority;
+  TitanTrackPriority replay_priority;
+  if (!ParseTitanBitratePriority(FLAG_track_priority,
+                                 &track_priority.bitrate_priority) ||
+      !ParseTitanBitratePriority(FLAG_replay_priority,
+                                 &replay_priority.bitrate_priority) ||
+      FLAG_track_max_bitrate < 0 || FLAG_replay_max_bitrate < 0) {
+    printf("Error: invalid Titan track priorities.\n");
+    return -1;
+  }
+  track_priority.max_bitrate_kbps = FLAG_track_max_bitrate;
+  replay_priority.max_bitrate_kbps = FLAG_replay_max_bitrate;
+
+  TitanFrameLayout frame_layout;
+  frame_layout.block_size = FLAG_block_size;
+  frame_layout.bits_per_symbol = FLAG_bits_per_symbol;
+  if (FLAG_frame_interval < 1 ||
+      !TitanTrackTransport::Supports(frame_layout, FLAG_fec_group)) {
+    printf("Error: invalid Titan frame settings.\n");
+    return -1;
+  }
+  std::vector<TitanSimulcastLayer> simulcast_layers;
+  if (strlen(FLAG_simulcast) > 0 &&
+      !ParseTitanSimulcastLayers(FLAG_simulcast, frame_layout,
+                                 &simulcast_layers)) {
+    printf("Error: invalid simulcast layers.\n");
+    return -1;
+  }
+  if (FLAG_simulcast_receive < -1 ||
+      FLAG_simulcast_receive >= static_cast<int>(simulcast_layers.size())) {
+    printf("Error: invalid simulcast layer to receive.\n");
+    return -1;
+  }
+
+  if (FLAG_connection_pool_size < 0 || FLAG_ice_candidate_pool_size < 0 ||
+      FLAG_ice_restart_attempts < 0) {
+    printf("Error: invalid PeerConnection pool settings.\n");
+    return -1;
+  }
+
+  int network_ignore_mask = rtc::ADAPTER_TYPE_LOOPBACK;
+  if (strlen(FLAG_ice_interfaces) > 0 &&
+      !ParseNetworkIgnoreMask(FLAG_ice_interfaces, &network_ignore_mask)) {
+    printf("Error: %s is not a valid list of interface types.\n",
+           FLAG_ice_interfaces);
+    return -1;
+  }
+
+  std::vector<rtc::SocketAddress> shards;
+  if (strlen(FLAG_shards) > 0 &&
+      !ParseSignalingServers(FLAG_shards, &shards)) {
+    printf("Error: %s is not a valid list of servers.\n", FLAG_shards);
+    return -1;
+  }
+
   MainWnd wnd(FLAG_server, FLAG_port, FLAG_autoconnect, FLAG_autocall);
   if (!wnd.Create()) {
     RTC_NOTREACHED();
     return -1;
   }
 
+  ConductorConfig config;
+  config.stats_interval_ms = FLAG_stats_interval;
+  config.stats_dump_path = FLAG_stats_dump;
+  config.metrics_port = FLAG_metrics_port;
+  config.transport_mode = transport_mode;
+  config.audio_mode = audio_mode;
+  config.frame_layout = frame_layout;
+  config.fec_group = FLAG_fec_group;
+  config.simulcast_layers = simulcast_layers;
+  config.simulcast_receive_layer = FLAG_simulcast_receive;
+  config.frame_interval_ms = FLAG_frame_interval;
+  config.benchmark_duration_ms = FLAG_benchmark_duration;
+  config.benchmark_message_size = FLAG_benchmark_message_size;
+  config.benchmark_audio = FLAG_benchmark_audio;
+  config.shm_name = FLAG_shm_name;
+  config.shm_mode = shm_mode;
+  config.shm_slots = FLAG_shm_slots;
+  config.shm_slot_size = FLAG_shm_slot_size;
+  config.ingest = FLAG_ingest;
+  config.replay_path = FLAG_replay;
+  config.replay_loop = FLAG_replay_loop;
+  config.replay_fps = FLAG_replay_fps;
+  config.record_path = FLAG_record;
+  config.record_format = record_format;
+  config.backpressure = backpressure;
+  config.track_priority = track_priority;
+  config.replay_priority = replay_priority;
+  config.connection_pool_size = FLAG_connection_pool_size;
+  config.ice_candidate_pool_size = FLAG_ice_candidate_pool_size;
+  config.ice_restart_attempts = FLAG_ice_restart_attempts;
+  config.lan_mode = FLAG_lan;
+  config.network_ignore_mask = network_ignore_mask;
+  config.minimize_sdp = FLAG_minimal_sdp;
+  config.compress = FLAG_compress;
+  config.sdp_profile.video_codec = FLAG_sdp_video_codec;
+
   rtc::InitializeSSL();
-  PeerConnectionClient client;
+  std::unique_ptr<SignalingClient> client;
+  if (shards.empty())
+    client.reset(new PeerConnectionClient());
+  else
+    client.reset(new ShardedSignalingClient(shards));
   rtc::scoped_refptr<Conductor> conductor(
-        new rtc::RefCountedObject<Conductor>(&client, &wnd));
+        new rtc::RefCountedObject<Conductor>(client.get(), &wnd, config));
 
   // Main loop.
   MSG msg;
@@ -59,8 +220,8 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (conductor->connection_active() || client.is_connected()) {
-    while ((conductor->connection_active() || client.is_connected()) &&
+  if (conductor->connection_active() || client->is_connected()) {
+    while ((conductor->connection_active() || client->is_connected()) &&
            (gm = ::GetMessage(&msg, NULL, 0, 0)) != 0 && gm != -1) {
       if (!wnd.PreTranslateMessage(&msg)) {
         ::TranslateMessage(&msg);
@@ -12,11 +12,17 @@
 
 #include <math.h>
 
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
 #include "api/video/i420_buffer.h"
 #include "defaults.h"
 #include "rtc_base/arraysize.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
+#include "rtc_base/timeutils.h"
+#include "TitanMetrics.h"
 #include "third_party/libyuv/include/libyuv/convert_argb.h"
 #include <iostream>
 
@@ -68,6 +74,7 @@ void AddListBoxItem(HWND listbox, const std::string& str, LPARAM item_data) {
   ::SendMessageA(listbox, LB_SETITEMDATA, index, item_data);
 }
 
+
 }  // namespace
 
 MainWnd::MainWnd(const char* server, int port, bool auto_connect,
@@ -139,6 +146,17 @@ bool MainWnd::PreTranslateMessage(MSG* msg) {
           callback_->DisconnectFromServer();
         }
       }
+    } else if (ui_ == STREAMING && callback_) {
+      if (msg->wParam == 'r' || msg->wParam == 'R') {
+        callback_->ToggleReplay();
+        ret = true;
+      } else if (msg->wParam == '+' || msg->wParam == '-') {
+        callback_->ChangeTrackPriority(msg->wParam == '+');
+        ret = true;
+      } else if (msg->wParam == 'l' || msg->wParam == 'L') {
+        callback_->CycleReceivedLayer();
+        ret = true;
+      }
     }
   } else if (msg->hwnd == NULL && msg->message == UI_THREAD_CALLBACK) {
     callback_->UIThreadCallback(static_cast<int>(msg->wParam),
@@ -165,15 +183,74 @@ void MainWnd::SwitchToPeerList(const Peers& peers) {
   ::SendMessage(listbox_, LB_RESETCONTENT, 0, 0);
 
   AddListBoxItem(listbox_, "List of currently connected peers:", -1);
-  Peers::const_iterator i = peers.begin();
-  for (; i != peers.end(); ++i)
-    AddListBoxItem(listbox_, i->second.c_str(), i->first);
+  // In the order the peers signed in, which is the order of their ids, so
+  // that --autocall picks the newest one.
+  listed_peers_.clear();
+  listed_peers_.reserve(peers.size());
+  for (const auto& peer : peers)
+    listed_peers_.push_back(peer.first);
+  std::sort(listed_peers_.begin(), listed_peers_.end());
+  for (int id : listed_peers_)
+    AddListBoxItem(listbox_, peers.at(id), id);
 
   ui_ = LIST_PEERS;
   LayoutPeerListUI(true);
   ::SetFocus(listbox_);
 
-  if (auto_call_ && peers.begin() != peers.end()) {
+  if (!peers.empty())
+    MaybeAutoCall();
+}
+
+void MainWnd::UpdatePeerList(const RosterDelta& delta) {
+  ::SendMessage(listbox_, WM_SETREDRAW, FALSE, 0);
+  if (!delta.removed.empty() || !delta.changed.empty()) {
+    // Row of every listed peer, looked up once for the whole delta.
+    std::unordered_map<int, size_t> rows;
+    rows.reserve(listed_peers_.size());
+    for (size_t i = 0; i < listed_peers_.size(); ++i)
+      rows[listed_peers_[i]] = i;
+
+    for (const auto& peer : delta.changed) {
+      auto row = rows.find(peer.first);
+      if (row == rows.end())
+        continue;
+      LRESULT index = static_cast<LRESULT>(row->second) + 1;
+      ::SendMessage(listbox_, LB_DELETESTRING, index, 0);
+      index = ::SendMessageA(listbox_, LB_INSERTSTRING, index,
+                             reinterpret_cast<LPARAM>(peer.second.c_str()));
+      ::SendMessageA(listbox_, LB_SETITEMDATA, index, peer.first);
+    }
+
+    std::vector<size_t> removed;
+    removed.reserve(delta.removed.size());
+    for (int id : delta.removed) {
+      auto row = rows.find(id);
+      if (row != rows.end())
+        removed.push_back(row->second);
+    }
+    // Last row first, so that the rows still to go keep their index.
+    std::sort(removed.begin(), removed.end(), std::greater<size_t>());
+    for (size_t row : removed) {
+      ::SendMessage(listbox_, LB_DELETESTRING, row + 1, 0);
+      listed_peers_[row] = -1;
+    }
+    listed_peers_.erase(
+        std::remove(listed_peers_.begin(), listed_peers_.end(), -1),
+        listed_peers_.end());
+  }
+  for (const auto& peer : delta.added) {
+    AddListBoxItem(listbox_, peer.second, peer.first);
+    listed_peers_.push_back(peer.first);
+  }
+  ::SendMessage(listbox_, WM_SETREDRAW, TRUE, 0);
+  ::InvalidateRect(listbox_, NULL, TRUE);
+
+  if (!delta.added.empty())
+    MaybeAutoCall();
+}
+
+void MainWnd::MaybeAutoCall() {
+  if (auto_call_) {
     // Get the number of items in the list
     LRESULT count = ::SendMessage(listbox_, LB_GETCOUNT, 0, 0);
     if (count != LB_ERR) {
@@ -487,7 +564,7 @@ void MainWnd::HandleTabbing() {
 
 MainWnd::VideoRenderer::VideoRenderer(
     HWND wnd, int width, int height, TitanTrackInterface* track_to_render)
-    : wnd_(wnd), rendered_track_(track_to_render) {
+    : wnd_(wnd), rendered_track_(track_to_render), last_frame_time_us_(0) {
   ::InitializeCriticalSection(&buffer_lock_);
   ZeroMemory(&bmi_, sizeof(bmi_));
   bmi_.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
@@ -526,6 +603,16 @@ void MainWnd::VideoRenderer::OnFrame(
 
   {
     std::cout << "OnFrame" << std::endl;
+    TitanMetrics& metrics = TitanMetrics::Get();
+    metrics.frames_received.fetch_add(1, std::memory_order_relaxed);
+    int64_t now_us = rtc::TimeMicros();
+    if (last_frame_time_us_ != 0) {
+      metrics.frame_interval_ms.Observe(
+          (now_us - last_frame_time_us_) /
+          static_cast<double>(rtc::kNumMicrosecsPerMillisec));
+    }
+    last_frame_time_us_ = now_us;
+
     AutoLock<VideoRenderer> lock(this);
 
     rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
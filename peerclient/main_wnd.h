@@ -14,6 +14,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "api/mediastreaminterface.h"
 #include "api/video/video_frame.h"
@@ -34,6 +35,13 @@ class MainWndCallback {
   virtual void DisconnectFromCurrentPeer() = 0;
   virtual void UIThreadCallback(int msg_id, void* data) = 0;
   virtual void Close() = 0;
+  // Adds or removes the replay track in the middle of a call.
+  virtual void ToggleReplay() = 0;
+  // Raises or lowers the bandwidth share of the transport tracks.
+  virtual void ChangeTrackPriority(bool raise) = 0;
+  // Takes the transport from each simulcast layer alone in turn, then from
+  // all of them again.
+  virtual void CycleReceivedLayer() = 0;
  protected:
   virtual ~MainWndCallback() {}
 };
@@ -59,6 +67,8 @@ class MainWindow {
 
   virtual void SwitchToConnectUI() = 0;
   virtual void SwitchToPeerList(const Peers& peers) = 0;
+  // Applies |delta| to the list SwitchToPeerList() shows.
+  virtual void UpdatePeerList(const RosterDelta& delta) = 0;
   virtual void SwitchToStreamingUI() = 0;
 
   virtual void StartLocalRenderer(TitanTrackInterface* local_video) = 0;
@@ -91,6 +101,7 @@ class MainWnd : public MainWindow {
   virtual bool IsWindow();
   virtual void SwitchToConnectUI();
   virtual void SwitchToPeerList(const Peers& peers);
+  virtual void UpdatePeerList(const RosterDelta& delta);
   virtual void SwitchToStreamingUI();
   virtual void MessageBox(const char* caption, const char* text,
                           bool is_error);
@@ -138,6 +149,7 @@ class MainWnd : public MainWindow {
     std::unique_ptr<uint8_t[]> image_;
     CRITICAL_SECTION buffer_lock_;
     rtc::scoped_refptr<TitanTrackInterface> rendered_track_;
+    int64_t last_frame_time_us_;
   };
 
   // A little helper class to make sure we always to proper locking and
@@ -164,6 +176,8 @@ class MainWnd : public MainWindow {
   void OnDestroyed();
 
   void OnDefaultAction();
+  // Calls the last peer in the list if --autocall is set.
+  void MaybeAutoCall();
 
   bool OnMessage(UINT msg, WPARAM wp, LPARAM lp, LRESULT* result);
 
@@ -191,6 +205,9 @@ class MainWnd : public MainWindow {
   HWND label2_;
   HWND button_;
   HWND listbox_;
+  // Ids of the peers in |listbox_|, in the order of the rows below the
+  // heading.
+  std::vector<int> listed_peers_;
   bool destroyed_;
   void* nested_msg_;
   MainWndCallback* callback_;
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "metrics_server.h"
+
+#include "TitanMetrics.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/stringutils.h"
+#include "rtc_base/thread.h"
+
+#ifdef WIN32
+#include "rtc_base/win32socketserver.h"
+#endif
+
+using rtc::sprintfn;
+
+namespace {
+
+const char kMetricsPath[] = "GET /metrics ";
+// Scrapes are tiny; anything bigger than this is not a request we serve.
+const size_t kMaxRequestSize = 8 * 1024;
+
+rtc::AsyncSocket* CreateListenSocket(int family) {
+#ifdef WIN32
+  rtc::Win32Socket* sock = new rtc::Win32Socket();
+  sock->CreateT(family, SOCK_STREAM);
+  return sock;
+#elif defined(WEBRTC_POSIX)
+  rtc::Thread* thread = rtc::Thread::Current();
+  RTC_DCHECK(thread != NULL);
+  return thread->socketserver()->CreateAsyncSocket(family, SOCK_STREAM);
+#else
+#error Platform not supported.
+#endif
+}
+
+}  // namespace
+
+MetricsServer::MetricsServer(MetricsServerObserver* observer)
+  : observer_(observer) {
+}
+
+MetricsServer::~MetricsServer() {
+  Stop();
+}
+
+bool MetricsServer::Start(int port) {
+  RTC_DCHECK(!listener_);
+  rtc::SocketAddress address(rtc::IPAddress(INADDR_LOOPBACK), port);
+  listener_.reset(CreateListenSocket(address.family()));
+  if (listener_->Bind(address) == SOCKET_ERROR ||
+      listener_->Listen(5) == SOCKET_ERROR) {
+    RTC_LOG(LS_ERROR) << "Failed to listen for metrics on "
+                      << address.ToString();
+    listener_.reset();
+    return false;
+  }
+  listener_->SignalReadEvent.connect(this, &MetricsServer::OnAccept);
+  RTC_LOG(INFO) << "Serving metrics on http://" << address.ToString()
+                << "/metrics";
+  return true;
+}
+
+void MetricsServer::Stop() {
+  connections_.clear();
+  listener_.reset();
+}
+
+void MetricsServer::OnAccept(rtc::AsyncSocket* socket) {
+  RTC_DCHECK(socket == listener_.get());
+  rtc::SocketAddress remote;
+  rtc::AsyncSocket* accepted = listener_->Accept(&remote);
+  if (!accepted)
+    return;
+
+  std::unique_ptr<Connection> connection(new Connection());
+  connection->socket.reset(accepted);
+  accepted->SignalReadEvent.connect(this, &MetricsServer::OnRead);
+  accepted->SignalWriteEvent.connect(this, &MetricsServer::OnWrite);
+  accepted->SignalCloseEvent.connect(this, &MetricsServer::OnClose);
+  connections_[accepted] = std::move(connection);
+}
+
+void MetricsServer::OnRead(rtc::AsyncSocket* socket) {
+  auto it = connections_.find(socket);
+  if (it == connections_.end())
+    return;
+  Connection* connection = it->second.get();
+
+  char buffer[1024];
+  do {
+    int bytes = socket->Recv(buffer, sizeof(buffer), nullptr);
+    if (bytes <= 0)
+      break;
+    connection->request.append(buffer, bytes);
+  } while (connection->request.size() < kMaxRequestSize);
+
+  if (!connection->response.empty())
+    return;  // Already answering.
+
+  if (connection->request.find("\r\n\r\n") == std::string::npos &&
+      connection->request.size() < kMaxRequestSize) {
+    return;  // Wait for the rest of the headers.
+  }
+
+  connection->response = BuildResponse(connection->request);
+  Flush(connection);
+}
+
+void MetricsServer::OnWrite(rtc::AsyncSocket* socket) {
+  auto it = connections_.find(socket);
+  if (it != connections_.end() && !it->second->response.empty())
+    Flush(it->second.get());
+}
+
+void MetricsServer::OnClose(rtc::AsyncSocket* socket, int err) {
+  CloseConnection(socket);
+}
+
+std::string MetricsServer::BuildResponse(const std::string& request) {
+  std::string body;
+  const char* status = "200 OK";
+  if (request.compare(0, strlen(kMetricsPath), kMetricsPath) == 0) {
+    TitanMetrics::Get().Render(&body);
+    if (observer_)
+      observer_->OnCollectMetrics(&body);
+  } else {
+    status = "404 Not Found";
+  }
+
+  char headers[256];
+  sprintfn(headers, sizeof(headers),
+      "HTTP/1.0 %s\r\n"
+      "Content-Length: %i\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      status, static_cast<int>(body.length()));
+  return headers + body;
+}
+
+void MetricsServer::Flush(Connection* connection) {
+  while (connection->sent < connection->response.size()) {
+    int sent = connection->socket->Send(
+        connection->response.data() + connection->sent,
+        connection->response.size() - connection->sent);
+    if (sent <= 0) {
+      if (connection->socket->IsBlocking())
+        return;  // OnWrite will pick it up again.
+      CloseConnection(connection->socket.get());
+      return;
+    }
+    connection->sent += sent;
+  }
+  CloseConnection(connection->socket.get());
+}
+
+void MetricsServer::CloseConnection(rtc::AsyncSocket* socket) {
+  auto it = connections_.find(socket);
+  if (it == connections_.end())
+    return;
+  socket->Close();
+  // We may be inside one of the socket's own signals, so let the thread
+  // delete it once the stack has unwound.
+  rtc::Thread::Current()->Dispose(it->second->socket.release());
+  connections_.erase(it);
+}
@@ -0,0 +1,52 @@
+#ifndef EXAMPLES_PEERCONNECTION_CLIENT_METRICS_SERVER_H_
+#define EXAMPLES_PEERCONNECTION_CLIENT_METRICS_SERVER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "rtc_base/asyncsocket.h"
+#include "rtc_base/sigslot.h"
+
+struct MetricsServerObserver {
+  // Called on the thread that owns the server whenever a scrape comes in.
+  // Implementations append their own samples in Prometheus text format.
+  virtual void OnCollectMetrics(std::string* out) = 0;
+
+ protected:
+  virtual ~MetricsServerObserver() {}
+};
+
+// Minimal HTTP/1.0 listener on the loopback interface that answers every
+// GET /metrics with the Titan counters in Prometheus text format.
+class MetricsServer : public sigslot::has_slots<> {
+ public:
+  explicit MetricsServer(MetricsServerObserver* observer);
+  ~MetricsServer();
+
+  bool Start(int port);
+  void Stop();
+
+ protected:
+  struct Connection {
+    std::unique_ptr<rtc::AsyncSocket> socket;
+    std::string request;
+    std::string response;
+    size_t sent = 0;
+  };
+
+  void OnAccept(rtc::AsyncSocket* socket);
+  void OnRead(rtc::AsyncSocket* socket);
+  void OnWrite(rtc::AsyncSocket* socket);
+  void OnClose(rtc::AsyncSocket* socket, int err);
+
+  std::string BuildResponse(const std::string& request);
+  void Flush(Connection* connection);
+  void CloseConnection(rtc::AsyncSocket* socket);
+
+  MetricsServerObserver* observer_;
+  std::unique_ptr<rtc::AsyncSocket> listener_;
+  std::map<rtc::AsyncSocket*, std::unique_ptr<Connection>> connections_;
+};
+
+#endif  // EXAMPLES_PEERCONNECTION_CLIENT_METRICS_SERVER_H_
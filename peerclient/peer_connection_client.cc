@@ -10,11 +10,18 @@
 #include "pch.h"
 #include "peer_connection_client.h"
 
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "TitanMetrics.h"
 #include "defaults.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/nethelpers.h"
 #include "rtc_base/stringutils.h"
+#include "rtc_base/timeutils.h"
 
 #ifdef WIN32
 #include "rtc_base/win32socketserver.h"
@@ -26,8 +33,32 @@ namespace {
 
 // This is our magical hangup signal.
 const char kByeMessage[] = "BYE";
-// Delay between server connection retries, in milliseconds
-const int kReconnectDelay = 2000;
+// How long a resolved server name is used before it is resolved again, in
+// milliseconds.
+const int kDnsCacheTtl = 5 * 60 * 1000;
+
+// Messages posted to ourselves.
+enum {
+  MSG_RECONNECT,
+  MSG_RECONNECT_HANGING_GET,
+};
+
+// Reads the decimal number at |pos|, like atoi() but stopping at |end|.
+// Returns where the number ends, or NULL when it doesn't fit an int.
+const char* ParseDecimal(const char* pos, const char* end, int* value) {
+  bool negative = pos < end && *pos == '-';
+  if (negative)
+    ++pos;
+  int number = 0;
+  for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos) {
+    int digit = *pos - '0';
+    if (number > (INT_MAX - digit) / 10)
+      return NULL;
+    number = number * 10 + digit;
+  }
+  *value = negative ? -number : number;
+  return pos;
+}
 
 rtc::AsyncSocket* CreateClientSocket(int family) {
 #ifdef WIN32
@@ -47,6 +78,7 @@ rtc::AsyncSocket* CreateClientSocket(int family) {
 
 PeerConnectionClient::PeerConnectionClient()
   : callback_(NULL),
+    dns_cache_(kDnsCacheTtl),
     resolver_(NULL),
     state_(NOT_CONNECTED),
     my_id_(-1) {
@@ -80,6 +112,10 @@ bool PeerConnectionClient::is_connected() const {
   return my_id_ != -1;
 }
 
+PeerConnectionClient::State PeerConnectionClient::state() const {
+  return state_;
+}
+
 const Peers& PeerConnectionClient::peers() const {
   return peers_;
 }
@@ -112,16 +148,33 @@ void PeerConnectionClient::Connect(const std::string& server, int port,
 
   server_address_.SetIP(server);
   server_address_.SetPort(port);
+  server_hostname_ =
+      server_address_.IsUnresolvedIP() ? server : std::string();
   client_name_ = client_name;
 
-  if (server_address_.IsUnresolvedIP()) {
-    state_ = RESOLVING;
-    resolver_ = new rtc::AsyncResolver();
-    resolver_->SignalDone.connect(this, &PeerConnectionClient::OnResolveResult);
-    resolver_->Start(server_address_);
-  } else {
+  ResolveOrConnect();
+}
+
+void PeerConnectionClient::ResolveOrConnect() {
+  if (server_hostname_.empty()) {
     DoConnect();
+    return;
+  }
+
+  rtc::IPAddress ip;
+  if (dns_cache_.Lookup(server_hostname_, rtc::TimeMillis(), &ip)) {
+    TitanMetrics::Get().dns_cache_hits.fetch_add(1,
+                                                 std::memory_order_relaxed);
+    server_address_.SetResolvedIP(ip);
+    DoConnect();
+    return;
   }
+
+  server_address_.SetIP(server_hostname_);
+  state_ = RESOLVING;
+  resolver_ = new rtc::AsyncResolver();
+  resolver_->SignalDone.connect(this, &PeerConnectionClient::OnResolveResult);
+  resolver_->Start(server_address_);
 }
 
 void PeerConnectionClient::OnResolveResult(
@@ -133,6 +186,8 @@ void PeerConnectionClient::OnResolveResult(
     state_ = NOT_CONNECTED;
   } else {
     server_address_ = resolver_->address();
+    dns_cache_.Insert(server_hostname_, server_address_.ipaddr(),
+                      rtc::TimeMillis());
     DoConnect();
   }
 }
@@ -201,7 +256,14 @@ bool PeerConnectionClient::SignOut() {
       onconnect_data_ = buffer;
       return ConnectControlSocket();
     } else {
-      // Can occur if the app is closed before we finish connecting.
+      // Can occur if the app is closed before we finish connecting. A
+      // sign-in still being resolved or retried must not sign us back in
+      // later.
+      rtc::Thread::Current()->Clear(this);
+      if (resolver_ != NULL) {
+        resolver_->Destroy(false);
+        resolver_ = NULL;
+      }
       return true;
     }
   } else {
@@ -212,6 +274,7 @@ bool PeerConnectionClient::SignOut() {
 }
 
 void PeerConnectionClient::Close() {
+  rtc::Thread::Current()->Clear(this);
   control_socket_->Close();
   hanging_get_->Close();
   onconnect_data_.clear();
@@ -334,30 +397,37 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket) {
     bool ok = ParseServerResponse(control_data_, content_length, &peer_id,
                                   &eoh);
     if (ok) {
+      reconnect_.OnSuccess();
       if (my_id_ == -1) {
         // First response.  Let's store our server assigned ID.
         RTC_DCHECK(state_ == SIGNING_IN);
         my_id_ = static_cast<int>(peer_id);
         RTC_DCHECK(my_id_ != -1);
 
-        // The body of the response will be a list of already connected peers.
+        // The body of the response will be a list of already connected peers,
+        // one per line, which is parsed in place.
+        RosterDelta delta;
         if (content_length) {
-          size_t pos = eoh + 4;
-          while (pos < control_data_.size()) {
-            size_t eol = control_data_.find('\n', pos);
-            if (eol == std::string::npos)
+          const char* pos = control_data_.data() + eoh + 4;
+          const char* end = control_data_.data() + control_data_.size();
+          size_t lines = std::count(pos, end, '\n');
+          peers_.reserve(peers_.size() + lines);
+          delta.added.reserve(lines);
+          while (pos < end) {
+            const char* eol = static_cast<const char*>(
+                memchr(pos, '\n', end - pos));
+            if (!eol)
               break;
-            int id = 0;
-            std::string name;
-            bool connected;
-            if (ParseEntry(control_data_.substr(pos, eol - pos), &name, &id,
-                           &connected) && id != my_id_) {
-              peers_[id] = name;
-              callback_->OnPeerConnected(id, name);
+            RosterEntry entry;
+            if (ParseEntry(pos, eol - pos, &entry) && entry.id != my_id_) {
+              entry.connected = true;
+              UpdatePeer(entry, &delta);
             }
             pos = eol + 1;
           }
         }
+        if (!delta.empty())
+          callback_->OnRosterChanged(delta);
         RTC_DCHECK(is_connected());
         callback_->OnSignedIn();
       } else if (state_ == SIGNING_OUT) {
@@ -387,25 +457,21 @@ void PeerConnectionClient::OnHangingGetRead(rtc::AsyncSocket* socket) {
                                   &peer_id, &eoh);
 
     if (ok) {
+      reconnect_.OnSuccess();
       // Store the position where the body begins.
       size_t pos = eoh + 4;
 
       if (my_id_ == static_cast<int>(peer_id)) {
         // A notification about a new member or a member that just
         // disconnected.
-        int id = 0;
-        std::string name;
-        bool connected = false;
-        if (ParseEntry(notification_data_.substr(pos), &name, &id,
-                       &connected)) {
-          if (connected) {
-            peers_[id] = name;
-            callback_->OnPeerConnected(id, name);
-          } else {
-            peers_.erase(id);
-            callback_->OnPeerDisconnected(id);
-          }
+        RosterEntry entry;
+        RosterDelta delta;
+        if (ParseEntry(notification_data_.data() + pos,
+                       notification_data_.size() - pos, &entry)) {
+          UpdatePeer(entry, &delta);
         }
+        if (!delta.empty())
+          callback_->OnRosterChanged(delta);
       } else {
         OnMessageFromPeer(static_cast<int>(peer_id),
                           notification_data_.substr(pos));
@@ -421,26 +487,55 @@ void PeerConnectionClient::OnHangingGetRead(rtc::AsyncSocket* socket) {
   }
 }
 
-bool PeerConnectionClient::ParseEntry(const std::string& entry,
-                                      std::string* name,
-                                      int* id,
-                                      bool* connected) {
-  RTC_DCHECK(name != NULL);
-  RTC_DCHECK(id != NULL);
-  RTC_DCHECK(connected != NULL);
-  RTC_DCHECK(!entry.empty());
-
-  *connected = false;
-  size_t separator = entry.find(',');
-  if (separator != std::string::npos) {
-    *id = atoi(&entry[separator + 1]);
-    name->assign(entry.substr(0, separator));
-    separator = entry.find(',', separator + 1);
-    if (separator != std::string::npos) {
-      *connected = atoi(&entry[separator + 1]) ? true : false;
+bool PeerConnectionClient::ParseEntry(const char* data,
+                                      size_t size,
+                                      RosterEntry* entry) {
+  RTC_DCHECK(entry != NULL);
+
+  const char* end = data + size;
+  entry->name = data;
+  entry->name_length = 0;
+  entry->id = 0;
+  entry->connected = false;
+  const char* separator =
+      static_cast<const char*>(memchr(data, ',', size));
+  if (separator) {
+    entry->name_length = separator - data;
+    separator = ParseDecimal(separator + 1, end, &entry->id);
+    if (!separator)
+      return false;
+    separator = static_cast<const char*>(
+        memchr(separator, ',', end - separator));
+    if (separator) {
+      int connected = 0;
+      if (!ParseDecimal(separator + 1, end, &connected))
+        return false;
+      entry->connected = connected != 0;
     }
   }
-  return !name->empty();
+  return entry->name_length != 0;
+}
+
+void PeerConnectionClient::UpdatePeer(const RosterEntry& entry,
+                                      RosterDelta* delta) {
+  if (!entry.connected) {
+    if (peers_.erase(entry.id) != 0)
+      delta->removed.push_back(entry.id);
+    return;
+  }
+  auto found = peers_.find(entry.id);
+  if (found == peers_.end()) {
+    // The name is copied once into the roster, and once more for the
+    // observer.
+    found = peers_.emplace(entry.id,
+                           std::string(entry.name, entry.name_length))
+                .first;
+    delta->added.emplace_back(entry.id, found->second);
+  } else if (found->second.compare(0, std::string::npos, entry.name,
+                                   entry.name_length) != 0) {
+    found->second.assign(entry.name, entry.name_length);
+    delta->changed.emplace_back(entry.id, found->second);
+  }
 }
 
 int PeerConnectionClient::GetResponseStatus(const std::string& response) {
@@ -490,24 +585,64 @@ void PeerConnectionClient::OnClose(rtc::AsyncSocket* socket, int err) {
     if (socket == hanging_get_.get()) {
       if (state_ == CONNECTED) {
         hanging_get_->Close();
-        hanging_get_->Connect(server_address_);
+        // The server closes the hanging GET after every notification, which
+        // is when it is connected again right away.
+        if (err == 0) {
+          hanging_get_->Connect(server_address_);
+        } else if (!ScheduleReconnect(MSG_RECONNECT_HANGING_GET)) {
+          Close();
+          callback_->OnDisconnected();
+        }
       }
     } else {
       callback_->OnMessageSent(err);
     }
   } else {
     if (socket == control_socket_.get()) {
-      RTC_LOG(WARNING) << "Connection refused; retrying in 2 seconds";
-      rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kReconnectDelay, this,
-                                          0);
-    } else {
+      ScheduleReconnect(MSG_RECONNECT);
+    } else if (state_ != CONNECTED ||
+               !ScheduleReconnect(MSG_RECONNECT_HANGING_GET)) {
       Close();
       callback_->OnDisconnected();
     }
   }
 }
 
+bool PeerConnectionClient::ScheduleReconnect(uint32_t message_id) {
+  int delay = reconnect_.OnFailure();
+  if (reconnect_.state() == ReconnectScheduler::OPEN) {
+    // The server may have moved along with going down.
+    dns_cache_.Invalidate(server_hostname_);
+    // Without the hanging GET we are not signed in anymore.
+    if (message_id == MSG_RECONNECT_HANGING_GET) {
+      RTC_LOG(WARNING) << "Lost the server after " << reconnect_.failures()
+                       << " attempts";
+      return false;
+    }
+  }
+  RTC_LOG(WARNING) << "Connection to the server failed; retrying in "
+                   << delay << " ms";
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this,
+                                      message_id);
+  return true;
+}
+
 void PeerConnectionClient::OnMessage(rtc::Message* msg) {
-  // ignore msg; there is currently only one supported message ("retry")
-  DoConnect();
+  // Signed out, or back to connected, since the retry was scheduled.
+  if (msg->message_id == MSG_RECONNECT && state_ != SIGNING_IN)
+    return;
+  reconnect_.OnAttempt();
+  TitanMetrics::Get().signaling_reconnects.fetch_add(
+      1, std::memory_order_relaxed);
+  switch (msg->message_id) {
+    case MSG_RECONNECT:
+      ResolveOrConnect();
+      break;
+    case MSG_RECONNECT_HANGING_GET:
+      if (state_ == CONNECTED &&
+          hanging_get_->GetState() == rtc::Socket::CS_CLOSED) {
+        hanging_get_->Connect(server_address_);
+      }
+      break;
+  }
 }
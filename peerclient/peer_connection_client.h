@@ -11,21 +11,40 @@
 #ifndef EXAMPLES_PEERCONNECTION_CLIENT_PEER_CONNECTION_CLIENT_H_
 #define EXAMPLES_PEERCONNECTION_CLIENT_PEER_CONNECTION_CLIENT_H_
 
-#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "reconnect_scheduler.h"
 #include "rtc_base/nethelpers.h"
 #include "rtc_base/physicalsocketserver.h"
 #include "rtc_base/signalthread.h"
 #include "rtc_base/sigslot.h"
 
-typedef std::map<int, std::string> Peers;
+typedef std::unordered_map<int, std::string> Peers;
+
+// What changed in the list of peers, so that it can be updated in place
+// instead of being built anew.
+struct RosterDelta {
+  bool empty() const {
+    return added.empty() && removed.empty() && changed.empty();
+  }
+
+  std::vector<std::pair<int, std::string>> added;
+  std::vector<int> removed;
+  // Peers that signed in again under another name.
+  std::vector<std::pair<int, std::string>> changed;
+};
 
 struct PeerConnectionClientObserver {
   virtual void OnSignedIn() = 0;  // Called when we're logged on.
   virtual void OnDisconnected() = 0;
-  virtual void OnPeerConnected(int id, const std::string& name) = 0;
+  // The peers already connected at sign-in come as a single delta, ahead of
+  // OnSignedIn().
+  virtual void OnRosterChanged(const RosterDelta& delta) = 0;
+  // The peer hung up.
   virtual void OnPeerDisconnected(int peer_id) = 0;
   virtual void OnMessageFromPeer(int peer_id, const std::string& message) = 0;
   virtual void OnMessageSent(int err) = 0;
@@ -35,8 +54,8 @@ struct PeerConnectionClientObserver {
   virtual ~PeerConnectionClientObserver() {}
 };
 
-class PeerConnectionClient : public sigslot::has_slots<>,
-                             public rtc::MessageHandler {
+// A connection to the signaling tier, be it one server or several.
+class SignalingClient {
  public:
   enum State {
     NOT_CONNECTED,
@@ -47,28 +66,55 @@ class PeerConnectionClient : public sigslot::has_slots<>,
     SIGNING_OUT,
   };
 
+  virtual ~SignalingClient() {}
+
+  virtual int id() const = 0;
+  virtual bool is_connected() const = 0;
+  virtual State state() const = 0;
+  virtual const Peers& peers() const = 0;
+
+  virtual void RegisterObserver(PeerConnectionClientObserver* callback) = 0;
+
+  virtual void Connect(const std::string& server, int port,
+                       const std::string& client_name) = 0;
+
+  virtual bool SendToPeer(int peer_id, const std::string& message) = 0;
+  virtual bool SendHangUp(int peer_id) = 0;
+  virtual bool IsSendingMessage() = 0;
+
+  virtual bool SignOut() = 0;
+};
+
+class PeerConnectionClient : public SignalingClient,
+                             public sigslot::has_slots<>,
+                             public rtc::MessageHandler {
+ public:
   PeerConnectionClient();
-  ~PeerConnectionClient();
+  ~PeerConnectionClient() override;
 
-  int id() const;
-  bool is_connected() const;
-  const Peers& peers() const;
+  int id() const override;
+  bool is_connected() const override;
+  State state() const override;
+  const Peers& peers() const override;
 
-  void RegisterObserver(PeerConnectionClientObserver* callback);
+  void RegisterObserver(PeerConnectionClientObserver* callback) override;
 
   void Connect(const std::string& server, int port,
-               const std::string& client_name);
+               const std::string& client_name) override;
 
-  bool SendToPeer(int peer_id, const std::string& message);
-  bool SendHangUp(int peer_id);
-  bool IsSendingMessage();
+  bool SendToPeer(int peer_id, const std::string& message) override;
+  bool SendHangUp(int peer_id) override;
+  bool IsSendingMessage() override;
 
-  bool SignOut();
+  bool SignOut() override;
 
   // implements the MessageHandler interface
   void OnMessage(rtc::Message* msg);
 
  protected:
+  // Resolves the server's name unless the cache still knows it, then
+  // connects.
+  void ResolveOrConnect();
   void DoConnect();
   void Close();
   void InitSocketSignals();
@@ -92,21 +138,42 @@ class PeerConnectionClient : public sigslot::has_slots<>,
 
   void OnHangingGetRead(rtc::AsyncSocket* socket);
 
-  // Parses a single line entry in the form "<name>,<id>,<connected>"
-  bool ParseEntry(const std::string& entry, std::string* name, int* id,
-                  bool* connected);
+  // One entry of the peer list, pointing into the buffer it was parsed from.
+  struct RosterEntry {
+    const char* name;
+    size_t name_length;
+    int id;
+    bool connected;
+  };
+
+  // Parses a single line entry in the form "<name>,<id>,<connected>" from
+  // the |size| bytes at |data|, without copying any of it.
+  bool ParseEntry(const char* data, size_t size, RosterEntry* entry);
 
   int GetResponseStatus(const std::string& response);
 
+  // Applies one entry of the peer list to |peers_|, noting the change in
+  // |delta|.
+  void UpdatePeer(const RosterEntry& entry, RosterDelta* delta);
+
   bool ParseServerResponse(const std::string& response, size_t content_length,
                            size_t* peer_id, size_t* eoh);
 
   void OnClose(rtc::AsyncSocket* socket, int err);
 
+  // Posts |message_id| to try the server again after the delay the
+  // scheduler chose. Returns false if instead the hanging GET should give
+  // up, because the breaker opened.
+  bool ScheduleReconnect(uint32_t message_id);
+
   void OnResolveResult(rtc::AsyncResolverInterface* resolver);
 
   PeerConnectionClientObserver* callback_;
   rtc::SocketAddress server_address_;
+  // Empty when the server was given by its address.
+  std::string server_hostname_;
+  DnsCache dns_cache_;
+  ReconnectScheduler reconnect_;
   rtc::AsyncResolver* resolver_;
   std::unique_ptr<rtc::AsyncSocket> control_socket_;
   std::unique_ptr<rtc::AsyncSocket> hanging_get_;
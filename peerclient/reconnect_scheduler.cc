@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "reconnect_scheduler.h"
+
+#include <algorithm>
+
+#include "rtc_base/timeutils.h"
+
+ReconnectScheduler::ReconnectScheduler()
+  : ReconnectScheduler(Config()) {
+}
+
+ReconnectScheduler::ReconnectScheduler(const Config& config)
+  : config_(config),
+    // Seeded from the clock, so that clients started together still draw
+    // different delays.
+    random_(static_cast<uint64_t>(rtc::TimeMicros()) | 1),
+    state_(CLOSED),
+    failures_(0) {
+}
+
+int ReconnectScheduler::OnFailure() {
+  ++failures_;
+  if (state_ == HALF_OPEN || failures_ >= config_.failure_threshold) {
+    state_ = OPEN;
+    return Jitter(config_.open_duration_ms);
+  }
+  int delay_ms = config_.initial_delay_ms;
+  for (int i = 1; i < failures_ && delay_ms < config_.max_delay_ms; ++i)
+    delay_ms *= 2;
+  return Jitter(std::min(delay_ms, config_.max_delay_ms));
+}
+
+void ReconnectScheduler::OnAttempt() {
+  if (state_ == OPEN)
+    state_ = HALF_OPEN;
+}
+
+void ReconnectScheduler::OnSuccess() {
+  state_ = CLOSED;
+  failures_ = 0;
+}
+
+int ReconnectScheduler::Jitter(int delay_ms) {
+  int half = delay_ms / 2;
+  return half + static_cast<int>(
+      random_.Rand(0, static_cast<uint32_t>(delay_ms - half)));
+}
+
+DnsCache::DnsCache(int ttl_ms) : ttl_ms_(ttl_ms) {
+}
+
+bool DnsCache::Lookup(const std::string& hostname, int64_t now_ms,
+                      rtc::IPAddress* ip) const {
+  auto found = entries_.find(hostname);
+  if (found == entries_.end() || now_ms >= found->second.expires_ms)
+    return false;
+  *ip = found->second.ip;
+  return true;
+}
+
+void DnsCache::Insert(const std::string& hostname, const rtc::IPAddress& ip,
+                      int64_t now_ms) {
+  entries_[hostname] = {ip, now_ms + ttl_ms_};
+}
+
+void DnsCache::Invalidate(const std::string& hostname) {
+  entries_.erase(hostname);
+}
@@ -0,0 +1,87 @@
+#ifndef EXAMPLES_PEERCONNECTION_CLIENT_RECONNECT_SCHEDULER_H_
+#define EXAMPLES_PEERCONNECTION_CLIENT_RECONNECT_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "rtc_base/ipaddress.h"
+#include "rtc_base/random.h"
+
+// Decides how long to wait before trying the signaling server again.
+//
+// The delay doubles with every failure in a row, from |initial_delay_ms| up
+// to |max_delay_ms|, and is drawn at random from its upper half. A single
+// client is back within a fraction of a second after a hiccup, while the
+// clients a server restart cut off all at once spread their returns instead
+// of coming back in lockstep.
+//
+// After |failure_threshold| failures in a row the breaker opens: the server
+// is taken to be down and left alone for about |open_duration_ms|. The next
+// attempt is a probe, which closes the breaker if it succeeds and opens it
+// again if it fails.
+class ReconnectScheduler {
+ public:
+  struct Config {
+    int initial_delay_ms = 250;
+    int max_delay_ms = 30000;
+    int failure_threshold = 8;
+    int open_duration_ms = 60000;
+  };
+
+  enum State {
+    CLOSED,
+    OPEN,
+    HALF_OPEN,
+  };
+
+  ReconnectScheduler();
+  explicit ReconnectScheduler(const Config& config);
+
+  State state() const { return state_; }
+  int failures() const { return failures_; }
+
+  // Records a failed attempt and returns the delay before the next one, in
+  // milliseconds.
+  int OnFailure();
+  // To be called when the delay is over and the next attempt starts.
+  void OnAttempt();
+  // The server answered, the next failure starts over from the shortest
+  // delay.
+  void OnSuccess();
+
+ private:
+  // A random delay in the upper half of [0, |delay_ms|].
+  int Jitter(int delay_ms);
+
+  const Config config_;
+  webrtc::Random random_;
+  State state_;
+  int failures_;
+};
+
+// Addresses host names resolved to, kept for |ttl_ms| so that reconnecting
+// doesn't resolve the server's name again every time. The resolver doesn't
+// report the TTL of the records it found, so all entries live equally long.
+class DnsCache {
+ public:
+  explicit DnsCache(int ttl_ms);
+
+  bool Lookup(const std::string& hostname, int64_t now_ms,
+              rtc::IPAddress* ip) const;
+  void Insert(const std::string& hostname, const rtc::IPAddress& ip,
+              int64_t now_ms);
+  void Invalidate(const std::string& hostname);
+
+ private:
+  struct Entry {
+    rtc::IPAddress ip;
+    int64_t expires_ms;
+  };
+
+  const int ttl_ms_;
+  std::map<std::string, Entry> entries_;
+};
+
+#endif  // EXAMPLES_PEERCONNECTION_CLIENT_RECONNECT_SCHEDULER_H_
@@ -0,0 +1,265 @@
+#include "pch.h"
+#include "sharded_signaling_client.h"
+
+#include <limits.h>
+
+#include "defaults.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/stringencode.h"
+
+bool ParseSignalingServers(const char* list,
+                           std::vector<rtc::SocketAddress>* servers) {
+  servers->clear();
+  std::vector<std::string> entries;
+  rtc::split(list, ',', &entries);
+  for (const std::string& entry : entries) {
+    rtc::SocketAddress server;
+    if (entry.find(':') == std::string::npos)
+      server.SetIP(entry);
+    else if (!server.FromString(entry))
+      return false;
+    if (server.hostname().empty())
+      return false;
+    // Like --port, a server given without one listens on the default.
+    if (server.port() == 0)
+      server.SetPort(kDefaultServerPort);
+    servers->push_back(server);
+  }
+  return !servers->empty();
+}
+
+ShardedSignalingClient::Shard::Shard(ShardedSignalingClient* owner,
+                                     size_t index,
+                                     const rtc::SocketAddress& server)
+  : owner_(owner),
+    index_(index),
+    server_(server) {
+  client_.RegisterObserver(this);
+}
+
+void ShardedSignalingClient::Shard::OnSignedIn() {
+  owner_->OnShardSignedIn(this);
+}
+
+void ShardedSignalingClient::Shard::OnDisconnected() {
+  owner_->OnShardDisconnected(this);
+}
+
+void ShardedSignalingClient::Shard::OnRosterChanged(const RosterDelta& delta) {
+  owner_->OnShardRosterChanged(this, delta);
+}
+
+void ShardedSignalingClient::Shard::OnPeerDisconnected(int peer_id) {
+  if (!owner_->HasGlobalId(peer_id)) {
+    RTC_LOG(WARNING) << "Ignoring peer " << peer_id << " of shard " << index_;
+    return;
+  }
+  owner_->callback_->OnPeerDisconnected(owner_->GlobalId(this, peer_id));
+}
+
+void ShardedSignalingClient::Shard::OnMessageFromPeer(
+    int peer_id,
+    const std::string& message) {
+  if (!owner_->HasGlobalId(peer_id)) {
+    RTC_LOG(WARNING) << "Ignoring message from peer " << peer_id
+                     << " of shard " << index_;
+    return;
+  }
+  owner_->callback_->OnMessageFromPeer(owner_->GlobalId(this, peer_id),
+                                       message);
+}
+
+void ShardedSignalingClient::Shard::OnMessageSent(int err) {
+  owner_->callback_->OnMessageSent(err);
+}
+
+void ShardedSignalingClient::Shard::OnServerConnectionFailure() {
+  owner_->OnShardConnectionFailure(this);
+}
+
+ShardedSignalingClient::ShardedSignalingClient(
+    const std::vector<rtc::SocketAddress>& servers)
+  : callback_(NULL),
+    signed_in_(false) {
+  // Shard 0 is the server Connect() is given.
+  shards_.emplace_back(new Shard(this, 0, rtc::SocketAddress()));
+  for (const rtc::SocketAddress& server : servers)
+    shards_.emplace_back(new Shard(this, shards_.size(), server));
+}
+
+ShardedSignalingClient::~ShardedSignalingClient() {
+}
+
+int ShardedSignalingClient::id() const {
+  for (const auto& shard : shards_) {
+    if (shard->client()->is_connected() &&
+        HasGlobalId(shard->client()->id())) {
+      return GlobalId(shard.get(), shard->client()->id());
+    }
+  }
+  return -1;
+}
+
+bool ShardedSignalingClient::is_connected() const {
+  for (const auto& shard : shards_) {
+    if (shard->client()->is_connected())
+      return true;
+  }
+  return false;
+}
+
+SignalingClient::State ShardedSignalingClient::state() const {
+  // The furthest along of the shards, but any signed in one makes the
+  // client connected.
+  State state = NOT_CONNECTED;
+  for (const auto& shard : shards_) {
+    State shard_state = shard->client()->state();
+    if (shard_state == CONNECTED)
+      return CONNECTED;
+    if (state == NOT_CONNECTED)
+      state = shard_state;
+  }
+  return state;
+}
+
+const Peers& ShardedSignalingClient::peers() const {
+  return peers_;
+}
+
+void ShardedSignalingClient::RegisterObserver(
+    PeerConnectionClientObserver* callback) {
+  RTC_DCHECK(!callback_);
+  callback_ = callback;
+}
+
+void ShardedSignalingClient::Connect(const std::string& server, int port,
+                                     const std::string& client_name) {
+  shards_[0]->client()->Connect(server, port, client_name);
+  for (size_t i = 1; i < shards_.size(); ++i) {
+    const rtc::SocketAddress& address = shards_[i]->server();
+    shards_[i]->client()->Connect(address.hostname(), address.port(),
+                                  client_name);
+  }
+}
+
+bool ShardedSignalingClient::SendToPeer(int peer_id,
+                                        const std::string& message) {
+  int local_id = -1;
+  Shard* shard = Route(peer_id, &local_id);
+  return shard && shard->client()->SendToPeer(local_id, message);
+}
+
+bool ShardedSignalingClient::SendHangUp(int peer_id) {
+  int local_id = -1;
+  Shard* shard = Route(peer_id, &local_id);
+  return shard && shard->client()->SendHangUp(local_id);
+}
+
+bool ShardedSignalingClient::IsSendingMessage() {
+  // Messages go out one at a time whichever server they are for, which
+  // keeps them in the order they were signaled.
+  for (const auto& shard : shards_) {
+    if (shard->client()->IsSendingMessage())
+      return true;
+  }
+  return false;
+}
+
+bool ShardedSignalingClient::SignOut() {
+  bool signed_out = true;
+  for (const auto& shard : shards_)
+    signed_out &= shard->client()->SignOut();
+  return signed_out;
+}
+
+bool ShardedSignalingClient::HasGlobalId(int peer_id) const {
+  int count = static_cast<int>(shards_.size());
+  return peer_id >= 0 && peer_id <= (INT_MAX - (count - 1)) / count;
+}
+
+int ShardedSignalingClient::GlobalId(const Shard* shard, int peer_id) const {
+  RTC_DCHECK(HasGlobalId(peer_id));
+  return peer_id * static_cast<int>(shards_.size()) +
+         static_cast<int>(shard->index());
+}
+
+ShardedSignalingClient::Shard* ShardedSignalingClient::Route(int peer_id,
+                                                             int* local_id) {
+  if (peer_id < 0)
+    return nullptr;
+  int count = static_cast<int>(shards_.size());
+  *local_id = peer_id / count;
+  return shards_[peer_id % count].get();
+}
+
+void ShardedSignalingClient::OnShardSignedIn(Shard* shard) {
+  RTC_LOG(INFO) << "Signed in to shard " << shard->index();
+  if (signed_in_)
+    return;
+  signed_in_ = true;
+  callback_->OnSignedIn();
+}
+
+void ShardedSignalingClient::OnShardDisconnected(Shard* shard) {
+  RTC_LOG(INFO) << "Disconnected from shard " << shard->index();
+  // The shard forgot its peers without telling, which the others must not
+  // do along with it.
+  RosterDelta delta;
+  for (auto it = peers_.begin(); it != peers_.end();) {
+    if (it->first % static_cast<int>(shards_.size()) ==
+        static_cast<int>(shard->index())) {
+      delta.removed.push_back(it->first);
+      it = peers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (is_connected()) {
+    if (!delta.empty())
+      callback_->OnRosterChanged(delta);
+    return;
+  }
+  signed_in_ = false;
+  callback_->OnDisconnected();
+}
+
+void ShardedSignalingClient::OnShardRosterChanged(Shard* shard,
+                                                  const RosterDelta& delta) {
+  RosterDelta merged;
+  merged.added.reserve(delta.added.size());
+  // A server handing out ids too large to share the id space with the
+  // others would have its peers collide with theirs, so those are left out.
+  for (const auto& peer : delta.added) {
+    if (!HasGlobalId(peer.first))
+      continue;
+    int id = GlobalId(shard, peer.first);
+    peers_[id] = peer.second;
+    merged.added.emplace_back(id, peer.second);
+  }
+  for (int peer_id : delta.removed) {
+    if (!HasGlobalId(peer_id))
+      continue;
+    int id = GlobalId(shard, peer_id);
+    peers_.erase(id);
+    merged.removed.push_back(id);
+  }
+  for (const auto& peer : delta.changed) {
+    if (!HasGlobalId(peer.first))
+      continue;
+    int id = GlobalId(shard, peer.first);
+    peers_[id] = peer.second;
+    merged.changed.emplace_back(id, peer.second);
+  }
+  callback_->OnRosterChanged(merged);
+}
+
+void ShardedSignalingClient::OnShardConnectionFailure(Shard* shard) {
+  RTC_LOG(WARNING) << "Failed to connect to shard " << shard->index();
+  // Only worth reporting once no server is left to sign in to.
+  for (const auto& other : shards_) {
+    if (other->client()->state() != NOT_CONNECTED)
+      return;
+  }
+  callback_->OnServerConnectionFailure();
+}
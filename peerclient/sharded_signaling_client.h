@@ -0,0 +1,94 @@
+#ifndef EXAMPLES_PEERCONNECTION_CLIENT_SHARDED_SIGNALING_CLIENT_H_
+#define EXAMPLES_PEERCONNECTION_CLIENT_SHARDED_SIGNALING_CLIENT_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "peer_connection_client.h"
+#include "rtc_base/socketaddress.h"
+
+// Parses a comma separated list of <host>[:<port>] signaling servers. A
+// missing port is the default one.
+bool ParseSignalingServers(const char* list,
+                           std::vector<rtc::SocketAddress>* servers);
+
+// Signs in to several signaling servers at once, so that peers can spread
+// over a tier of servers instead of all sharing one.
+//
+// The rosters of all servers are merged into one. The server a peer signed
+// in to is encoded in the id it is known by here: shard <index> knows it as
+// <id / shard count>, which is where SendToPeer() takes messages for it.
+// A peer that signed in to more than one server is listed once for each.
+//
+// The client counts as signed in while any server has it signed in, and as
+// disconnected once the last server let it go.
+class ShardedSignalingClient : public SignalingClient {
+ public:
+  // Connect() signs in to the server it is given and to |servers|.
+  explicit ShardedSignalingClient(
+      const std::vector<rtc::SocketAddress>& servers);
+  ~ShardedSignalingClient() override;
+
+  // SignalingClient implementation.
+  int id() const override;
+  bool is_connected() const override;
+  State state() const override;
+  const Peers& peers() const override;
+  void RegisterObserver(PeerConnectionClientObserver* callback) override;
+  void Connect(const std::string& server, int port,
+               const std::string& client_name) override;
+  bool SendToPeer(int peer_id, const std::string& message) override;
+  bool SendHangUp(int peer_id) override;
+  bool IsSendingMessage() override;
+  bool SignOut() override;
+
+ protected:
+  // One server, observed on behalf of the sharded client.
+  class Shard : public PeerConnectionClientObserver {
+   public:
+    Shard(ShardedSignalingClient* owner, size_t index,
+          const rtc::SocketAddress& server);
+
+    size_t index() const { return index_; }
+    const rtc::SocketAddress& server() const { return server_; }
+    PeerConnectionClient* client() { return &client_; }
+    const PeerConnectionClient* client() const { return &client_; }
+
+    // PeerConnectionClientObserver implementation.
+    void OnSignedIn() override;
+    void OnDisconnected() override;
+    void OnRosterChanged(const RosterDelta& delta) override;
+    void OnPeerDisconnected(int peer_id) override;
+    void OnMessageFromPeer(int peer_id, const std::string& message) override;
+    void OnMessageSent(int err) override;
+    void OnServerConnectionFailure() override;
+
+   private:
+    ShardedSignalingClient* const owner_;
+    const size_t index_;
+    rtc::SocketAddress server_;
+    PeerConnectionClient client_;
+  };
+
+  // Whether |peer_id| as a shard knows it has a global id that fits an int.
+  bool HasGlobalId(int peer_id) const;
+  int GlobalId(const Shard* shard, int peer_id) const;
+  // The shard |peer_id| lives on, and its id there. Null for an id that
+  // isn't one of ours.
+  Shard* Route(int peer_id, int* local_id);
+
+  void OnShardSignedIn(Shard* shard);
+  void OnShardDisconnected(Shard* shard);
+  void OnShardRosterChanged(Shard* shard, const RosterDelta& delta);
+  void OnShardConnectionFailure(Shard* shard);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  PeerConnectionClientObserver* callback_;
+  Peers peers_;
+  bool signed_in_;
+};
+
+#endif  // EXAMPLES_PEERCONNECTION_CLIENT_SHARDED_SIGNALING_CLIENT_H_